@@ -0,0 +1,78 @@
+/**
+ * \file bench.h
+ * \brief A minimal micro benchmark harness for the fts-net library.
+ *
+ * Benchmarks register themselves with FTS_BENCH and are run by
+ * bench_main.cpp. Run the executable with a name fragment as argument
+ * to run only the matching benchmarks.
+ **/
+
+#ifndef FTS_BENCH_H
+#define FTS_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace FTSBench {
+
+/// Number of heap allocations done so far (operator new and the pool's mallocs).
+std::uint64_t heapAllocations();
+/// Number of buffers handed out by the packet buffer pool so far.
+std::uint64_t poolAllocations();
+
+/// Prints one result line.
+void report( const std::string& in_name, std::uint64_t in_iterations, double in_nsPerOp, const std::string& in_extra = "" );
+
+using BenchFn = void (*)();
+struct Registrar {
+    Registrar( const char* in_name, BenchFn in_fn );
+};
+
+/// Keeps the compiler from optimizing away a value.
+template<class T>
+inline void keep( T const& in_v )
+{
+#if defined(__GNUC__)
+    asm volatile( "" : : "g"( &in_v ) : "memory" );
+#else
+    static volatile const void* sink;
+    sink = &in_v;
+#endif
+}
+
+/// Runs \a in_f \a in_iterations times and returns the nanoseconds per run.
+template<class F>
+double measure( std::uint64_t in_iterations, F&& in_f )
+{
+    auto start = std::chrono::steady_clock::now();
+    for( std::uint64_t i = 0; i < in_iterations; ++i ) {
+        in_f();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>( stop - start ).count() / (double) in_iterations;
+}
+
+/// Runs \a in_f and reports the time and the allocations per run.
+template<class F>
+void measureAndReport( const std::string& in_name, std::uint64_t in_iterations, F&& in_f )
+{
+    in_f(); // warm up the caches and the buffer pool.
+    auto heap = heapAllocations();
+    auto pool = poolAllocations();
+    auto ns = measure( in_iterations, in_f );
+    auto heapPerOp = (double) (heapAllocations() - heap) / (double) in_iterations;
+    auto poolPerOp = (double) (poolAllocations() - pool) / (double) in_iterations;
+    report( in_name, in_iterations, ns, "heap allocs/op: " + std::to_string( heapPerOp ) + "  pool allocs/op: " + std::to_string( poolPerOp ) );
+}
+
+}
+
+#define FTS_BENCH( name ) \
+    static void name(); \
+    static FTSBench::Registrar name##_registrar( #name, name ); \
+    static void name()
+
+#endif /* FTS_BENCH_H */
+
+ /* EOF */
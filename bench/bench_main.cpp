@@ -0,0 +1,75 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench.h"
+#include "packet_buffer_pool.h"
+
+namespace {
+
+std::atomic<std::uint64_t> g_newCalls( 0 );
+
+std::vector<std::pair<std::string, FTSBench::BenchFn>>& registry()
+{
+    static std::vector<std::pair<std::string, FTSBench::BenchFn>> benches;
+    return benches;
+}
+
+}
+
+// Count every heap allocation done through operator new.
+void* operator new( std::size_t in_size )
+{
+    g_newCalls.fetch_add( 1, std::memory_order_relaxed );
+    if( void* p = std::malloc( in_size ? in_size : 1 ) ) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete( void* in_p ) noexcept
+{
+    std::free( in_p );
+}
+
+void operator delete( void* in_p, std::size_t ) noexcept
+{
+    std::free( in_p );
+}
+
+std::uint64_t FTSBench::heapAllocations()
+{
+    auto stats = FTS::PacketBufferPool::instance().getStats();
+    return g_newCalls.load() + stats.misses + stats.oversized;
+}
+
+std::uint64_t FTSBench::poolAllocations()
+{
+    return FTS::PacketBufferPool::instance().getStats().allocations;
+}
+
+void FTSBench::report( const std::string& in_name, std::uint64_t in_iterations, double in_nsPerOp, const std::string& in_extra )
+{
+    std::printf( "%-48s %10llu it %12.1f ns/op  %s\n", in_name.c_str(), (unsigned long long) in_iterations, in_nsPerOp, in_extra.c_str() );
+    std::fflush( stdout );
+}
+
+FTSBench::Registrar::Registrar( const char* in_name, BenchFn in_fn )
+{
+    registry().emplace_back( in_name, in_fn );
+}
+
+int main( int argc, char** argv )
+{
+    std::string filter = argc > 1 ? argv[1] : "";
+    for( auto& bench : registry() ) {
+        if( bench.first.find( filter ) != std::string::npos ) {
+            bench.second();
+        }
+    }
+    return 0;
+}
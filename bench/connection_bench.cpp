@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "connection.h"
+#include "connection_waiter.h"
+#include "dsrv_constants.h"
+#include "multi_reactor.h"
+#include "reactor.h"
+#include "worker_pool.h"
+
+using namespace FTS;
+using namespace FTSBench;
+
+// The server echoes every CHAT_GETMSG; a PLAYER_SET is the first half of a
+// request and isn't answered on its own.
+static void echoServer( std::uint16_t in_usPort, const ConnectionOptions& in_options, ConnectionWaiter::ConnectionType in_type )
+{
+    std::unique_ptr<Connection> pCon;
+    std::unique_ptr<ConnectionWaiter> pWaiter( ConnectionWaiter::create( in_type ) );
+    if( pWaiter->init( in_usPort, [&pCon]( Connection* in_pCon ) { pCon.reset( in_pCon ); }, in_options ) != 0 ) {
+        return;
+    }
+    if( !pWaiter->waitForThenDoConnection( 2000 ) ) {
+        return;
+    }
+
+    pCon->setMaxWaitMillisec( 5000 );
+    while( pCon->isConnected() ) {
+        auto p = pCon->receivePacket();
+        if( p != nullptr && p->getType() == DSRV_MSG_CHAT_GETMSG ) {
+            pCon->send( p.get() );
+        }
+    }
+}
+
+// Round trips on loopback, for each socket option on its own.
+FTS_BENCH( connection_loopback_latency )
+{
+    struct Case {
+        const char* name;
+        ConnectionOptions options;
+    };
+    Case cases[6];
+    cases[0].name = "defaults";
+    cases[1].name = "TCP_NODELAY";
+    cases[1].options.bNoDelay = true;
+    cases[2].name = "TCP_QUICKACK";
+    cases[2].options.bQuickAck = true;
+    cases[3].name = "SO_BUSY_POLL 50us";
+    cases[3].options.iBusyPollMicrosec = 50;
+    cases[4].name = "256 KB buffers";
+    cases[4].options.iSendBufSize = 256 * 1024;
+    cases[4].options.iRecvBufSize = 256 * 1024;
+    cases[5].name = "keepalive";
+    cases[5].options.bKeepAlive = true;
+    cases[5].options.iKeepAliveIdleSec = 10;
+
+    std::uint16_t usPort = 41730;
+    for( auto& c : cases ) {
+        std::thread server( echoServer, usPort, c.options, ConnectionWaiter::ConnectionType::SOCKET );
+        std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+        std::unique_ptr<Connection> pCli( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort++, 1000, c.options ) );
+        if( !pCli->isConnected() ) {
+            report( std::string( "loopback, " ) + c.name, 0, 0.0, "could not connect" );
+            server.join();
+            continue;
+        }
+
+        Packet req( DSRV_MSG_CHAT_GETMSG );
+        req.append( "Hi all, anyone up for a 2on2 on the new map?" );
+        Packet half( DSRV_MSG_PLAYER_SET );
+        half.append( (std::uint32_t) 42 );
+
+        // One packet out, one packet back.
+        auto roundTrip = [&pCli, &req] {
+            pCli->send( &req );
+            auto p = pCli->receivePacket();
+            keep( p );
+        };
+        roundTrip();
+        report( std::string( "loopback round trip, " ) + c.name, 2000, measure( 2000, roundTrip ) );
+
+        // A request written in two packets: Nagle holds back the second
+        // until the first is acknowledged.
+        auto splitRoundTrip = [&pCli, &half, &req] {
+            pCli->send( &half );
+            pCli->send( &req );
+            auto p = pCli->receivePacket();
+            keep( p );
+        };
+        splitRoundTrip();
+        report( std::string( "loopback split request, " ) + c.name, 50, measure( 50, splitRoundTrip ) );
+
+        pCli->disconnect();
+        server.join();
+    }
+}
+
+// Fetching three lists: one request after the other, and all at once.
+FTS_BENCH( connection_loopback_pipelined )
+{
+    ConnectionOptions options;
+    options.bNoDelay = true;
+    std::uint16_t usPort = 41750;
+    std::thread server( echoServer, usPort, options, ConnectionWaiter::ConnectionType::SOCKET );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+    std::unique_ptr<Connection> pCli( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 1000, options ) );
+    if( !pCli->isConnected() ) {
+        report( "loopback 3 requests", 0, 0.0, "could not connect" );
+        server.join();
+        return;
+    }
+
+    Packet req( DSRV_MSG_CHAT_GETMSG );
+    req.append( "Give me the list" );
+
+    auto serial = [&pCli] {
+        for( int i = 0; i < 3; ++i ) {
+            PacketPtr p = Packet::create( DSRV_MSG_CHAT_GETMSG, 32 );
+            p->append( "Give me the list" );
+            pCli->mreq( p );
+            keep( p );
+        }
+    };
+    serial();
+    report( "loopback 3 requests, serial mreq", 2000, measure( 2000, serial ) );
+
+    auto pipelined = [&pCli, &req] {
+        pCli->cork();
+        for( int i = 0; i < 3; ++i ) {
+            pCli->mreqAsync( &req, []( FTSC_ERR, PacketPtr in_pResponse ) { keep( in_pResponse ); } );
+        }
+        pCli->flush();
+        pCli->processResponses( 1000 );
+    };
+    pipelined();
+    report( "loopback 3 requests, corked mreqAsync", 2000, measure( 2000, pipelined ) );
+
+    pCli->disconnect();
+    server.join();
+}
+
+// Round trips with poll and with io_uring on both ends, and the system
+// calls each one takes on the client.
+FTS_BENCH( connection_loopback_uring )
+{
+    struct Case {
+        const char* name;
+        Connection::eConnectionType conType;
+        ConnectionWaiter::ConnectionType waiterType;
+    };
+    const Case cases[] = {
+        { "poll", Connection::eConnectionType::D_CONNECTION_TRADITIONAL, ConnectionWaiter::ConnectionType::SOCKET },
+        { "io_uring", Connection::eConnectionType::D_CONNECTION_URING, ConnectionWaiter::ConnectionType::URING },
+    };
+
+    ConnectionOptions options;
+    options.bNoDelay = true;
+    std::uint16_t usPort = 41740;
+    for( auto& c : cases ) {
+        std::thread server( echoServer, usPort, options, c.waiterType );
+        std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+        std::unique_ptr<Connection> pCli( Connection::create( c.conType, "127.0.0.1", usPort++, 1000, options ) );
+        if( !pCli->isConnected() ) {
+            report( std::string( "loopback round trip, " ) + c.name, 0, 0.0, "could not connect" );
+            server.join();
+            continue;
+        }
+
+        Packet req( DSRV_MSG_CHAT_GETMSG );
+        req.append( "Hi all, anyone up for a 2on2 on the new map?" );
+        auto roundTrip = [&pCli, &req] {
+            pCli->send( &req );
+            auto p = pCli->receivePacket();
+            keep( p );
+        };
+        roundTrip();
+        auto before = pCli->getIoStats();
+        double ns = measure( 2000, roundTrip );
+        auto after = pCli->getIoStats();
+        auto nCalls = ( after.sendCalls - before.sendCalls ) + ( after.recvCalls - before.recvCalls ) + ( after.waitCalls - before.waitCalls );
+        report( std::string( "loopback round trip, " ) + c.name, 2000, ns,
+                std::to_string( (double) nCalls / ( after.packetsReceived - before.packetsReceived ) ) + " syscalls/round trip" );
+
+        pCli->disconnect();
+        server.join();
+    }
+}
+
+// Round trips through one reactor thread, next to many idle connections.
+FTS_BENCH( reactor_loopback_idle_clients )
+{
+    ConnectionOptions options;
+    options.bNoDelay = true;
+    std::uint16_t usPort = 41760;
+    for( int nIdle : { 0, 1000, 5000 } ) {
+        Reactor reactor;
+        if( reactor.listen( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ), usPort, [&reactor]( Connection* in_pCon ) {
+                reactor.add( in_pCon, []( Connection& in_con, PacketPtr in_p ) { in_con.send( in_p.get() ); } );
+            }, options ) != 0 ) {
+            report( "reactor round trip", 0, 0.0, "could not listen" );
+            return;
+        }
+        std::thread server( [&reactor] { reactor.run(); } );
+
+        std::vector<std::unique_ptr<Connection>> idle;
+        for( int i = 0; i < nIdle; ++i ) {
+            idle.emplace_back( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 1000, options ) );
+        }
+        std::unique_ptr<Connection> pCli( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort++, 1000, options ) );
+
+        Packet req( DSRV_MSG_CHAT_GETMSG );
+        req.append( "Hi all, anyone up for a 2on2 on the new map?" );
+        auto roundTrip = [&pCli, &req] {
+            pCli->send( &req );
+            auto p = pCli->receivePacket();
+            keep( p );
+        };
+        roundTrip();
+        double ns = measure( 2000, roundTrip );
+
+        reactor.stop();
+        server.join();
+        report( "reactor round trip, " + std::to_string( nIdle ) + " idle clients", 2000, ns,
+                std::to_string( reactor.getConnectionCount() ) + " served" );
+    }
+}
+
+// Round trips of many client threads at once, through one reactor thread
+// and through one per core.
+FTS_BENCH( multi_reactor_loopback )
+{
+    ConnectionOptions options;
+    options.bNoDelay = true;
+    const int nClients = 8;
+    const int nTrips = 1000;
+    std::uint16_t usPort = 41780;
+    unsigned nCores = std::max( 2u, std::thread::hardware_concurrency() );
+    for( unsigned nThreads : { 1u, nCores } ) {
+        MultiReactor reactors( nThreads );
+        if( reactors.listen( usPort, []( Reactor& io_reactor, Connection* in_pCon ) {
+                io_reactor.add( in_pCon, []( Connection& in_con, PacketPtr in_p ) { in_con.send( in_p.get() ); } );
+            }, options ) != 0 ) {
+            report( "multi-reactor round trip", 0, 0.0, "could not listen" );
+            return;
+        }
+        reactors.start();
+
+        std::vector<std::unique_ptr<Connection>> cons;
+        for( int i = 0; i < nClients; ++i ) {
+            cons.emplace_back( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 1000, options ) );
+        }
+        usPort++;
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> clients;
+        for( auto& pCon : cons ) {
+            clients.emplace_back( [&pCon, nTrips] {
+                Packet req( DSRV_MSG_CHAT_GETMSG );
+                req.append( "Hi all, anyone up for a 2on2 on the new map?" );
+                for( int i = 0; i < nTrips; ++i ) {
+                    pCon->send( &req );
+                    auto p = pCon->receivePacket();
+                    keep( p );
+                }
+            } );
+        }
+        for( auto& t : clients ) {
+            t.join();
+        }
+        double ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / (double) (nClients * nTrips);
+
+        reactors.stop();
+        report( "multi-reactor round trip, " + std::to_string( nThreads ) + " reactor threads", nClients * nTrips, ns,
+                std::to_string( nClients ) + " clients, " + (reactors.isSharingPort() ? "SO_REUSEPORT" : "dealt out") );
+    }
+}
+
+// From the client's connect until the waiter hands the connection out, with
+// the waiter already sleeping when the client comes.
+FTS_BENCH( accept_latency )
+{
+    std::atomic<std::int64_t> acceptedAt( 0 );
+    std::unique_ptr<ConnectionWaiter> pWaiter( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ) );
+    std::mutex mtx;
+    std::condition_variable accepted;
+    auto onAccept = [&]( Connection* in_pCon ) {
+        auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        delete in_pCon;
+        std::lock_guard<std::mutex> lock( mtx );
+        acceptedAt = now;
+        accepted.notify_one();
+    };
+    // The ports of earlier runs are in TIME_WAIT, the server closes first.
+    std::uint16_t usPort = 41800;
+    while( pWaiter->init( usPort, onAccept ) != 0 ) {
+        if( ++usPort == 41820 ) {
+            report( "accept latency", 0, 0.0, "could not listen" );
+            return;
+        }
+    }
+
+    const int nConnects = 200;
+    std::atomic<bool> bStop( false );
+    std::thread server( [&] {
+        while( !bStop ) {
+            pWaiter->waitForThenDoConnection( 100 );
+        }
+    } );
+
+    double ns = 0.0;
+    for( int i = 0; i < nConnects; ++i ) {
+        // Let the waiter fall asleep, coming at a different moment each time.
+        std::this_thread::sleep_for( std::chrono::microseconds( 2000 + (i * 379) % 1000 ) );
+        acceptedAt = 0;
+        auto start = std::chrono::steady_clock::now().time_since_epoch().count();
+        std::unique_ptr<Connection> pCli( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 1000 ) );
+        // Block instead of spinning, the waiter may need this core.
+        std::unique_lock<std::mutex> lock( mtx );
+        accepted.wait( lock, [&acceptedAt] { return acceptedAt != 0; } );
+        ns += (double) (acceptedAt - start);
+    }
+    bStop = true;
+    server.join();
+    report( "accept latency", nConnects, ns / nConnects,
+            "accepted/wakeup: " + std::to_string( pWaiter->getAcceptStats().acceptedPerWakeup() ) );
+}
+
+// A burst of logins whose handling takes 1 ms each: how long until a login
+// is handled, with the handler on the accepting thread and on a worker pool.
+FTS_BENCH( login_storm )
+{
+    using Clock = std::chrono::steady_clock;
+    const int nLogins = 64;
+    std::uint16_t usPort = 41820;
+    for( unsigned nWorkers : { 0u, 4u } ) {
+        std::mutex mtx;
+        std::vector<Clock::time_point> handled;
+        auto login = [&]( Connection* in_pCon ) {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            delete in_pCon;
+            std::lock_guard<std::mutex> lock( mtx );
+            handled.push_back( Clock::now() );
+        };
+
+        // The ports of earlier runs are in TIME_WAIT, the server closes first.
+        std::unique_ptr<ConnectionWaiter> pWaiter;
+        std::unique_ptr<WorkerPool> pPool;
+        int iRet = -1;
+        for( ; iRet != 0 && usPort < 41840; ++usPort ) {
+            if( nWorkers == 0 ) {
+                pWaiter.reset( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ) );
+                iRet = pWaiter->init( usPort, login );
+            } else {
+                pPool.reset( new WorkerPool( nWorkers ) );
+                iRet = pPool->listen( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ), usPort,
+                                      [&login]( Reactor&, Connection* in_pCon ) { login( in_pCon ); } );
+            }
+        }
+        if( iRet != 0 ) {
+            report( "login storm", 0, 0.0, "could not listen" );
+            return;
+        }
+        std::uint16_t usListenPort = usPort - 1;
+
+        std::atomic<bool> bStop( false );
+        std::thread server;
+        if( pPool ) {
+            pPool->start();
+        } else {
+            server = std::thread( [&] {
+                while( !bStop ) {
+                    pWaiter->waitForThenDoConnection( 50 );
+                }
+            } );
+        }
+
+        auto start = Clock::now();
+        std::vector<std::unique_ptr<Connection>> cons;
+        for( int i = 0; i < nLogins; ++i ) {
+            cons.emplace_back( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usListenPort, 1000 ) );
+        }
+        while( Clock::now() - start < std::chrono::seconds( 5 ) ) {
+            {
+                std::lock_guard<std::mutex> lock( mtx );
+                if( handled.size() >= (std::size_t) nLogins ) {
+                    break;
+                }
+            }
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+        }
+
+        bStop = true;
+        if( pPool ) {
+            pPool->stop();
+        } else {
+            server.join();
+        }
+        double ns = 0.0;
+        for( auto& t : handled ) {
+            ns += std::chrono::duration<double, std::nano>( t - start ).count();
+        }
+        report( nWorkers == 0 ? std::string( "login storm, handled on the accepting thread" ) : "login storm, " + std::to_string( nWorkers ) + " workers",
+                handled.size(), handled.empty() ? 0.0 : ns / (double) handled.size(), "until handled, on average" );
+    }
+}
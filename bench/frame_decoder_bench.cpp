@@ -0,0 +1,79 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "frame_decoder.h"
+#include "dsrv_constants.h"
+
+using namespace FTS;
+using namespace FTSBench;
+
+/// Feeds \a in_stream to a decoder in chunks of 16 KB, like the receive buffer.
+static std::size_t decodeStream( const std::vector<std::int8_t>& in_stream )
+{
+    FrameDecoder decoder( UINT32_MAX, SIZE_MAX );
+    std::size_t frames = 0;
+    for( std::size_t off = 0; off < in_stream.size(); off += 16384 ) {
+        auto p = in_stream.data() + off;
+        auto len = std::min<std::size_t>( 16384, in_stream.size() - off );
+        while( len > 0 ) {
+            PacketView frame;
+            auto used = decoder.decode( p, len, frame );
+            p += used;
+            len -= used;
+            frames += frame.isValid() ? 1 : 0;
+        }
+    }
+    return frames;
+}
+
+static void reportThroughput( const std::string& in_name, const std::vector<std::int8_t>& in_stream, std::uint64_t in_iterations )
+{
+    decodeStream( in_stream );
+    auto ns = measure( in_iterations, [&in_stream] {
+        auto frames = decodeStream( in_stream );
+        keep( frames );
+    } );
+    auto mbPerSec = (double) in_stream.size() / ns * 1e9 / (1024.0 * 1024.0);
+    report( in_name, in_iterations, ns, std::to_string( (int) mbPerSec ) + " MB/s" );
+}
+
+// Resynchronizing on 4 MB of random garbage.
+FTS_BENCH( frame_decoder_random_noise )
+{
+    std::vector<std::int8_t> stream( 4 * 1024 * 1024 );
+    std::uint32_t x = 2463534242u;
+    for( auto& b : stream ) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        b = (std::int8_t) x;
+    }
+    reportThroughput( "skip 4 MB of random noise", stream, 50 );
+}
+
+// Resynchronizing on 4 MB of garbage that nearly looks like identifiers.
+FTS_BENCH( frame_decoder_lookalike_noise )
+{
+    std::vector<std::int8_t> stream( 4 * 1024 * 1024 );
+    for( std::size_t i = 0; i < stream.size(); ++i ) {
+        stream[i] = "FTSxFTFS"[i % 8];
+    }
+    reportThroughput( "skip 4 MB of FTS look-alikes", stream, 50 );
+}
+
+// Cutting a stream of small chat packets, for comparison.
+FTS_BENCH( frame_decoder_small_frames )
+{
+    std::vector<std::int8_t> stream;
+    Packet p( DSRV_MSG_CHAT_GETMSG );
+    p.append( DSRV_CHAT_TYPE::NORMAL );
+    p.append( "Pompei2" );
+    p.append( "Hi all, anyone up for a 2on2 on the new map?" );
+    auto pFrame = p.getPayloadPtr() - D_PACKET_HDR_LEN;
+    while( stream.size() < 4 * 1024 * 1024 ) {
+        stream.insert( stream.end(), pFrame, pFrame + p.getTotalLen() );
+    }
+    reportThroughput( "decode 4 MB of chat packets", stream, 50 );
+}
@@ -0,0 +1,224 @@
+#include <cstring>
+#include <string>
+
+#include "bench.h"
+#include "packet.h"
+#include "packet_view.h"
+#include "packet_schema.h"
+#include "packet_queue.h"
+#include "dsrv_constants.h"
+
+using namespace FTS;
+using namespace FTSBench;
+
+// A chat message as the client sends it: flags, receiver and a short text.
+FTS_BENCH( packet_build_small_chat )
+{
+    const std::string sMsg = "Hi all, anyone up for a 2on2 on the new map?";
+    measureAndReport( "build CHAT_SENDMSG (~60 bytes)", 2000000, [&sMsg] {
+        Packet p( DSRV_MSG_CHAT_SENDMSG );
+        p.append( DSRV_CHAT_TYPE::NORMAL );
+        p.append( "" );
+        p.append( sMsg );
+        keep( p );
+    } );
+}
+
+// A login: nickname and password hash.
+FTS_BENCH( packet_build_login )
+{
+    measureAndReport( "build LOGIN (~50 bytes)", 2000000, [] {
+        Packet p( DSRV_MSG_LOGIN );
+        p.append( "Pompei2" );
+        p.append( "0123456789abcdef0123456789abcdef" );
+        keep( p );
+    } );
+}
+
+// A PLAYER_SET with twenty integer fields.
+FTS_BENCH( packet_build_player_set )
+{
+    measureAndReport( "build PLAYER_SET (20 fields)", 2000000, [] {
+        Packet p( DSRV_MSG_PLAYER_SET );
+        for( std::uint32_t i = 0; i < 20; ++i ) {
+            p.append( i );
+        }
+        keep( p );
+    } );
+}
+
+// A game list, which spills out of the inline buffer.
+FTS_BENCH( packet_build_game_list )
+{
+    measureAndReport( "build GAME_LST (64 games)", 200000, [] {
+        Packet p( DSRV_MSG_GAME_LST );
+        p.append( (std::uint32_t) 64 );
+        for( int i = 0; i < 64; ++i ) {
+            p.append( "Some game name" );
+            p.append( (std::uint8_t) i );
+        }
+        keep( p );
+    } );
+}
+
+// Parsing a received small packet.
+FTS_BENCH( packet_parse_small_chat )
+{
+    Packet src( DSRV_MSG_CHAT_GETMSG );
+    src.append( DSRV_CHAT_TYPE::NORMAL );
+    src.append( "Pompei2" );
+    src.append( "Hi all, anyone up for a 2on2 on the new map?" );
+    measureAndReport( "parse CHAT_GETMSG (~60 bytes)", 2000000, [&src] {
+        src.rewind();
+        DSRV_CHAT_TYPE type = DSRV_CHAT_TYPE::NONE;
+        src.get( type );
+        auto sFrom = src.get_string();
+        auto sMsg = src.get_string();
+        keep( sFrom );
+        keep( sMsg );
+    } );
+}
+
+// Parsing the same packet through a view, without copying the strings.
+FTS_BENCH( packet_view_parse_small_chat )
+{
+    Packet src( DSRV_MSG_CHAT_GETMSG );
+    src.append( DSRV_CHAT_TYPE::NORMAL );
+    src.append( "Pompei2" );
+    src.append( "Hi all, anyone up for a 2on2 on the new map?" );
+    measureAndReport( "view parse CHAT_GETMSG (~60 bytes)", 2000000, [&src] {
+        PacketView v( src );
+        DSRV_CHAT_TYPE type = DSRV_CHAT_TYPE::NONE;
+        v.get( type );
+        auto sFrom = v.get_string_view();
+        auto sMsg = v.get_string_view();
+        keep( sFrom );
+        keep( sMsg );
+    } );
+}
+
+using ChatGetMsg = MessageDef<DSRV_MSG_CHAT_GETMSG, DSRV_CHAT_TYPE, CString, CString>;
+
+// Building the chat message from its compile-time definition.
+FTS_BENCH( schema_build_small_chat )
+{
+    measureAndReport( "schema build CHAT_GETMSG (~60 bytes)", 2000000, [] {
+        auto p = ChatGetMsg::create( DSRV_CHAT_TYPE::NORMAL, "Pompei2", "Hi all, anyone up for a 2on2 on the new map?" );
+        keep( p );
+    } );
+}
+
+// Parsing the chat message from its compile-time definition.
+FTS_BENCH( schema_parse_small_chat )
+{
+    auto src = ChatGetMsg::create( DSRV_CHAT_TYPE::NORMAL, "Pompei2", "Hi all, anyone up for a 2on2 on the new map?" );
+    measureAndReport( "schema parse CHAT_GETMSG (~60 bytes)", 2000000, [&src] {
+        DSRV_CHAT_TYPE type = DSRV_CHAT_TYPE::NONE;
+        std::string_view sFrom, sMsg;
+        ChatGetMsg::decode( *src, type, sFrom, sMsg );
+        keep( sFrom );
+        keep( sMsg );
+    } );
+}
+
+// A list of 256 player ids, one append per id.
+FTS_BENCH( packet_build_id_list_loop )
+{
+    std::uint32_t ids[256];
+    for( std::uint32_t i = 0; i < 256; ++i ) ids[i] = i * 7919;
+    measureAndReport( "build 256 ids, append loop", 200000, [&ids] {
+        Packet p( DSRV_MSG_PLAYER_SET );
+        for( auto id : ids ) {
+            p.append( id );
+        }
+        keep( p );
+    } );
+}
+
+// The same list in one bulk append, in host and in network byte order.
+FTS_BENCH( packet_build_id_list_array )
+{
+    std::uint32_t ids[256];
+    for( std::uint32_t i = 0; i < 256; ++i ) ids[i] = i * 7919;
+    measureAndReport( "build 256 ids, appendArray", 200000, [&ids] {
+        Packet p( DSRV_MSG_PLAYER_SET );
+        p.appendArray( ids, 256 );
+        keep( p );
+    } );
+    measureAndReport( "build 256 ids, appendArray big endian", 200000, [&ids] {
+        Packet p( DSRV_MSG_PLAYER_SET );
+        p.appendArray( ids, 256, ByteOrder::Big );
+        keep( p );
+    } );
+}
+
+// Reading the list back in network byte order.
+FTS_BENCH( packet_parse_id_list_array )
+{
+    std::uint32_t ids[256];
+    for( std::uint32_t i = 0; i < 256; ++i ) ids[i] = i * 7919;
+    Packet src( DSRV_MSG_PLAYER_SET );
+    src.appendArray( ids, 256, ByteOrder::Big );
+    measureAndReport( "parse 256 ids, getArray big endian", 200000, [&src, &ids] {
+        src.rewind();
+        src.getArray( ids, 256, ByteOrder::Big );
+        keep( ids );
+    } );
+}
+
+// Reading chat texts of typical lengths, as copy and as view.
+FTS_BENCH( packet_get_string )
+{
+    for( std::size_t len : { 8, 32, 64, 140, 512 } ) {
+        Packet src( DSRV_MSG_CHAT_GETMSG );
+        src.append( std::string( len, 'a' ) );
+        std::string sName = "get_string, " + std::to_string( len ) + " chars";
+        measureAndReport( sName, 2000000, [&src] {
+            src.rewind();
+            auto s = src.get_string();
+            keep( s );
+        } );
+        sName = "get_string_view, " + std::to_string( len ) + " chars";
+        measureAndReport( sName, 2000000, [&src] {
+            src.rewind();
+            auto s = src.get_string_view();
+            keep( s );
+        } );
+    }
+}
+
+// Removing all 500 names from a big game list.
+FTS_BENCH( packet_extract_strings )
+{
+    Packet src( DSRV_MSG_GAME_LST );
+    for( int i = 0; i < 500; ++i ) {
+        src.append( "Some game name" );
+        src.append( (std::uint32_t) i );
+    }
+    measureAndReport( "extractString x500 from a 10 KB packet", 2000, [&src] {
+        Packet p( DSRV_MSG_GAME_LST );
+        p.append( src.getPayloadPtr(), src.getPayloadLen() );
+        p.rewind();
+        std::uint32_t n = 0;
+        for( int i = 0; i < 500; ++i ) {
+            auto s = p.extractString();
+            p.get( n );
+            keep( s );
+        }
+        keep( p );
+    } );
+}
+
+// A full connection queue of 32 packets, taking out the newest type each time.
+FTS_BENCH( packet_queue_pop_by_type )
+{
+    PacketQueue q;
+    for( int i = 0; i < 32; ++i ) {
+        q.push( new Packet( (master_request_t) (i % 16 + 1) ) );
+    }
+    measureAndReport( "queue of 32, pop by type and push back", 2000000, [&q] {
+        auto p = q.pop( (master_request_t) 16 );
+        q.push( p );
+        keep( p );
+    } );
+}
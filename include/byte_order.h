@@ -0,0 +1,51 @@
+/**
+ * \file byte_order.h
+ * \brief This file describes the conversion of integer arrays between
+ *        the host and a wire byte order.
+ **/
+
+#ifndef FTS_BYTEORDER_H
+#define FTS_BYTEORDER_H
+
+#include <cstddef>
+#include <cstring>
+
+namespace FTS {
+
+/// The byte order integers are stored in a packet.
+enum class ByteOrder {
+    Host,   ///< As they are in memory, this is what append and get do.
+    Little, ///< Little endian (x86, ARM).
+    Big,    ///< Big endian, the network byte order.
+};
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr ByteOrder D_HOST_BYTE_ORDER = ByteOrder::Big;
+#else
+constexpr ByteOrder D_HOST_BYTE_ORDER = ByteOrder::Little;
+#endif
+
+/// Whether integers have to be byte-swapped to get them into \a in_order.
+constexpr bool needsByteSwap( ByteOrder in_order )
+{
+    return in_order != ByteOrder::Host && in_order != D_HOST_BYTE_ORDER;
+}
+
+void copySwapped( void* out_pData, const void* in_pData, std::size_t in_count, std::size_t in_elemSize );
+
+/// Copies \a in_count integers of \a in_elemSize bytes, converting them to or
+/// from \a in_order. The buffers must not overlap.
+inline void copyByteOrder( void* out_pData, const void* in_pData, std::size_t in_count, std::size_t in_elemSize, ByteOrder in_order )
+{
+    if( in_elemSize == 1 || !needsByteSwap( in_order ) ) {
+        memcpy( out_pData, in_pData, in_count * in_elemSize );
+    } else {
+        copySwapped( out_pData, in_pData, in_count, in_elemSize );
+    }
+}
+
+}
+
+#endif /* FTS_BYTEORDER_H */
+
+ /* EOF */
@@ -10,14 +10,20 @@
 #define FTS_CONNECTION_H
 
 #include <vector>
-#include <list>
+#include <deque>
+#include <functional>
+#include <future>
 #include <unordered_map>
 #include <cstdint>
+#include <initializer_list>
+#include <utility>
 
 #include "packet.h"
+#include "packet_queue.h"
 
 #define FTSC_TIME_OUT      1000    ///< time out value in milliseconds
-#define FTSC_MAX_QUEUE_LEN 32      ///< The longest queue we shall have. If queue gets longer, drop it.
+#define FTSC_MAX_QUEUE_LEN 32      ///< The default queue capacity, see Connection::setQueueCapacity.
+#define FTSC_FLUSH_THRESHOLD 16384 ///< A corked connection sends as soon as it has this many bytes.
 
 enum class FTSC_ERR {
     OK            =  0, ///< No error.
@@ -33,14 +39,70 @@ enum class FTSC_ERR {
     INVALID_INPUT = -10, ///< Invalid method parameter. Usually a nullptr.
 };
 
-// Holds for each request the recv and send counts.
-using PacketStats = std::unordered_map<master_request_t, std::pair<std::uint64_t, std::uint64_t>>;
+/// The packet counts of one request id.
+struct PacketCounts {
+    std::uint64_t received = 0; ///< Received.
+    std::uint64_t sent = 0;     ///< Sent.
+    std::uint64_t dropped = 0;  ///< Received but dropped because the queue was full.
+};
+
+// Holds for each request the recv, send and drop counts.
+using PacketStats = std::unordered_map<master_request_t, PacketCounts>;
+
+/// Counts the system calls of a connection, to see how well its I/O is batched.
+struct IoStats {
+    std::uint64_t packetsSent = 0;     ///< Packets handed to send, sendv or mreq.
+    std::uint64_t packetsReceived = 0; ///< Packets received.
+    std::uint64_t sendCalls = 0;       ///< Calls of send, sendmsg or WSASend.
+    std::uint64_t recvCalls = 0;       ///< Calls of recv.
+    std::uint64_t waitCalls = 0;       ///< Calls of poll or select.
+    std::uint64_t bytesSent = 0;       ///< Bytes taken by the kernel.
+    std::uint64_t bytesReceived = 0;   ///< Bytes got from the kernel.
+
+    double sendCallsPerPacket() const { return packetsSent ? (double) sendCalls / (double) packetsSent : 0.0; }
+    double recvCallsPerPacket() const { return packetsReceived ? (double) recvCalls / (double) packetsReceived : 0.0; }
+};
 
 namespace FTS {
 
 FTSC_ERR getHTTPFile(std::vector<std::uint8_t>& out_data, const std::string &in_sServer, const std::string &in_sPath, std::uint64_t in_ulMaxWaitMillisec );
 int downloadHTTPFile( const std::string &in_sServer, const std::string &in_sPath, const std::string &in_sLocal, std::uint64_t in_ulMaxWaitMillisec );
 
+/// A piece of payload for the scatter/gather send, see Connection::sendv.
+struct PacketFragment {
+    const void *pData;   ///< The bytes to send.
+    std::size_t uiLen;   ///< The number of bytes to send.
+};
+
+/// What a connection does with a received packet that doesn't fit into its queue.
+/** See Connection::setQueueCapacity and Connection::setQueueLimit. */
+enum class QueueOverflow {
+    DropOldest,  ///< Drop the oldest queued packet, of the same type if the type limit is hit.
+    DropNewest,  ///< Drop the packet that just came in.
+    BlockSender, ///< Stop receiving while the queue is at its capacity, so TCP blocks the counterpart. A type limit drops the oldest of the type.
+};
+
+/// Tuning of the sockets of a connection, see Connection::create and ConnectionWaiter::init.
+/** Every option left at its default keeps what the system does. Options the
+ *  system doesn't know (TCP_QUICKACK and SO_BUSY_POLL are Linux only) are
+ *  ignored. Failing to set an option is logged as warning, the connection
+ *  works nonetheless. The listener options have to be set before binding,
+ *  ConnectionWaiter::init does so.
+ **/
+struct ConnectionOptions {
+    bool bNoDelay = false;          ///< Send small packets right away instead of waiting for an ACK (TCP_NODELAY).
+    int iSendBufSize = 0;           ///< The kernel send buffer in bytes (SO_SNDBUF), 0 for the default.
+    int iRecvBufSize = 0;           ///< The kernel receive buffer in bytes (SO_RCVBUF), 0 for the default.
+    bool bKeepAlive = false;        ///< Probe idle connections to detect dead counterparts (SO_KEEPALIVE).
+    int iKeepAliveIdleSec = 0;      ///< Idle time before the first probe (TCP_KEEPIDLE), 0 for the default.
+    int iKeepAliveIntervalSec = 0;  ///< Time between two probes (TCP_KEEPINTVL), 0 for the default.
+    int iKeepAliveProbes = 0;       ///< Unanswered probes that drop the connection (TCP_KEEPCNT), 0 for the default.
+    bool bQuickAck = false;         ///< Acknowledge received data right away instead of delaying it (TCP_QUICKACK).
+    int iBusyPollMicrosec = 0;      ///< Busy poll the device this long before sleeping in a receive (SO_BUSY_POLL), 0 for none.
+    bool bReusePort = false;        ///< Let several listeners share the port, the kernel spreads the connections among them (SO_REUSEPORT, listeners only).
+    int iIncomingCpu = -1;          ///< Prefer this listener for connections arriving on this CPU (SO_INCOMING_CPU, listeners only), -1 for any.
+};
+
 /// The FTS connection class
 /** This class represents an abstract connection.
  *  It may be implemented as a connection over tcp/ip, over serial,
@@ -55,10 +117,11 @@ public:
     {
         D_CONNECTION_TRADITIONAL  = 0x0,
         D_CONNECTION_ONDEMAND_CLI = 0x1,
-        D_CONNECTION_ONDEMAND_SRV = 0x2
+        D_CONNECTION_ONDEMAND_SRV = 0x2,
+        D_CONNECTION_URING        = 0x3  ///< Like traditional, but the I/O goes through io_uring (Linux only, traditional elsewhere).
     } ;
 
-    static Connection* create( eConnectionType type, const std::string &in_sName, std::uint16_t in_usPort, std::uint64_t in_ulTimeoutInMillisec );
+    static Connection* create( eConnectionType type, const std::string &in_sName, std::uint16_t in_usPort, std::uint64_t in_ulTimeoutInMillisec, const ConnectionOptions &in_options = ConnectionOptions() );
     virtual eConnectionType getType() const = 0;
     virtual bool isConnected() = 0;
     virtual void disconnect() = 0;
@@ -69,19 +132,86 @@ public:
     virtual Packet *getReceivedPacketIfAny() = 0 ;
     virtual FTSC_ERR send(Packet *in_pPacket) = 0;
     virtual FTSC_ERR mreq(Packet *in_pPacket) = 0;
+    virtual FTSC_ERR sendv(master_request_t in_req, const PacketFragment *in_pFragments, std::size_t in_nFragments) = 0;
+    /// Sends a packet whose payload is made of the given fragments, see sendv.
+    FTSC_ERR sendv(master_request_t in_req, std::initializer_list<PacketFragment> in_fragments) { return sendv( in_req, in_fragments.begin(), in_fragments.size() ); }
+
+    /// Waits for and then receives any packet, see waitForThenGetPacket.
+    /** \return The packet or an empty handle if nothing came in time. */
+    PacketPtr receivePacket(bool in_bUseQueue = true) { return PacketPtr( waitForThenGetPacket( in_bUseQueue ) ); }
+    /// Returns an already received packet, see getReceivedPacketIfAny.
+    PacketPtr receivePacketIfAny() { return PacketPtr( getReceivedPacketIfAny() ); }
+    virtual FTSC_ERR mreq(PacketPtr& io_pPacket);
+
+    /// Gets the result of an asynchronous request, see mreqAsync.
+    /** The error is OK and the packet is the response, or the error tells
+     *  why the request failed and the packet handle is empty.
+     */
+    using ResponseCallback = std::function<void( FTSC_ERR, PacketPtr )>;
+    FTSC_ERR mreqAsync( Packet *in_pPacket, ResponseCallback in_cb );
+    std::future<std::pair<FTSC_ERR, PacketPtr>> mreqAsync( Packet *in_pPacket );
+    /// Receives until all asynchronous requests got their response or the time is over.
+    /** Packets that are no response are queued. The requests still collected
+     *  by cork are sent first.
+     *
+     * \return The number of requests still waiting for their response.
+     */
+    virtual std::size_t processResponses( std::uint64_t in_ulMaxWaitMillisec ) = 0;
+    /// The number of asynchronous requests waiting for their response.
+    std::size_t getPendingRequestCount() const { return m_nPendingRequests; }
+
+    /// Starts collecting the packets sent instead of sending each one on its own.
+    /** The packets are sent together by flush(), or as soon as they make up
+     *  the flush threshold, see setFlushThreshold. mreq sends what has been
+     *  collected before it waits for the response.
+     */
+    virtual void cork() = 0;
+    /// Sends the collected packets in one go and stops collecting, see cork.
+    virtual FTSC_ERR flush() = 0;
+    /// Sets how many collected bytes make a corked connection send them.
+    void setFlushThreshold( std::size_t in_uiBytes ) { m_uiFlushThreshold = in_uiBytes; }
+
+    /// Sets how many packets nobody waited for may be queued, and what happens beyond.
+    /** With QueueOverflow::BlockSender the queue never grows beyond the
+     *  capacity: while it is at its capacity, nothing is received. The
+     *  type limits don't block, see setQueueLimit. So mreq and
+     *  waitForThenGetPacketWithReq fail with FTSC_ERR::RECEIVE (NULL) even
+     *  if the response has been sent, until the queued packets are taken,
+     *  e.g. by waitForThenGetPacket.
+     */
+    void setQueueCapacity( std::size_t in_uiCapacity, QueueOverflow in_policy = QueueOverflow::DropOldest ) { m_uiQueueCapacity = in_uiCapacity; m_queueOverflow = in_policy; }
+    /// Limits the queued packets of one type, 0 for no limit but the capacity.
+    void setQueueLimit( master_request_t in_req, std::size_t in_uiLimit );
+    bool isQueueFull() const;
 
     virtual void setMaxWaitMillisec( std::uint64_t in_ulMaxWaitMillisec ) { m_maxWaitMillisec = in_ulMaxWaitMillisec; }
     PacketStats getPacketStats() { return m_statPackets; }
+    IoStats getIoStats() const { return m_ioStats; }
 protected:
-    std::list<Packet *>m_lpPacketQueue; ///< A queue of packets that have been received but not consumed. Most recent are at the back.
+    PacketQueue m_packetQueue;          ///< A queue of packets that have been received but not consumed. Most recent are at the back.
+    std::size_t m_uiQueueCapacity = FTSC_MAX_QUEUE_LEN;  ///< See setQueueCapacity.
+    QueueOverflow m_queueOverflow = QueueOverflow::DropOldest; ///< See setQueueCapacity.
+    std::unordered_map<master_request_t, std::size_t> m_queueLimits; ///< See setQueueLimit.
+    std::unordered_map<master_request_t, std::deque<ResponseCallback>> m_pendingRequests; ///< The callbacks of the asynchronous requests, oldest first.
+    std::size_t m_nPendingRequests = 0; ///< The number of callbacks in m_pendingRequests.
     std::uint64_t m_maxWaitMillisec;         ///< Time out in millisec for all socket calls.
+    std::size_t m_uiFlushThreshold = FTSC_FLUSH_THRESHOLD; ///< See setFlushThreshold.
+    IoStats m_ioStats;                       ///< The system calls made so far.
 
     Connection() : m_maxWaitMillisec( FTSC_TIME_OUT ) {};
     virtual Packet *getFirstPacketFromQueue(master_request_t in_req = DSRV_MSG_NONE);
+    /// Whether receiving has to wait, as a QueueOverflow::BlockSender queue is at its capacity.
+    bool isReceiveBlocked() const { return m_queueOverflow == QueueOverflow::BlockSender && m_packetQueue.size() >= m_uiQueueCapacity; }
     virtual void queuePacket(Packet *in_pPacket);
+    std::string describeQueue() const;
+    void dropPacket( Packet *in_pPacket );
+    bool dispatchResponse( Packet *in_pPacket );
+    void failPendingRequests( FTSC_ERR in_err );
     // Statistical information
     void addSendPacketStat( Packet* p );
+    void addSendPacketStat( master_request_t in_req );
     void addRecvPacketStat( Packet* p );
+    void addDropPacketStat( Packet* p );
 private:
     PacketStats m_statPackets;
 };
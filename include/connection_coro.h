@@ -0,0 +1,299 @@
+/**
+ * \file connection_coro.h
+ * \brief This file describes the C++20 coroutine interface of the
+ *        connections, driven by an EventLoop.
+ **/
+
+#ifndef FTS_CONNECTIONCORO_H
+#define FTS_CONNECTIONCORO_H
+
+#if !defined(__cpp_impl_coroutine)
+#  error "connection_coro.h needs C++20 coroutines, build with FTS_NET_COROUTINES."
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "connection.h"
+#include "connection_waiter.h"
+#include "event_loop.h"
+
+namespace FTS {
+
+template<class T> class Task;
+class TraditionalConnection;
+class SocketConnectionWaiter;
+
+namespace detail {
+
+/// What the promises of all tasks have in common.
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation;   ///< The coroutine awaiting the task.
+    std::exception_ptr error;               ///< The exception the task ended with.
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    /// Goes on with the awaiting coroutine, without growing the stack.
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template<class P>
+        std::coroutine_handle<> await_suspend( std::coroutine_handle<P> in_h ) noexcept
+        {
+            auto cont = in_h.promise().continuation;
+            return cont ? cont : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template<class T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;   ///< What the task returned.
+
+    Task<T> get_return_object();
+    template<class U>
+    void return_value( U&& in_value ) { value.emplace( std::forward<U>( in_value ) ); }
+    T result()
+    {
+        if( error ) std::rethrow_exception( error );
+        return std::move( *value );
+    }
+};
+
+template<>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    void result() { if( error ) std::rethrow_exception( error ); }
+};
+
+}
+
+/// A coroutine that returns a T to the coroutine awaiting it.
+/** The task starts when it is awaited (or spawned), and the awaiting
+ *  coroutine goes on when the task is finished, e.g.
+ *  \code
+ *  Task<PacketPtr> login( AsyncConnection& conn );
+ *  Task<void> session( AsyncConnection& conn ) { auto p = co_await login( conn ); ... }
+ *  \endcode
+ **/
+template<class T = void>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task( Task&& in_other ) noexcept : m_h( std::exchange( in_other.m_h, {} ) ) {}
+    Task& operator=( Task&& in_other ) noexcept { if( m_h ) m_h.destroy(); m_h = std::exchange( in_other.m_h, {} ); return *this; }
+    Task( const Task& ) = delete;
+    Task& operator=( const Task& ) = delete;
+    ~Task() { if( m_h ) m_h.destroy(); }
+
+    bool await_ready() const noexcept { return !m_h || m_h.done(); }
+    std::coroutine_handle<> await_suspend( std::coroutine_handle<> in_cont ) noexcept
+    {
+        m_h.promise().continuation = in_cont;
+        return m_h;
+    }
+    T await_resume() { return m_h.promise().result(); }
+
+private:
+    friend promise_type;
+    explicit Task( std::coroutine_handle<promise_type> in_h ) : m_h( in_h ) {}
+
+    std::coroutine_handle<promise_type> m_h;   ///< The coroutine of the task.
+};
+
+template<class T>
+Task<T> detail::TaskPromise<T>::get_return_object() { return Task<T>( std::coroutine_handle<TaskPromise<T>>::from_promise( *this ) ); }
+inline Task<void> detail::TaskPromise<void>::get_return_object() { return Task<void>( std::coroutine_handle<TaskPromise<void>>::from_promise( *this ) ); }
+
+namespace detail {
+
+/// A coroutine nobody awaits, it frees itself when done.
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception();
+    };
+};
+
+}
+
+/// Starts a task that nobody awaits, e.g. a session per accepted connection.
+/** The task runs right away until it awaits something, then goes on as the
+ *  event loop resumes it. It frees itself when done. Exceptions leaving it
+ *  are logged and swallowed.
+ */
+inline detail::DetachedTask spawn( Task<void> in_task )
+{
+    co_await in_task;
+}
+
+/// A connection whose packets are awaited by coroutines.
+/** The connection is watched by an event loop, which receives whatever
+ *  comes in and resumes the coroutines waiting for it. So one thread can
+ *  serve thousands of sessions, e.g.
+ *  \code
+ *  Task<void> session( EventLoop& loop, Connection* in_pCon )
+ *  {
+ *      AsyncConnection conn( loop, in_pCon );
+ *      while( PacketPtr p = co_await conn.receive( 60000 ) ) {
+ *          PacketPtr rsp = co_await conn.request( *question );
+ *          ...
+ *      }
+ *  }
+ *  \endcode
+ *  Only connections of type D_CONNECTION_TRADITIONAL can be used. Sending
+ *  stays as it is: use getConnection().send().\n
+ *  One coroutine at a time may await receive(), any number may await
+ *  request(). The object must live until all of them have been resumed.\n
+ *  With QueueOverflow::BlockSender, nothing is received while the queue is
+ *  full and nobody awaits receive(), so the responses to requests wait too.
+ **/
+class AsyncConnection {
+public:
+    AsyncConnection( EventLoop& in_loop, Connection* in_pConnection );
+    AsyncConnection( const AsyncConnection& ) = delete;
+    AsyncConnection& operator=( const AsyncConnection& ) = delete;
+    ~AsyncConnection();
+
+    Connection& getConnection() { return *m_pConnection; }
+    bool isConnected() const { return m_pConnection->isConnected(); }
+    /// Whether it can be awaited, else receive and request fail at once.
+    bool isValid() const { return m_pTC != nullptr; }
+
+    /// Awaits the next packet that is no response to a request.
+    class ReceiveAwaitable {
+    public:
+        bool await_ready();
+        void await_suspend( std::coroutine_handle<> in_h );
+        /// The packet, or an empty handle on time out or when the connection is lost.
+        PacketPtr await_resume() { return std::move( m_pPacket ); }
+
+    private:
+        friend class AsyncConnection;
+        ReceiveAwaitable( AsyncConnection& in_conn, std::uint64_t in_ulMaxWaitMillisec ) : m_conn( in_conn ), m_ulMaxWaitMillisec( in_ulMaxWaitMillisec ) {}
+
+        AsyncConnection& m_conn;              ///< The connection to receive from.
+        std::uint64_t m_ulMaxWaitMillisec;    ///< How long to wait at most.
+        std::coroutine_handle<> m_h;          ///< The awaiting coroutine.
+        EventLoop::TimerId m_timer = 0;       ///< The time out.
+        PacketPtr m_pPacket;                  ///< The packet received.
+    };
+
+    /// Awaits the response to a request, see Connection::mreqAsync.
+    class RequestAwaitable {
+    public:
+        bool await_ready() { return false; }
+        bool await_suspend( std::coroutine_handle<> in_h );
+        /// The response, or an empty handle if the request failed or timed out.
+        PacketPtr await_resume() { return std::move( m_pState->pResponse ); }
+
+    private:
+        friend class AsyncConnection;
+        /// Outlives the awaitable when the request times out.
+        struct State {
+            std::coroutine_handle<> h;         ///< The awaiting coroutine.
+            PacketPtr pResponse;               ///< The response received.
+            bool bDone = false;                ///< Whether the request has been answered, failed or timed out.
+            bool bSuspended = false;           ///< Whether the coroutine waits to be resumed.
+            EventLoop::TimerId timer = 0;      ///< The time out.
+        };
+        RequestAwaitable( AsyncConnection& in_conn, Packet& in_request, std::uint64_t in_ulMaxWaitMillisec )
+            : m_conn( in_conn ), m_request( in_request ), m_ulMaxWaitMillisec( in_ulMaxWaitMillisec ), m_pState( std::make_shared<State>() ) {}
+
+        AsyncConnection& m_conn;              ///< The connection to send on.
+        Packet& m_request;                    ///< The request to send.
+        std::uint64_t m_ulMaxWaitMillisec;    ///< How long to wait at most.
+        std::shared_ptr<State> m_pState;      ///< Shared with the response callback.
+    };
+
+    /** \param in_ulMaxWaitMillisec How long to wait, -1 for ever. */
+    ReceiveAwaitable receive( std::uint64_t in_ulMaxWaitMillisec = (std::uint64_t) -1 ) { return ReceiveAwaitable( *this, in_ulMaxWaitMillisec ); }
+    /** \param in_request The request, it is left untouched and may be freed as soon as this returns.
+     *  \param in_ulMaxWaitMillisec How long to wait for the response, -1 for ever. */
+    RequestAwaitable request( Packet& in_request, std::uint64_t in_ulMaxWaitMillisec = FTSC_TIME_OUT ) { return RequestAwaitable( *this, in_request, in_ulMaxWaitMillisec ); }
+
+private:
+    void watch();
+    void onReadable();
+    void resumeLater( std::coroutine_handle<> in_h );
+    void resumeReady();
+
+    EventLoop& m_loop;                            ///< The loop watching the connection.
+    std::unique_ptr<Connection> m_pConnection;    ///< The connection.
+    TraditionalConnection* m_pTC = nullptr;       ///< m_pConnection, if it can be awaited.
+    NativeSocket m_sock = 0;                      ///< The socket of the connection.
+    ReceiveAwaitable* m_pReceiver = nullptr;      ///< The awaiting receive, if any.
+    std::vector<std::coroutine_handle<>> m_ready; ///< The coroutines to resume once the socket is done with.
+    bool m_bInCallback = false;                   ///< Whether onReadable is running.
+    bool m_bWatching = false;                     ///< Whether the loop watches the socket, not while a BlockSender queue is full.
+};
+
+/// A connection waiter whose connections are awaited by coroutines.
+/** The listening socket is watched by an event loop, e.g.
+ *  \code
+ *  Task<void> acceptor( EventLoop& loop, AsyncConnectionWaiter& waiter )
+ *  {
+ *      while( Connection* pCon = co_await waiter.accept() ) {
+ *          spawn( session( loop, pCon ) );
+ *      }
+ *  }
+ *  \endcode
+ *  Only waiters of type SOCKET can be used, after init has been called.
+ *  With any other, accept returns NULL at once.
+ *  One coroutine at a time may await accept().
+ **/
+class AsyncConnectionWaiter {
+public:
+    AsyncConnectionWaiter( EventLoop& in_loop, ConnectionWaiter* in_pWaiter );
+    AsyncConnectionWaiter( const AsyncConnectionWaiter& ) = delete;
+    AsyncConnectionWaiter& operator=( const AsyncConnectionWaiter& ) = delete;
+    ~AsyncConnectionWaiter();
+
+    /// Awaits the next connection.
+    class AcceptAwaitable {
+    public:
+        bool await_ready();
+        void await_suspend( std::coroutine_handle<> in_h );
+        /// The new connection, the caller owns it. NULL on time out, or if the waiter can't be awaited.
+        Connection* await_resume() { return m_pConnection; }
+
+    private:
+        friend class AsyncConnectionWaiter;
+        AcceptAwaitable( AsyncConnectionWaiter& in_waiter, std::uint64_t in_ulMaxWaitMillisec ) : m_waiter( in_waiter ), m_ulMaxWaitMillisec( in_ulMaxWaitMillisec ) {}
+
+        AsyncConnectionWaiter& m_waiter;      ///< The waiter to accept with.
+        std::uint64_t m_ulMaxWaitMillisec;    ///< How long to wait at most.
+        std::coroutine_handle<> m_h;          ///< The awaiting coroutine.
+        EventLoop::TimerId m_timer = 0;       ///< The time out.
+        Connection* m_pConnection = nullptr;  ///< The connection accepted.
+    };
+
+    /** \param in_ulMaxWaitMillisec How long to wait, -1 for ever. */
+    AcceptAwaitable accept( std::uint64_t in_ulMaxWaitMillisec = (std::uint64_t) -1 ) { return AcceptAwaitable( *this, in_ulMaxWaitMillisec ); }
+
+private:
+    void onReadable();
+
+    EventLoop& m_loop;                                ///< The loop watching the listening socket.
+    std::unique_ptr<ConnectionWaiter> m_pWaiter;      ///< The waiter.
+    SocketConnectionWaiter* m_pSocketWaiter = nullptr; ///< m_pWaiter, if it has a listening socket to watch.
+    NativeSocket m_sock = 0;                          ///< The listening socket.
+    AcceptAwaitable* m_pAccepter = nullptr;           ///< The awaiting accept, if any.
+};
+
+}
+
+#endif /* FTS_CONNECTIONCORO_H */
+
+ /* EOF */
@@ -0,0 +1,59 @@
+/**
+ * \file connection_queue.h
+ * \brief This file describes the lock-free queue new connections are handed
+ *        over from one thread to another in.
+ **/
+
+#ifndef FTS_CONNECTIONQUEUE_H
+#define FTS_CONNECTIONQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "connection.h"
+
+/// The size of a cache line, keeps the ends of the queue apart.
+#define D_CONNECTION_QUEUE_CACHE_LINE 64
+
+namespace FTS {
+
+/// A bounded FIFO of connections that any number of threads push to and pop from.
+/** It never locks and never allocates after construction: each slot has a
+ *  sequence number telling whether it's free for the producer of that turn
+ *  or filled for its consumer, so a push or a pop is one compare-and-swap
+ *  on its end of the queue. A full queue makes push fail instead of
+ *  waiting, the caller decides what to do with the connection.\n
+ *  The queue owns the connections it holds, the destructor deletes them.
+ **/
+class ConnectionQueue {
+public:
+    explicit ConnectionQueue( std::size_t in_uiCapacity );
+    ConnectionQueue( const ConnectionQueue& ) = delete;
+    ConnectionQueue& operator=( const ConnectionQueue& ) = delete;
+    ~ConnectionQueue();
+
+    bool push( Connection *in_pCon );
+    Connection *pop();
+
+    /// The most connections the queue holds, the capacity asked for rounded up to a power of 2.
+    std::size_t capacity() const { return m_uiMask + 1; }
+
+private:
+    /// One place in the ring.
+    struct Slot {
+        std::atomic<std::size_t> seq; ///< The turn the slot is ready for, see push and pop.
+        Connection *pCon;             ///< The connection, if filled.
+    };
+
+    std::unique_ptr<Slot[]> m_pSlots; ///< The ring.
+    std::size_t m_uiMask = 0;         ///< The ring size - 1.
+    alignas( D_CONNECTION_QUEUE_CACHE_LINE ) std::atomic<std::size_t> m_uiTail{ 0 }; ///< The next turn to push.
+    alignas( D_CONNECTION_QUEUE_CACHE_LINE ) std::atomic<std::size_t> m_uiHead{ 0 }; ///< The next turn to pop.
+};
+
+}
+
+#endif /* FTS_CONNECTIONQUEUE_H */
+
+ /* EOF */
@@ -4,21 +4,42 @@
 #include <functional>
 #include "connection.h"
 
+/// Makes waitForThenDoConnection wait until a connection comes, any negative
+/// value does. Before, a negative wait returned false at once.
+#define FTSC_WAIT_FOREVER  -1
+
 namespace FTS {
 
+/// Counts how many connections a waiter accepts each time it wakes up.
+struct AcceptStats {
+    std::uint64_t wakeups = 0;     ///< Times the listening socket was found readable.
+    std::uint64_t acceptCalls = 0; ///< Calls of accept, also the ones finding nobody.
+    std::uint64_t accepted = 0;    ///< Connections accepted.
+
+    double acceptedPerWakeup() const { return wakeups ? (double) accepted / (double) wakeups : 0.0; }
+};
+
 class ConnectionWaiter {
 public:
     enum class ConnectionType
     {
-        SOCKET
+        SOCKET,
+        URING   ///< Accepts through io_uring and hands out D_CONNECTION_URING connections (Linux only, SOCKET elsewhere).
     };
     virtual ~ConnectionWaiter() {};
     static ConnectionWaiter* create(ConnectionType t);
-    virtual int init(std::uint16_t in_usPort, std::function<void(Connection*)> in_cb) = 0;
+    /// Starts listening, \a in_options are applied to every connection accepted.
+    virtual int init(std::uint16_t in_usPort, std::function<void(Connection*)> in_cb, const ConnectionOptions &in_options = ConnectionOptions()) = 0;
+    /// Waits for connections and hands all that are waiting to the callback,
+    /// \a in_ulMaxWaitMillisec FTSC_WAIT_FOREVER (or any negative) waits for ever. Returns false if none came in time.
     virtual bool waitForThenDoConnection(std::int64_t in_ulMaxWaitMillisec = FTSC_TIME_OUT) = 0;
+    /// The accepts done so far.
+    AcceptStats getAcceptStats() const { return m_acceptStats; }
 
 protected:
     ConnectionWaiter() = default;
+
+    AcceptStats m_acceptStats; ///< The accepts done so far.
 };
 
 } // namespace FTSSrv2
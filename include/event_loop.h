@@ -0,0 +1,108 @@
+/**
+ * \file event_loop.h
+ * \brief This file describes the loop that waits for many sockets, timers
+ *        and posted functions at once.
+ **/
+
+#ifndef FTS_EVENTLOOP_H
+#define FTS_EVENTLOOP_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace FTS {
+
+#if defined(_WIN32)
+using NativeSocket = std::uintptr_t; ///< The SOCKET of winsock.
+#else
+using NativeSocket = int;            ///< The file descriptor of the socket.
+#endif
+
+/// Runs callbacks when sockets are ready, timers are due or functions are posted.
+/** One thread runs the loop, all callbacks are called on that thread and all
+ *  methods but post() and stop() have to be called on it too. Many sockets
+ *  can be watched at once without a thread for each of them: the loop sleeps
+ *  in epoll (poll on other systems) until something happens.\n
+ *  The sockets are watched level-triggered: a readable socket is reported
+ *  again and again until all of its data has been received.\n
+ *  Callbacks may add and remove sockets and timers, also their own.
+ **/
+class EventLoop {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void()>;
+    /// Gets the events of a socket, a combination of Readable, Writable and Error.
+    using SocketCallback = std::function<void( std::uint32_t in_events )>;
+    using TimerId = std::uint64_t;
+
+    /// What happened on a socket.
+    enum Events : std::uint32_t {
+        Readable = 0x1,   ///< There is data to receive, or the counterpart closed.
+        Writable = 0x2,   ///< There is room to send.
+        Error    = 0x4,   ///< The socket has an error or has been hung up.
+    };
+
+    EventLoop();
+    EventLoop( const EventLoop& ) = delete;
+    EventLoop& operator=( const EventLoop& ) = delete;
+    ~EventLoop();
+
+    /// False if the system refused to give us an epoll instance.
+    bool isValid() const { return m_bValid; }
+
+    bool add( NativeSocket in_sock, std::uint32_t in_events, SocketCallback in_cb );
+    bool modify( NativeSocket in_sock, std::uint32_t in_events );
+    void remove( NativeSocket in_sock );
+    /// The number of sockets watched.
+    std::size_t getSocketCount() const { return m_sockets.size(); }
+
+    TimerId addTimer( Clock::time_point in_when, Callback in_cb );
+    TimerId addTimer( std::uint64_t in_ulMillisec, Callback in_cb ) { return this->addTimer( Clock::now() + std::chrono::milliseconds( in_ulMillisec ), std::move( in_cb ) ); }
+    void cancelTimer( TimerId in_id );
+
+    void post( Callback in_cb );
+    void wake();
+    std::size_t runOnce( std::int64_t in_iMaxWaitMillisec = -1 );
+    void run();
+    void stop();
+
+private:
+    /// A watched socket.
+    struct Watch {
+        NativeSocket sock;       ///< The socket.
+        std::uint32_t events;    ///< What to wait for.
+        std::uint32_t gen;       ///< Tells the watches of a reused socket number apart.
+        SocketCallback cb;       ///< What to call.
+    };
+
+    std::size_t runPosted();
+    std::size_t runTimers();
+    std::int64_t getWaitMillisec( std::int64_t in_iMaxWaitMillisec ) const;
+
+    bool m_bValid = false;                          ///< Whether the loop can be used.
+    int m_epoll = -1;                               ///< The epoll instance (Linux only).
+    int m_wakeFd = -1;                              ///< Makes a waiting loop return (an eventfd on Linux, a pipe elsewhere).
+    int m_wakeWriteFd = -1;                         ///< The writing end of the pipe, where there is no eventfd.
+    std::uint32_t m_uiGen = 0;                      ///< The generation of the last watch added.
+    std::unordered_map<NativeSocket, std::shared_ptr<Watch>> m_sockets; ///< The watched sockets.
+    std::map<std::pair<Clock::time_point, TimerId>, Callback> m_timers; ///< The timers, the next one first.
+    std::unordered_map<TimerId, Clock::time_point> m_timerIds; ///< Where to find the timers by id.
+    TimerId m_lastTimerId = 0;                      ///< The id of the last timer added.
+    std::mutex m_postMtx;                           ///< Protects m_posted.
+    std::vector<Callback> m_posted;                 ///< The functions posted but not run yet.
+    std::atomic<bool> m_bWakePending{ false };      ///< Whether the loop has been woken and not yet noticed.
+    std::atomic<bool> m_bStop{ false };             ///< Makes run() return.
+};
+
+}
+
+#endif /* FTS_EVENTLOOP_H */
+
+ /* EOF */
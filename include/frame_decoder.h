@@ -0,0 +1,81 @@
+/**
+ * \file frame_decoder.h
+ * \brief This file describes the class that cuts a stream of received
+ *        bytes into packets.
+ **/
+
+#ifndef FTS_FRAMEDECODER_H
+#define FTS_FRAMEDECODER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "packet_view.h"
+
+namespace FTS {
+
+/// The default number of bytes a decoder skips before it gives up on a stream.
+constexpr std::size_t D_FRAME_MAX_SKIP = 65536;
+
+/// Cuts a stream of received bytes into FTSS frames.
+/** The decoder never reads from a socket and never blocks: it is handed the
+ *  bytes as they come in, in chunks of any size, and remembers where it stopped
+ *  in between. So a blocking connection, an event loop or a test can all feed
+ *  it the same way:
+ *  \code
+ *  while( len > 0 ) {
+ *      PacketView frame;
+ *      auto used = decoder.decode( p, len, frame );
+ *      p += used;
+ *      len -= used;
+ *      if( frame.isValid() )
+ *          handle( frame );
+ *  }
+ *  \endcode
+ *  A frame that is completely inside the chunk is returned as a view of the
+ *  chunk, without any copy. The bytes of a frame that is cut by the end of a
+ *  chunk are kept by the decoder until the frame is complete, then the view
+ *  references the decoder. Either way, the view is only valid until the next
+ *  call of decode.\n
+ *  Everything before an "FTSS" identifier is skipped. Frames with an invalid
+ *  request or payload length are dropped. If too much is skipped or dropped
+ *  in a row, the stream is considered corrupt, see isCorrupt.
+ **/
+class FrameDecoder {
+public:
+    explicit FrameDecoder( std::uint32_t in_uiMaxPayloadLen = UINT32_MAX, std::size_t in_uiMaxSkip = D_FRAME_MAX_SKIP );
+
+    std::size_t decode( const void* in_pData, std::size_t in_uiLen, PacketView& out_frame );
+    void reset();
+
+    /// Whether the decoder holds the start of a frame that isn't complete yet.
+    bool isInFrame() const { return (!m_partial.empty() && !m_bComplete) || m_uiDiscard > 0; }
+    /// The number of bytes skipped while looking for an "FTSS" identifier.
+    std::uint64_t getSkippedBytes() const { return m_uiSkipped; }
+    /// The number of frames dropped because of an invalid header.
+    std::uint64_t getDroppedFrames() const { return m_uiDropped; }
+    /// Whether more bytes than allowed have been skipped or dropped since the
+    /// last valid frame. There is no point in reading such a stream any further.
+    bool isCorrupt() const { return m_uiSkippedInRow > m_uiMaxSkip; }
+
+private:
+    std::vector<std::int8_t> m_partial; ///< The bytes of a frame cut by the end of a chunk.
+    std::size_t m_uiFrameLen = 0;       ///< The length of that frame, 0 while its header is incomplete.
+    bool m_bComplete = false;           ///< Whether m_partial holds a frame that has been returned.
+    std::uint32_t m_uiMaxPayloadLen;    ///< Longer payloads are considered invalid.
+    std::uint64_t m_uiSkipped = 0;      ///< See getSkippedBytes.
+    std::uint64_t m_uiDropped = 0;      ///< See getDroppedFrames.
+    std::size_t m_uiDiscard = 0;        ///< The bytes of a dropped frame that are still to come.
+    std::size_t m_uiMaxSkip;            ///< See isCorrupt.
+    std::size_t m_uiSkippedInRow = 0;   ///< The bytes skipped or dropped since the last valid frame.
+
+    bool checkHeader( const std::int8_t* in_pHdr, std::size_t& out_uiLen );
+    std::size_t dropFrame( std::size_t in_uiFrameLen, std::size_t in_uiLen );
+    std::size_t continueFrame( const std::int8_t* in_pData, std::size_t in_uiLen, PacketView& out_frame );
+};
+
+}
+
+#endif /* FTS_FRAMEDECODER_H */
+
+ /* EOF */
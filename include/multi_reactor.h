@@ -0,0 +1,82 @@
+/**
+ * \file multi_reactor.h
+ * \brief This file describes the multi-reactor, which serves the connections
+ *        of one port from a reactor per core.
+ **/
+
+#ifndef FTS_MULTIREACTOR_H
+#define FTS_MULTIREACTOR_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "reactor.h"
+
+namespace FTS {
+
+/// Serves the connections of one port from several threads, one reactor each.
+/** Every worker thread has its own Reactor with its own listening socket on
+ *  the same port (SO_REUSEPORT), so the kernel spreads the new connections
+ *  among them and no thread ever hands a connection to another one. A
+ *  connection stays with the reactor that accepted it for its whole life.\n
+ *  The threads are pinned to a core each, and each listener prefers the
+ *  connections whose packets arrive on its core (SO_INCOMING_CPU), so the
+ *  packets of a connection are handled where the kernel received them, e.g.
+ *  \code
+ *  MultiReactor reactors;
+ *  reactors.listen( 44917, []( Reactor& io_reactor, Connection* in_pCon ) {
+ *      io_reactor.add( in_pCon, []( Connection& in_con, PacketPtr in_p ) { in_con.send( in_p.get() ); } );
+ *  } );
+ *  reactors.start();
+ *  \endcode
+ *  Without SO_REUSEPORT (e.g. on Windows) the first reactor accepts all the
+ *  connections and deals them out to the reactors in turn.\n
+ *  The callbacks are called on the thread of the reactor they are given,
+ *  the rules of Reactor apply.
+ **/
+class MultiReactor {
+public:
+    /// Gets a new connection, which it owns, and the reactor to serve it on.
+    using AcceptCallback = std::function<void( Reactor& io_reactor, Connection* in_pCon )>;
+
+    explicit MultiReactor( unsigned in_nThreads = 0 );
+    MultiReactor( const MultiReactor& ) = delete;
+    MultiReactor& operator=( const MultiReactor& ) = delete;
+    ~MultiReactor();
+
+    int listen( std::uint16_t in_usPort, AcceptCallback in_onAccept, const ConnectionOptions& in_options = ConnectionOptions() );
+
+    /// Whether to pin each thread to a core, true by default. Call it before listen.
+    void setPinThreads( bool in_bPin ) { m_bPinThreads = in_bPin; }
+    /// Whether every reactor has its own listener, false if the first one deals out the connections.
+    bool isSharingPort() const { return m_bSharingPort; }
+
+    void start();
+    void stop();
+
+    /// The number of threads, and so of reactors.
+    std::size_t getThreadCount() const { return m_reactors.size(); }
+    /// A reactor, e.g. to add connections or timers to it through its loop.
+    Reactor& getReactor( std::size_t in_i ) { return *m_reactors[in_i]; }
+
+private:
+    unsigned getCpu( std::size_t in_i ) const;
+    void dealOut( Connection* in_pCon );
+
+    std::vector<std::unique_ptr<Reactor>> m_reactors; ///< One per thread.
+    std::vector<unsigned> m_cpus;                     ///< The cores the process may run on, the threads go round them.
+    std::vector<std::thread> m_threads;               ///< The running threads, empty if not started.
+    AcceptCallback m_onAccept;                        ///< Gets the new connections.
+    bool m_bPinThreads = true;                        ///< Whether to pin each thread to a core.
+    bool m_bSharingPort = false;                      ///< Whether every reactor has its own listener.
+    std::size_t m_uiNext = 0;                         ///< The reactor to deal the next connection to.
+};
+
+}
+
+#endif /* FTS_MULTIREACTOR_H */
+
+ /* EOF */
@@ -9,12 +9,25 @@
 #ifndef FTS_PACKET_H
 #define FTS_PACKET_H
 
+#include <memory>
 #include <string>
+#include <string_view>
 
+#include "byte_order.h"
 #include "packet_header.h"
 
 namespace FTS {
 
+/// Size of the buffer inside each packet object (header included).
+/** Packets that fit into it (most chat, login and ack messages) don't need
+ *  any heap allocation. Bigger ones spill into a buffer of the PacketBufferPool.
+ **/
+constexpr std::size_t D_PACKET_INLINE_LEN = 128;
+
+class Packet;
+/// The owning handle of a packet.
+using PacketPtr = std::unique_ptr<Packet>;
+
 /// The FTS packet class
 /** This class represents a packet that can be sent over a connection.
  *  This connection is described by another class.
@@ -23,6 +36,7 @@ class Packet {
     friend class Connection;
     friend class TraditionalConnection;
     friend class OnDemandHTTPConnection;
+    friend class PacketQueue;
 
 public:
     Packet( const Packet &in_copy ) = delete ; ///< Block the copy-constructor.
@@ -34,6 +48,10 @@ public:
     Packet(master_request_t in_cType);
     virtual ~Packet();
 
+    static PacketPtr create(master_request_t in_cType, std::size_t in_payloadLen);
+    static void* operator new(std::size_t in_size);
+    static void operator delete(void* in_p);
+
     bool isValid() const;
 
     Packet *setType(master_request_t in_cType);
@@ -43,11 +61,15 @@ public:
     std::size_t getPayloadLen() const;
     Packet *rewind();
     Packet *realloc( std::size_t in_newSize );
+    Packet *reserve( std::size_t in_payloadLen );
+    std::size_t getCapacity() const { return m_uiCapacity; }
     std::int8_t* getPayloadPtr() const { return getDataPtr(); }
     Packet* transferData( Packet* p );
 
-    Packet *append(std::string in);
+    Packet *append(const std::string& in);
+    Packet *append(const char *in);
     Packet *append(const void *in_pData, std::size_t in_iSize);
+    std::int8_t *appendRaw(std::size_t in_iSize);
 
     /// Appends something to the message.
     /** This appends something at the current cursor position in the message.
@@ -57,21 +79,15 @@ public:
     *
     * \return a pointer to itself (this)
     *
-    * \note If there is not enough space to hold it, nothing is stored.
-    *
     * \author Pompei2
     */
     template<class T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type* = nullptr>
     Packet* append( T in )
     {
-        std::int8_t* pBuf;
-        pBuf = (std::int8_t *)::realloc( (void *) m_pData, sizeof( T ) + m_uiCursor );
-        if( pBuf != nullptr ) {
-            m_pData = pBuf;
-            *((T *) & m_pData[m_uiCursor]) = in;
-            m_uiCursor += sizeof( T );
-            ((fts_packet_hdr_t*) m_pData)->data_len = (std::uint32_t) (m_uiCursor - D_PACKET_HDR_LEN);
-        }
+        this->ensureCapacity( sizeof( T ) + m_uiCursor );
+        *((T *) & m_pData[m_uiCursor]) = in;
+        m_uiCursor += sizeof( T );
+        ((fts_packet_hdr_t*) m_pData)->data_len = (std::uint32_t) (m_uiCursor - D_PACKET_HDR_LEN);
         return this;
     }
 
@@ -98,9 +114,53 @@ public:
         m_uiCursor += sizeof( T );
     }
 
+    /// Appends an array of integers in one go.
+    /** This appends \a in_count integers at the current cursor position in the
+     *  message, growing the packet only once. After adding the data, the cursor
+     *  is moved to point right behind it.
+     *
+     * \param in_pData The first integer to append.
+     * \param in_count The number of integers to append.
+     * \param in_order The byte order to store the integers in.
+     *
+     * \return a pointer to itself (this)
+     */
+    template<class T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type* = nullptr>
+    Packet* appendArray( const T* in_pData, std::size_t in_count, ByteOrder in_order = ByteOrder::Host )
+    {
+        copyByteOrder( this->appendRaw( in_count * sizeof( T ) ), in_pData, in_count, sizeof( T ), in_order );
+        return this;
+    }
+
+    /// Retrieves an array of integers in one go.
+    /** This retrieves \a in_count integers from the current cursor position in
+     *  the message. After retrieving the data, the cursor is moved to point
+     *  right behind it.
+     *
+     * \param out_pData Where to store the integers.
+     * \param in_count The number of integers to retrieve.
+     * \param in_order The byte order the integers are stored in.
+     *
+     * \return false if there aren't \a in_count integers left. Then nothing
+     *         is read and the cursor stays where it is.
+     */
+    template<class T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type* = nullptr>
+    bool getArray( T* out_pData, std::size_t in_count, ByteOrder in_order = ByteOrder::Host )
+    {
+        std::size_t len = this->getTotalLen();
+        if( m_uiCursor > len || in_count > (len - m_uiCursor) / sizeof( T ) ) {
+            return false;
+        }
+
+        copyByteOrder( out_pData, &m_pData[m_uiCursor], in_count, sizeof( T ), in_order );
+        m_uiCursor += in_count * sizeof( T );
+        return true;
+    }
+
     inline std::int8_t get() { std::int8_t out = 0; this->get(out); return out;}
     inline void get(std::string& out) {out = this->get_string(); }
     std::string get_string();
+    std::string_view get_string_view();
     std::string extractString();
     int get(void *out_pData, std::size_t in_iSize);
 
@@ -112,6 +172,23 @@ public:
 private:
     std::int8_t *m_pData;     ///< The data this packet contains.
     std::size_t m_uiCursor;   ///< The current cursor position in the data.
+    std::size_t m_uiCapacity; ///< The allocated size of m_pData, header included.
+    alignas(8) std::int8_t m_inline[D_PACKET_INLINE_LEN]; ///< The buffer m_pData points to, as long as it is big enough.
+    Packet *m_pQueuePrev = nullptr;     ///< The previous packet in the PacketQueue.
+    Packet *m_pQueueNext = nullptr;     ///< The next packet in the PacketQueue.
+    Packet *m_pQueueNextSame = nullptr; ///< The next packet of the same type in the PacketQueue.
+
+    Packet *appendString(const char *in, std::size_t in_len);
+    bool ownsData() const;
+    /// The storage right behind the object, used by packets made by create().
+    inline std::int8_t *trailingData() const { return (std::int8_t *)this + sizeof(Packet); }
+    void allocateData(std::size_t in_size);
+    void releaseData();
+    void takeData(Packet& in_packet);
+
+    void grow(std::size_t in_needed);
+    /// Makes sure \a in_needed bytes (header included) fit into the buffer.
+    inline void ensureCapacity(std::size_t in_needed) { if(in_needed > m_uiCapacity) grow(in_needed); }
 
     /// Returns a pointer to the beginning of the data.
     inline std::int8_t *getDataPtr() const            {return &m_pData[D_PACKET_HDR_LEN];}
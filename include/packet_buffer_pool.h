@@ -0,0 +1,97 @@
+/**
+ * \file packet_buffer_pool.h
+ * \brief This file describes the size-classed pool the packets draw
+ *        their data buffers from.
+ **/
+
+#ifndef FTS_PACKETBUFFERPOOL_H
+#define FTS_PACKETBUFFERPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace FTS {
+
+/// Counters of the packet buffer pool.
+struct PacketBufferPoolStats {
+    std::uint64_t allocations = 0; ///< Buffers handed out.
+    std::uint64_t releases = 0;    ///< Buffers given back.
+    std::uint64_t hits = 0;        ///< Allocations served from a free list.
+    std::uint64_t misses = 0;      ///< Allocations that had to go to the heap.
+    std::uint64_t oversized = 0;   ///< Allocations bigger than the biggest size class.
+    std::uint64_t trimmed = 0;     ///< Released buffers freed because their free list was full.
+};
+
+/// A size-classed buffer pool.
+/** Every buffer is rounded up to the next size class and, when given back,
+ *  kept in a free list of that class instead of being freed. Each thread keeps
+ *  a small cache per class which is refilled from and spilled to a global
+ *  free list, so a thread that allocates and releases packets at a steady
+ *  rate does not touch the heap (and rarely a lock).\n
+ *  Buffers bigger than the biggest class come directly from the heap.\n
+ *  Every buffer carries a small hidden header in front of it, so the pool knows
+ *  its size class when it is released or reallocated.
+ **/
+class PacketBufferPool {
+public:
+    static constexpr std::size_t MAX_CLASSES = 16;            ///< The maximum number of size classes.
+    static constexpr std::size_t DEFAULT_MAX_FREE = 256;      ///< Default number of buffers kept per class.
+    static constexpr std::size_t THREAD_CACHE_LEN = 32;       ///< Buffers per class cached in each thread.
+
+    PacketBufferPool( const PacketBufferPool& ) = delete;
+    PacketBufferPool& operator=( const PacketBufferPool& ) = delete;
+
+    static PacketBufferPool& instance();
+
+    bool configure( const std::vector<std::size_t>& in_classes, std::size_t in_maxFreePerClass = DEFAULT_MAX_FREE );
+    std::vector<std::size_t> getClasses() const;
+
+    void* allocate( std::size_t in_size );
+    void* reallocate( void* in_p, std::size_t in_newSize );
+    void release( void* in_p );
+    static std::size_t capacity( const void* in_p );
+
+    void trim();
+    PacketBufferPoolStats getStats() const;
+    void resetStats();
+
+private:
+    struct FreeList {
+        std::mutex mtx;                 ///< Protects the list.
+        void* head = nullptr;           ///< First free block of this class.
+        std::size_t count = 0;          ///< Number of blocks in the list.
+    };
+
+    friend struct PacketBufferThreadCache;
+
+    PacketBufferPool();
+
+    int findClass( std::size_t in_size ) const;
+    void* allocateBlock( int in_class, std::size_t in_size );
+    void releaseBlock( void* in_block );
+    void pushGlobal( int in_class, void* in_block );
+    void* popGlobal( int in_class );
+
+    std::size_t m_classes[MAX_CLASSES];      ///< The size classes, in ascending order.
+    std::atomic<std::size_t> m_nClasses;     ///< The number of valid entries in m_classes.
+    std::atomic<std::uint32_t> m_generation; ///< Incremented on every (re-)configuration.
+    std::size_t m_maxFree;                   ///< Number of buffers kept in each global free list.
+    FreeList m_free[MAX_CLASSES];            ///< The global free lists.
+    mutable std::mutex m_configMtx;          ///< Serializes configuration changes.
+
+    std::atomic<std::uint64_t> m_allocations;
+    std::atomic<std::uint64_t> m_releases;
+    std::atomic<std::uint64_t> m_hits;
+    std::atomic<std::uint64_t> m_misses;
+    std::atomic<std::uint64_t> m_oversized;
+    std::atomic<std::uint64_t> m_trimmed;
+};
+
+}
+
+#endif /* FTS_PACKETBUFFERPOOL_H */
+
+ /* EOF */
@@ -0,0 +1,74 @@
+/**
+ * \file packet_queue.h
+ * \brief This file describes the queue of the packets a connection has
+ *        received but nobody asked for yet.
+ **/
+
+#ifndef FTS_PACKETQUEUE_H
+#define FTS_PACKETQUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "packet.h"
+
+namespace FTS {
+
+/// A FIFO of received packets that can also be taken from by request id.
+/** The packets are linked through hooks inside of them, so queueing never
+ *  allocates. Besides the global order (oldest first), the packets of each
+ *  request id are linked in a list of their own: taking the oldest packet,
+ *  the oldest packet of a given id and counting the packets of an id are all
+ *  O(1).\n
+ *  The queue owns the packets it holds, clear() and the destructor delete them.
+ *  A packet can be in one queue only.
+ **/
+class PacketQueue {
+public:
+    PacketQueue() = default;
+    PacketQueue( const PacketQueue& ) = delete;
+    PacketQueue& operator=( const PacketQueue& ) = delete;
+    ~PacketQueue() { this->clear(); }
+
+    bool empty() const { return m_pHead == nullptr; }
+    std::size_t size() const { return m_uiSize; }
+    /// The number of queued packets with the request id \a in_req.
+    std::size_t count( master_request_t in_req ) const { return m_perReq[in_req].uiCount; }
+    /// The oldest packet, without taking it out.
+    Packet *front() const { return m_pHead; }
+
+    void push( Packet *in_pPacket );
+    Packet *pop();
+    Packet *pop( master_request_t in_req );
+    void clear();
+
+    /// Calls \a in_f for every queued packet, oldest first.
+    template<class F>
+    void forEach( F&& in_f ) const
+    {
+        for( Packet *p = m_pHead; p != nullptr; p = p->m_pQueueNext ) {
+            in_f( (const Packet *) p );
+        }
+    }
+
+private:
+    /// The packets of one request id.
+    struct ReqList {
+        Packet *pHead = nullptr;   ///< The oldest packet of this id.
+        Packet *pTail = nullptr;   ///< The most recent packet of this id.
+        std::size_t uiCount = 0;   ///< The number of packets of this id.
+    };
+
+    void unlink( Packet *in_pPacket );
+
+    Packet *m_pHead = nullptr;    ///< The oldest packet.
+    Packet *m_pTail = nullptr;    ///< The most recent packet.
+    std::size_t m_uiSize = 0;     ///< The number of queued packets.
+    ReqList m_perReq[256];        ///< The lists per request id.
+};
+
+}
+
+#endif /* FTS_PACKETQUEUE_H */
+
+ /* EOF */
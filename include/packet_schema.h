@@ -0,0 +1,173 @@
+/**
+ * \file packet_schema.h
+ * \brief This file describes the compile-time definition of the
+ *        layout of a message.
+ **/
+
+#ifndef FTS_PACKETSCHEMA_H
+#define FTS_PACKETSCHEMA_H
+
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "packet.h"
+#include "packet_view.h"
+
+namespace FTS {
+
+/// Marks a message field as a zero terminated string.
+struct CString {};
+
+/// Describes how a field type is laid out in a message.
+/** Only integers, enums and CString are valid fields, every other type
+ *  stops the compilation.
+ **/
+template<class T, class Enable = void>
+struct FieldTraits {
+    static_assert( sizeof( T ) == 0, "Message fields have to be integers, enums or CString." );
+};
+
+/// Integers and enums are stored as they are in memory.
+template<class T>
+struct FieldTraits<T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type> {
+    using EncodeType = T;
+    using DecodeType = T;
+    static constexpr bool isString = false;
+    static constexpr std::size_t minSize = sizeof( T );
+
+    static std::size_t size( T ) { return sizeof( T ); }
+    static std::int8_t* write( std::int8_t* p, T in ) { memcpy( p, &in, sizeof( T ) ); return p + sizeof( T ); }
+    /// Has no bound check: MessageDef checks all fixed fields at once.
+    static const std::int8_t* read( const std::int8_t* p, const std::int8_t*, bool&, T& out ) { memcpy( &out, p, sizeof( T ) ); return p + sizeof( T ); }
+};
+
+/// Strings are stored with their terminating \0 and decoded without copy.
+template<>
+struct FieldTraits<CString> {
+    using EncodeType = std::string_view;
+    using DecodeType = std::string_view;
+    static constexpr bool isString = true;
+    static constexpr std::size_t minSize = 1;
+
+    static std::size_t size( std::string_view in ) { return in.size() + 1; }
+    static std::int8_t* write( std::int8_t* p, std::string_view in )
+    {
+        memcpy( p, in.data(), in.size() );
+        p[in.size()] = 0;
+        return p + in.size() + 1;
+    }
+    /// Looks for the \0 before \a in_pLimit. If there is none, \a io_bOk is
+    /// cleared and the cursor is not moved, so following fields stay in bounds.
+    static const std::int8_t* read( const std::int8_t* p, const std::int8_t* in_pLimit, bool& io_bOk, std::string_view& out )
+    {
+        auto pEnd = (const std::int8_t*) memchr( p, 0, (std::size_t) (in_pLimit - p) );
+        if( pEnd == nullptr ) {
+            io_bOk = false;
+            return p;
+        }
+        out = std::string_view( (const char*) p, (std::size_t) (pEnd - p) );
+        return pEnd + 1;
+    }
+};
+
+/// The compile-time definition of a message.
+/** Each request declares its fields once, e.g.
+ *  \code
+ *  using ChatSendMsg = MessageDef<DSRV_MSG_CHAT_SENDMSG, DSRV_CHAT_TYPE, CString, CString>;
+ *
+ *  auto p = ChatSendMsg::create( DSRV_CHAT_TYPE::NORMAL, "", "Hi all" );
+ *
+ *  DSRV_CHAT_TYPE type; std::string_view to, msg;
+ *  if( ChatSendMsg::decode( *p, type, to, msg ) ) ...
+ *  \endcode
+ *  and gets encode and decode functions that are fully inlined. Passing too
+ *  many or too few fields, or decoding into a variable of the wrong type, does
+ *  not compile.\n
+ *  Encoding computes the size first and grows the packet once. Decoding
+ *  checks the size of all fields once up front; strings are only searched
+ *  for their \0 within the bytes not needed by the fields behind them, so no
+ *  field ever needs its own bound check.
+ **/
+template<master_request_t Req, class... Fields>
+struct MessageDef {
+    static constexpr master_request_t type = Req;
+    /// The minimal payload length, every string being empty.
+    static constexpr std::size_t minSize = (FieldTraits<Fields>::minSize + ... + 0);
+    /// Whether the payload length is always minSize.
+    static constexpr bool isFixedSize = !(FieldTraits<Fields>::isString || ... || false);
+
+    /// The payload length for the given field values.
+    static std::size_t size( typename FieldTraits<Fields>::EncodeType... in )
+    {
+        return (FieldTraits<Fields>::size( in ) + ... + 0);
+    }
+
+    /// Appends the fields at the cursor of \a out.
+    static void encode( Packet& out, typename FieldTraits<Fields>::EncodeType... in )
+    {
+        std::int8_t* p = out.appendRaw( size( in... ) );
+        ((p = FieldTraits<Fields>::write( p, in )), ...);
+        (void) p;
+    }
+
+    /// Makes a packet holding the fields, in one single allocation.
+    static PacketPtr create( typename FieldTraits<Fields>::EncodeType... in )
+    {
+        auto p = Packet::create( Req, size( in... ) );
+        encode( *p, in... );
+        return p;
+    }
+
+    /// Reads the fields at the cursor of \a in and moves the cursor behind them.
+    /** \return false if \a in is of another type or too short. The cursor
+     *          is only moved if the fields could be read.
+     */
+    static bool decode( PacketView& in, typename FieldTraits<Fields>::DecodeType&... out )
+    {
+        if( in.getType() != Req || in.getRemaining() < minSize ) {
+            return false;
+        }
+
+        const std::int8_t* pStart = in.getCursorPtr();
+        const std::int8_t* pEnd = pStart + in.getRemaining();
+        bool bOk = true;
+        auto p = readFields( pStart, pEnd, bOk, std::index_sequence_for<Fields...>(), out... );
+        return bOk && in.skip( (std::size_t) (p - pStart) );
+    }
+
+    /// Reads the fields from the start of the payload of \a in.
+    static bool decode( const Packet& in, typename FieldTraits<Fields>::DecodeType&... out )
+    {
+        PacketView view( in );
+        return decode( view, out... );
+    }
+
+private:
+    static constexpr std::size_t minSizes[sizeof...( Fields ) + 1] = { FieldTraits<Fields>::minSize..., 0 };
+
+    /// The minimal size of all fields behind field \a I.
+    static constexpr std::size_t minSizeBehind( std::size_t I )
+    {
+        std::size_t n = 0;
+        for( std::size_t i = I + 1; i < sizeof...( Fields ); ++i ) {
+            n += minSizes[i];
+        }
+        return n;
+    }
+
+    template<std::size_t... I>
+    static const std::int8_t* readFields( const std::int8_t* p, const std::int8_t* pEnd, bool& io_bOk, std::index_sequence<I...>, typename FieldTraits<Fields>::DecodeType&... out )
+    {
+        ((p = FieldTraits<Fields>::read( p, pEnd - std::integral_constant<std::size_t, minSizeBehind( I )>::value, io_bOk, out )), ...);
+        (void) pEnd;
+        return p;
+    }
+};
+
+}
+
+#endif /* FTS_PACKETSCHEMA_H */
+
+ /* EOF */
@@ -0,0 +1,98 @@
+/**
+ * \file packet_view.h
+ * \brief This file describes a read-only view onto the bytes of a
+ *        received packet.
+ **/
+
+#ifndef FTS_PACKETVIEW_H
+#define FTS_PACKETVIEW_H
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "packet.h"
+
+namespace FTS {
+
+/// A read-only, non-owning view of a packet.
+/** The view references the payload bytes of a packet that lives somewhere
+ *  else (a receive buffer, a Packet, the payload of another packet) and
+ *  decodes it without copying or allocating anything. It has its own cursor,
+ *  so several views may read the same bytes.\n
+ *  The referenced bytes have to outlive the view.
+ **/
+class PacketView {
+public:
+    PacketView() = default;
+    PacketView( master_request_t in_cType, const void* in_pPayload, std::size_t in_uiPayloadLen );
+    explicit PacketView( const Packet& in_packet );
+
+    static PacketView fromFrame( const void* in_pData, std::size_t in_uiLen );
+
+    /// False if the view has been made from invalid bytes.
+    bool isValid() const { return m_bValid; }
+    master_request_t getType() const { return m_cType; }
+    std::size_t getPayloadLen() const { return m_uiLen; }
+    const std::int8_t* getPayloadPtr() const { return m_pPayload; }
+    /// The number of bytes between the cursor and the end of the payload.
+    std::size_t getRemaining() const { return m_uiLen - m_uiCursor; }
+    PacketView& rewind() { m_uiCursor = 0; return *this; }
+    /// The byte the cursor is at.
+    const std::int8_t* getCursorPtr() const { return m_pPayload + m_uiCursor; }
+    /// Moves the cursor \a in_uiSize bytes forward, if there are that many left.
+    bool skip( std::size_t in_uiSize ) { if( getRemaining() < in_uiSize ) return false; m_uiCursor += in_uiSize; return true; }
+
+    /// Retrieves something from the payload.
+    /** This retrieves something from the current cursor position in the payload.
+     *  After retrieving the data, the cursor is moved to point right behind it.
+     *
+     * \param out Reference to the data to retrieve. If there was an error, this is set to 0.
+     *
+     * \return false if there weren't enough bytes left.
+     */
+    template<class T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type* = nullptr>
+    bool get( T& out )
+    {
+        if( getRemaining() < sizeof( T ) ) {
+            out = (T) 0;
+            return false;
+        }
+        memcpy( &out, m_pPayload + m_uiCursor, sizeof( T ) );
+        m_uiCursor += sizeof( T );
+        return true;
+    }
+
+    /// Retrieves an array of integers in one go, see Packet::getArray.
+    template<class T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type* = nullptr>
+    bool getArray( T* out_pData, std::size_t in_count, ByteOrder in_order = ByteOrder::Host )
+    {
+        if( in_count > getRemaining() / sizeof( T ) ) {
+            return false;
+        }
+        copyByteOrder( out_pData, m_pPayload + m_uiCursor, in_count, sizeof( T ), in_order );
+        m_uiCursor += in_count * sizeof( T );
+        return true;
+    }
+
+    inline std::int8_t get() { std::int8_t out = 0; this->get( out ); return out; }
+    std::string_view get_string_view();
+    std::string get_string() { return std::string( this->get_string_view() ); }
+    std::size_t get( void* out_pData, std::size_t in_uiSize );
+    PacketView getPacketView();
+    PacketPtr toPacket() const;
+
+private:
+    const std::int8_t* m_pPayload = nullptr;   ///< The first payload byte.
+    std::size_t m_uiLen = 0;                   ///< The length of the payload.
+    std::size_t m_uiCursor = 0;                ///< The read position, relative to m_pPayload.
+    master_request_t m_cType = DSRV_MSG_NULL;  ///< The type of the packet.
+    bool m_bValid = false;                     ///< Whether the view references a proper packet.
+};
+
+}
+
+#endif /* FTS_PACKETVIEW_H */
+
+ /* EOF */
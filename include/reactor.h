@@ -0,0 +1,104 @@
+/**
+ * \file reactor.h
+ * \brief This file describes the reactor, which serves many connections
+ *        from one thread.
+ **/
+
+#ifndef FTS_REACTOR_H
+#define FTS_REACTOR_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+#include "connection.h"
+#include "connection_waiter.h"
+#include "event_loop.h"
+
+/// The most packets taken from one connection per wakeup, so a busy
+/// connection can't starve the others.
+#define D_REACTOR_MAX_PACKETS_PER_WAKEUP 64
+
+namespace FTS {
+
+class SocketConnectionWaiter;
+
+/// Serves many connections from one thread.
+/** Instead of a thread blocking in getPacket for each client, the reactor
+ *  puts the sockets of all its connections in non-blocking mode and waits
+ *  for all of them at once in an EventLoop. When a socket is readable, it
+ *  receives what is there, cuts it into packets and hands each complete
+ *  packet to the callback of its connection, e.g.
+ *  \code
+ *  Reactor reactor;
+ *  reactor.listen( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ), 44917, [&]( Connection* in_pCon ) {
+ *      reactor.add( in_pCon, []( Connection& in_con, PacketPtr in_p ) { in_con.send( in_p.get() ); } );
+ *  } );
+ *  reactor.run();
+ *  \endcode
+ *  Only connections of type D_CONNECTION_TRADITIONAL can be added.\n
+ *  All callbacks are called on the thread running the reactor. They may
+ *  send, and add or remove connections, their own too. A send that would
+ *  block waits for the socket, which holds up all the other connections, so
+ *  keep the responses small or the send buffers big.\n
+ *  The responses to asynchronous requests (mreqAsync) go to their callback,
+ *  not to the packet callback.
+ **/
+class Reactor {
+public:
+    /// Gets a packet received on a connection. The callback owns the packet.
+    using PacketCallback = std::function<void( Connection& in_con, PacketPtr in_pPacket )>;
+    /// Is told a connection has been lost. The connection is freed right after.
+    using CloseCallback = std::function<void( Connection& in_con )>;
+    /// Gets a new connection, which it owns.
+    using AcceptCallback = std::function<void( Connection* in_pCon )>;
+
+    Reactor();
+    Reactor( const Reactor& ) = delete;
+    Reactor& operator=( const Reactor& ) = delete;
+    ~Reactor();
+
+    bool add( Connection* in_pCon, PacketCallback in_onPacket, CloseCallback in_onClose = CloseCallback() );
+    void remove( Connection* in_pCon );
+    Connection* release( Connection* in_pCon );
+    /// The number of connections served.
+    std::size_t getConnectionCount() const { return m_connections.size(); }
+
+    int listen( ConnectionWaiter* in_pWaiter, std::uint16_t in_usPort, AcceptCallback in_onAccept, const ConnectionOptions& in_options = ConnectionOptions() );
+    void stopListening();
+
+    /// The loop, e.g. to add timers or post functions from other threads.
+    EventLoop& getLoop() { return m_loop; }
+    /// Serves until stop is called.
+    void run() { m_loop.run(); }
+    /// Serves what is ready, waiting at most in_iMaxWaitMillisec (-1 for ever), see EventLoop::runOnce.
+    std::size_t runOnce( std::int64_t in_iMaxWaitMillisec = -1 ) { return m_loop.runOnce( in_iMaxWaitMillisec ); }
+    /// Makes run return, may be called from any thread.
+    void stop() { m_loop.stop(); }
+
+private:
+    /// A connection served.
+    struct Entry {
+        std::unique_ptr<Connection> pCon;  ///< The connection.
+        NativeSocket sock;                 ///< Its socket.
+        PacketCallback onPacket;           ///< Gets its packets.
+        CloseCallback onClose;             ///< Is told when it's lost.
+        bool bRemoved = false;             ///< Whether it has been removed in a callback.
+    };
+
+    void onReadable( const std::shared_ptr<Entry>& in_pEntry );
+    void onAcceptable();
+    std::shared_ptr<Entry> unlink( Connection* in_pCon );
+
+    EventLoop m_loop;                                                     ///< Waits for all the sockets.
+    std::unordered_map<Connection*, std::shared_ptr<Entry>> m_connections; ///< The connections served.
+    std::unique_ptr<SocketConnectionWaiter> m_pWaiter;                    ///< Accepts new connections, if listening.
+    AcceptCallback m_onAccept;                                            ///< Gets the new connections.
+};
+
+}
+
+#endif /* FTS_REACTOR_H */
+
+ /* EOF */
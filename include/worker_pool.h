@@ -0,0 +1,105 @@
+/**
+ * \file worker_pool.h
+ * \brief This file describes the worker pool, which takes the new connections
+ *        off the accepting thread and serves them on the least loaded worker.
+ **/
+
+#ifndef FTS_WORKERPOOL_H
+#define FTS_WORKERPOOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "connection_queue.h"
+#include "connection_waiter.h"
+#include "reactor.h"
+
+/// The most new connections waiting for each worker.
+#define D_WORKER_POOL_QUEUE_LEN 1024
+/// How long the accepting thread waits at once, and so how long stop may take.
+#define D_WORKER_POOL_ACCEPT_WAIT_MS 50
+
+namespace FTS {
+
+/// Serves the connections accepted on one thread by a pool of reactor threads.
+/** The accepting thread does nothing but accept: each new connection is
+ *  pushed to the ConnectionQueue of the worker that serves the fewest
+ *  connections right now, and that worker is woken up. The worker takes it
+ *  out on its own thread and hands it to the connection callback, together
+ *  with its Reactor, e.g.
+ *  \code
+ *  WorkerPool pool( 4 );
+ *  pool.listen( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ), 44917, []( Reactor& io_reactor, Connection* in_pCon ) {
+ *      // A slow login here holds up this worker only, not the accepting.
+ *      io_reactor.add( in_pCon, []( Connection& in_con, PacketPtr in_p ) { in_con.send( in_p.get() ); } );
+ *  } );
+ *  pool.start();
+ *  \endcode
+ *  So a login storm costs the accepting thread a push per connection, however
+ *  long the callbacks take. Connections accepted elsewhere can be handed in
+ *  with dispatch, from any thread.\n
+ *  The load of a worker counts the connections waiting in its queue and the
+ *  ones its reactor serves. If all queues are full, the new connection is
+ *  closed and counted as dropped.
+ **/
+class WorkerPool {
+public:
+    /// Gets a new connection, which it owns, on the thread of the worker that serves it.
+    using ConnectionCallback = std::function<void( Reactor& io_reactor, Connection* in_pCon )>;
+
+    explicit WorkerPool( unsigned in_nWorkers = 0, std::size_t in_uiQueueLen = D_WORKER_POOL_QUEUE_LEN );
+    WorkerPool( const WorkerPool& ) = delete;
+    WorkerPool& operator=( const WorkerPool& ) = delete;
+    ~WorkerPool();
+
+    /// Sets who gets the new connections. Call it before start, listen sets it too.
+    void setConnectionCallback( ConnectionCallback in_onConnection ) { m_onConnection = std::move( in_onConnection ); }
+    int listen( ConnectionWaiter* in_pWaiter, std::uint16_t in_usPort, ConnectionCallback in_onConnection, const ConnectionOptions& in_options = ConnectionOptions() );
+    bool dispatch( Connection* in_pCon );
+
+    void start();
+    void stop();
+
+    /// The number of worker threads.
+    std::size_t getWorkerCount() const { return m_workers.size(); }
+    /// A worker's reactor, e.g. to add timers to it through its loop.
+    Reactor& getReactor( std::size_t in_i ) { return m_workers[in_i]->reactor; }
+    /// The connections waiting for a worker and served by it.
+    std::size_t getLoad( std::size_t in_i ) const { return m_workers[in_i]->nLoad.load( std::memory_order_relaxed ); }
+    /// The connections closed because all queues were full.
+    std::uint64_t getDropped() const { return m_nDropped.load( std::memory_order_relaxed ); }
+
+private:
+    /// A thread serving connections.
+    struct Worker {
+        explicit Worker( std::size_t in_uiQueueLen ) : queue( in_uiQueueLen ) {}
+
+        Reactor reactor;                    ///< Serves the connections.
+        ConnectionQueue queue;              ///< The new connections, not taken yet.
+        std::atomic<std::size_t> nLoad{ 0 }; ///< The connections queued or served.
+        std::size_t uiServed = 0;           ///< The connections served after the last round, for the worker only.
+        std::thread thread;                 ///< Runs the reactor.
+    };
+
+    bool handTo( Worker& io_worker, Connection* in_pCon );
+    void work( Worker& io_worker );
+    void takeNew( Worker& io_worker );
+
+    std::vector<std::unique_ptr<Worker>> m_workers; ///< The workers.
+    std::unique_ptr<ConnectionWaiter> m_pWaiter;    ///< Accepts the connections, if listening.
+    std::thread m_acceptor;                         ///< Runs m_pWaiter, if listening.
+    ConnectionCallback m_onConnection;              ///< Gets the new connections.
+    std::atomic<bool> m_bStop{ false };             ///< Makes all threads return.
+    std::atomic<std::uint64_t> m_nDropped{ 0 };     ///< The connections closed because all queues were full.
+    bool m_bRunning = false;                        ///< Whether the threads have been started.
+};
+
+}
+
+#endif /* FTS_WORKERPOOL_H */
+
+ /* EOF */
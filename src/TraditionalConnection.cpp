@@ -14,6 +14,7 @@
 #include <ostream>
 #include <iostream>
 #include <cstring>
+#include <climits>
 
 #include "TraditionalConnection.h"
 #include "packet.h"
@@ -27,6 +28,7 @@
 #  include <netdb.h>
 #  include <fcntl.h>
 #  include <arpa/inet.h>
+#  include <netinet/tcp.h>
 #else
 // Gotta work this around with a function cuz a define would be too risked.
 inline void close(SOCKET s)
@@ -36,9 +38,42 @@ inline void close(SOCKET s)
 }
 #endif
 
+#ifndef IOV_MAX
+#  define IOV_MAX 1024
+#endif
+
 using namespace FTS;
 using namespace std;
 
+static inline void setIoVec( IOVEC& out_vec, const void *in_pData, size_t in_uiLen )
+{
+#if defined(_WIN32)
+    out_vec.buf = (char *)in_pData;
+    out_vec.len = (ULONG)in_uiLen;
+#else
+    out_vec.iov_base = (void *)in_pData;
+    out_vec.iov_len = in_uiLen;
+#endif
+}
+
+static inline size_t ioVecLen( const IOVEC& in_vec )
+{
+#if defined(_WIN32)
+    return in_vec.len;
+#else
+    return in_vec.iov_len;
+#endif
+}
+
+static inline const void *ioVecData( const IOVEC& in_vec )
+{
+#if defined(_WIN32)
+    return in_vec.buf;
+#else
+    return in_vec.iov_base;
+#endif
+}
+
 void TraditionalConnection::netlog(const std::string &in_s)
 {
     if( Logger::DbgLevel() == 0 ) {
@@ -79,14 +114,16 @@ void TraditionalConnection::netlog2(const std::string &in_s, const void* id, siz
  * \param in_usPort The port to connect to.
  * \param in_nTimeout The maximum number of milliseconds (1/1000 seconds)
  *                    to wait for a connection.
+ * \param in_options The tuning of the socket, see ConnectionOptions.
  *
  * \author Klaus Beyer 
  *
  * \note modified by Pompei2
  */
-FTS::TraditionalConnection::TraditionalConnection(const std::string &in_sName, uint16_t in_usPort, uint64_t in_ulTimeoutInMillisec)
+FTS::TraditionalConnection::TraditionalConnection(const std::string &in_sName, uint16_t in_usPort, uint64_t in_ulTimeoutInMillisec, const ConnectionOptions &in_options)
     : m_bConnected(false)
     , m_sock(0)
+    , m_options(in_options)
 {
     setMaxWaitMillisec( in_ulTimeoutInMillisec );
     memset( &m_saCounterpart, 0, sizeof( m_saCounterpart ) );
@@ -99,13 +136,18 @@ FTS::TraditionalConnection::TraditionalConnection(const std::string &in_sName, u
  *
  * \param[in] in_sock the socket to use for the connection
  * \param[in] in_sa   address of counterpart to which the connection goes.
+ * \param[in] in_options The tuning of the socket, see ConnectionOptions.
  *
  */
-FTS::TraditionalConnection::TraditionalConnection(SOCKET in_sock, SOCKADDR_IN in_sa)
+FTS::TraditionalConnection::TraditionalConnection(SOCKET in_sock, SOCKADDR_IN in_sa, const ConnectionOptions &in_options)
     : m_bConnected(true)
     , m_sock(in_sock)
     , m_saCounterpart(in_sa)
+    , m_options(in_options)
 {
+    // All waiting is done in poll, so the timeouts work on this socket too.
+    setSocketBlocking(m_sock, false);
+    applySocketOptions(m_sock, m_options);
 }
 
 /// Default destructor
@@ -158,16 +200,21 @@ bool FTS::TraditionalConnection::isConnected()
 void FTS::TraditionalConnection::disconnect()
 {
     if(m_bConnected) {
+        // Don't lose what has been collected while corked.
+        this->flushSendBuffer();
         close(m_sock);
         m_bConnected = false;
     }
+    m_sendBuf.clear();
+    m_bCorked = false;
+    m_recvBuf.clear();
+    m_decoder.reset();
     // We need to check empty the queue ourselves.
-    if(!m_lpPacketQueue.empty()) {
-        FTSMSGDBG( "There are still {1} packets in the queue left.", 5, toString( m_lpPacketQueue.size() ) );
-        for( auto p : m_lpPacketQueue ) {
-            delete p;
-        }
+    if(!m_packetQueue.empty()) {
+        FTSMSGDBG( "There are still {1} packets in the queue left.", 5, toString( m_packetQueue.size() ) );
+        m_packetQueue.clear();
     }
+    this->failPendingRequests( FTSC_ERR::NOT_CONNECTED );
 }
 
 /// Return the IP address of the counterpart.
@@ -232,6 +279,9 @@ FTSC_ERR FTS::TraditionalConnection::connectByName( std::string in_sName, uint16
     memcpy( (char *) &m_saCounterpart.sin_addr.s_addr, serverInfo->h_addr_list[0], serverInfo->h_length );
     m_saCounterpart.sin_port = htons( in_usPort );
 
+    // Before connecting, the buffer sizes decide on the TCP window scale.
+    applySocketOptions(m_sock, m_options);
+
     // Set the socket non-blocking so we can cancel it if it can't connect.
     setSocketBlocking(m_sock, false);
 
@@ -320,43 +370,130 @@ FTSC_ERR FTS::TraditionalConnection::connectByName( std::string in_sName, uint16
     return FTSC_ERR::TIMEOUT;
 }
 
-/// lowlevel data receiving method.
-/** This tries to receive some amount of data over the network. If it does get
- *  nothing (or not enough) within the time it has been accorded, it returns.
+/// Computes the deadline of an operation.
+/**
+ * \param in_ulMillisec The number of milliseconds from now, (uint64_t)-1
+ *                      for no deadline at all.
+ *
+ * \return The point in time the operation has to be finished.
+ */
+TraditionalConnection::Deadline FTS::TraditionalConnection::deadlineIn(std::uint64_t in_ulMillisec)
+{
+    if(in_ulMillisec == ((uint64_t) (-1)))
+        return Deadline::max();
+
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(std::min<uint64_t>(in_ulMillisec, INT32_MAX));
+}
+
+/// Waits until the socket is readable or writable.
+/** This sleeps in poll (select on windows), so waiting doesn't cost any CPU.
+ *
+ * \param in_bWrite Wait for the socket to be writable instead of readable.
+ * \param in_deadline When to give up.
+ *
+ * \return If successful:  OK, the socket is ready (or has an error the next
+ *                         recv/send will report).
+ * \return If failed:      TIMEOUT or SELECT
+ *
+ * \internal This method is only for internal use!
+ */
+FTSC_ERR FTS::TraditionalConnection::waitForSocket(bool in_bWrite, Deadline in_deadline)
+{
+    using namespace std::chrono;
+    while(true) {
+        // Rounded up, so we don't wake up just before the deadline.
+        int64_t iWaitMs = -1;
+        if(in_deadline != Deadline::max()) {
+            // Compared first: Deadline::min() - now would overflow.
+            auto now = steady_clock::now();
+            if(in_deadline <= now)
+                return FTSC_ERR::TIMEOUT;
+            auto left = in_deadline - now;
+            iWaitMs = std::min<int64_t>(duration_cast<milliseconds>(left + milliseconds(1) - nanoseconds(1)).count(), INT32_MAX);
+        }
+
+        ++m_ioStats.waitCalls;
+#if defined(_WIN32)
+        fd_set fds;
+        FD_ZERO( &fds );
+        FD_SET( m_sock, &fds );
+        timeval tv = { (long)(iWaitMs / 1000), (long)(iWaitMs % 1000) * 1000 };
+        int serr = ::select( 1, in_bWrite ? NULL : &fds, in_bWrite ? &fds : NULL, NULL, iWaitMs < 0 ? NULL : &tv );
+        if( serr == SOCKET_ERROR && WSAGetLastError() == WSAEINTR )
+            continue;
+#else
+        pollfd pfd;
+        pfd.fd = m_sock;
+        pfd.events = in_bWrite ? POLLOUT : POLLIN;
+        pfd.revents = 0;
+        int serr = ::poll( &pfd, 1, (int)iWaitMs );
+        if( serr == SOCKET_ERROR && errno == EINTR )
+            continue;
+#endif
+        if( serr == SOCKET_ERROR ) {
+            FTSMSG("Net: error during select: {1} ({2})", MsgType::Error, std::string(strerror(errno)), toString(errno));
+            return FTSC_ERR::SELECT;
+        }
+        if( serr > 0 )
+            return FTSC_ERR::OK;
+    }
+}
+
+/// Waits until more data can be sent.
+/**
+ * \param in_deadline When to give up.
+ *
+ * \return If successful:  OK
+ * \return If failed:      TIMEOUT or SELECT
+ *
+ * \internal This method is only for internal use!
+ */
+FTSC_ERR FTS::TraditionalConnection::waitForSend(Deadline in_deadline)
+{
+    auto err = this->waitForSocket( true, in_deadline );
+    if( err == FTSC_ERR::TIMEOUT ) {
+        FTSMSG( "Net: could not send data: timed out after {1} ms", MsgType::Error, toString( m_maxWaitMillisec ) );
+    }
+    return err;
+}
+
+/// Receives whatever is there, up to some amount of data.
+/** This does one successful recv. If there is nothing to receive, it waits
+ *  for data until the deadline.
  *
  * \param out_pBuf The (allocated) buffer where to write the data.
- * \param in_uiLen The length of the buffer to get.
+ * \param in_uiLen The length of the buffer.
+ * \param out_uiGot Is set to the number of bytes received.
+ * \param in_deadline When to give up waiting for data.
  *
  * \return If successful:  OK
  * \return If failed:      Error Code
  *
- * \note The user has to allocate the buffer big enough!
- * \note On linux, only an exactitude of 1-10 millisecond may be achieved. Anyway, on most PC's
- *       an exactitude of more the 10ms is nearly never possible.
  * \internal This method is only for internal use!
- *
- * \author Pompei2
  */
-FTSC_ERR FTS::TraditionalConnection::get_lowlevel(void *out_pBuf, std::size_t in_uiLen)
+FTSC_ERR FTS::TraditionalConnection::recvSome(void *out_pBuf, std::size_t in_uiLen, std::size_t &out_uiGot, Deadline in_deadline)
 {
-    size_t to_read = in_uiLen;
-    int8_t *buf = (int8_t *)out_pBuf;
-
-    using namespace std::chrono;
-    do {
-        auto startTime = steady_clock::now();
-        auto read = ::recv( m_sock, (char *) buf, (int)to_read, 0 );
+    out_uiGot = 0;
+    while(true) {
+        ++m_ioStats.recvCalls;
+        auto read = ::recv( m_sock, (char *) out_pBuf, (int)std::min<size_t>(in_uiLen, INT_MAX), 0 );
 #if defined(_WIN32)
         auto errorno = WSAGetLastError();
-        if( read == SOCKET_ERROR && (errorno == WSAEINTR || errorno == WSATRY_AGAIN || errorno == WSAEWOULDBLOCK) ) {
+        if( read == SOCKET_ERROR && errorno == WSAEINTR )
+            continue;
+        if( read == SOCKET_ERROR && (errorno == WSATRY_AGAIN || errorno == WSAEWOULDBLOCK) ) {
 #else
-        if( read < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) ) {
+        if( read < 0 && errno == EINTR )
+            continue;
+        if( read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) {
 #endif
             // Only check for timeouts when waiting for data!
-            auto currentTime = steady_clock::now();
-            if( duration_cast<milliseconds>(currentTime-startTime).count() > (std::int64_t)m_maxWaitMillisec ) {
+            auto err = this->waitForSocket( false, in_deadline );
+            if( err == FTSC_ERR::TIMEOUT ) {
                 netlog( "Dropping due to timeout (allowed " + toString( m_maxWaitMillisec ) + " ms)!" );
-                return FTSC_ERR::OK;
+            }
+            if( err != FTSC_ERR::OK ) {
+                return err;
             }
             continue;
         }
@@ -367,9 +504,81 @@ FTSC_ERR FTS::TraditionalConnection::get_lowlevel(void *out_pBuf, std::size_t in
             return FTSC_ERR::RECEIVE;
         }
 
-        to_read -= read;
-        buf += read;
-    } while(to_read);
+        out_uiGot = (std::size_t)read;
+        m_ioStats.bytesReceived += out_uiGot;
+#if defined(TCP_QUICKACK)
+        // The kernel falls back to delayed ACKs on its own, so re-arm it.
+        if(m_options.bQuickAck) {
+            int iOn = 1;
+            setsockopt(m_sock, IPPROTO_TCP, TCP_QUICKACK, &iOn, sizeof(iOn));
+        }
+#endif
+        return FTSC_ERR::OK;
+    }
+}
+
+/// Receives as much as fits into the receive buffer, with one recv.
+/**
+ * \param in_deadline When to give up waiting for data.
+ *
+ * \return If successful:  OK, at least one byte has been added to the buffer.
+ * \return If failed:      Error Code
+ *
+ * \internal This method is only for internal use!
+ */
+FTSC_ERR FTS::TraditionalConnection::fillReceiveBuffer(Deadline in_deadline)
+{
+    size_t uiFree = 0;
+    int8_t *pFree = m_recvBuf.prepare(uiFree);
+    size_t uiGot = 0;
+    auto err = this->recvSome(pFree, uiFree, uiGot, in_deadline);
+    m_recvBuf.commit(uiGot);
+    return err;
+}
+
+/// lowlevel data receiving method.
+/** This tries to receive some amount of data over the network. If it does get
+ *  nothing (or not enough) within the time it has been accorded, it returns.
+ *  The time is for all of the data, not for each recv.\n
+ *  The data is taken from the receive buffer first. Small reads refill the
+ *  buffer with as much as there is to receive, big ones go straight into
+ *  \a out_pBuf.
+ *
+ * \param out_pBuf The (allocated) buffer where to write the data.
+ * \param in_uiLen The length of the buffer to get.
+ *
+ * \return If successful:  OK
+ * \return If failed:      Error Code
+ *
+ * \note The user has to allocate the buffer big enough!
+ * \note On linux, only an exactitude of 1-10 millisecond may be achieved. Anyway, on most PC's
+ *       an exactitude of more the 10ms is nearly never possible.
+ * \internal This method is only for internal use!
+ *
+ * \author Pompei2
+ */
+FTSC_ERR FTS::TraditionalConnection::get_lowlevel(void *out_pBuf, std::size_t in_uiLen)
+{
+    int8_t *buf = (int8_t *)out_pBuf;
+    size_t got = m_recvBuf.read(buf, in_uiLen);
+    auto deadline = deadlineIn(m_maxWaitMillisec);
+
+    while(got < in_uiLen) {
+        size_t to_read = in_uiLen - got;
+        FTSC_ERR err = FTSC_ERR::OK;
+        if(to_read >= m_recvBuf.capacity() / 2) {
+            size_t read = 0;
+            err = this->recvSome(buf + got, to_read, read, deadline);
+            got += read;
+        } else {
+            err = this->fillReceiveBuffer(deadline);
+            got += m_recvBuf.read(buf + got, to_read);
+        }
+
+        if(err != FTSC_ERR::OK) {
+            return err;
+        }
+    }
 
     //netlog2("recv", this, in_uiLen, (const char *)out_pBuf);
 
@@ -393,19 +602,33 @@ FTSC_ERR FTS::TraditionalConnection::get_lowlevel(void *out_pBuf, std::size_t in
  */
 std::string FTS::TraditionalConnection::getLine(const std::string& in_sLineEnding)
 {
-    std::string sLine;
-    uint8_t byte[2] = {0};
-    while(this->get_lowlevel(&byte[0], 1) == FTSC_ERR::OK) {
-        sLine.push_back( byte[0] );
+    size_t searchFrom = 0;
+    auto deadline = deadlineIn(m_maxWaitMillisec);
+    while(true) {
+        std::string_view sBuffered((const char *)m_recvBuf.data(), m_recvBuf.size());
 
         // Got an end of line?
-        auto pos = sLine.rfind( in_sLineEnding );
+        auto pos = sBuffered.find( in_sLineEnding, searchFrom );
         if( pos != std::string::npos ) {
+            std::string sLine( sBuffered.substr( 0, pos + in_sLineEnding.size() ) );
+            m_recvBuf.consume( sLine.size() );
             return sLine;
         }
+
+        // Lines longer than the buffer are returned in pieces.
+        if( m_recvBuf.size() == m_recvBuf.capacity() ) {
+            break;
+        }
+        searchFrom = sBuffered.size() >= in_sLineEnding.size() ? sBuffered.size() - in_sLineEnding.size() + 1 : 0;
+
+        if( this->fillReceiveBuffer(deadline) != FTSC_ERR::OK ) {
+            break;
+        }
     }
 
     // Connection lost or timed out before EOL.
+    std::string sLine( (const char *)m_recvBuf.data(), m_recvBuf.size() );
+    m_recvBuf.clear();
     return sLine;
 }
 
@@ -416,6 +639,8 @@ std::string FTS::TraditionalConnection::getLine(const std::string& in_sLineEndin
  *  at all for a message to come over the net.
  *
  * \param in_bUseQueue Use the queue or just ignore it ?
+ * \param timeOut The milliseconds to wait for the whole packet, 0 to use the
+ *                connection's default.
  *
  * \return If successfull: A pointer to the packet.
  * \return If failed:      NULL
@@ -442,117 +667,102 @@ Packet *FTS::TraditionalConnection::getPacket(bool in_bUseQueue, uint64_t timeOu
             return p;
     }
 
-    int serr = 0;
-    auto useTimeOut = m_maxWaitMillisec;
-    if( timeOut ) {
-        useTimeOut = timeOut;
-    }
-#if defined(_WIN32)
-    fd_set fdr;
-    timeval tv = { 0, (long) useTimeOut * 1000 }; 
-
-    FD_ZERO( &fdr );
-    FD_SET( m_sock, &fdr );
-
-    // Wait an amount of time or wait infinitely
-    if( m_maxWaitMillisec == ((uint64_t) (-1)) )
-        serr = ::select( 1, &fdr, NULL, NULL, NULL );
-    else
-        serr = ::select( 1, &fdr, NULL, NULL, &tv );
-#else
-    do {
-        pollfd pfd;
-        pfd.fd = m_sock;
-        pfd.events = 0 | POLLIN;
-        pfd.revents = 0;
-
-        // Wait an amount of time or wait infinitely
-        if( m_maxWaitMillisec == ((uint64_t) (-1)) )
-            serr = ::poll( &pfd, 1, -1 );
-        else
-            serr = ::poll( &pfd, 1, (int) useTimeOut /*ms*/ );
-    } while( serr == SOCKET_ERROR && errno == EINTR );
-#endif
-
-    if( serr == 0 ) {
-        return nullptr;
+    // One deadline for the whole packet. If it is over in the middle of a
+    // packet, the decoder keeps what came so far for the next call.
+    auto deadline = deadlineIn( timeOut ? timeOut : m_maxWaitMillisec );
+    while( Packet *p = this->getPacketUntil( deadline ) ) {
+        // Responses to asynchronous requests go to their callback.
+        if( !this->dispatchResponse( p ) ) {
+            return p;
+        }
     }
+    return nullptr;
+}
 
-    // First, ignore everything until the "FTSS" identifier.
-    int8_t buf;
-
-    while(true) {
-        // Get the first "F"
-        do {
-            if(FTSC_ERR::OK != this->get_lowlevel(&buf, 1)) {
-                FTSMSGDBG( "Reading F.", 3 );
-                return nullptr;
-            }
-        } while(buf != 'F');
-
-        // Check for the next "T". If it isn't one, restart.
-        if( FTSC_ERR::OK != this->get_lowlevel( &buf, 1 ) ) {
-            FTSMSGDBG( "Reading T.", 3 );
-            return nullptr;
+/// Receives the next packet.
+/**
+ * \param in_deadline When to give up waiting.
+ *
+ * \return If successfull: A pointer to the packet.
+ * \return If failed:      NULL
+ */
+Packet *FTS::TraditionalConnection::getPacketUntil(Deadline in_deadline)
+{
+    // Cut the received bytes into packets, receiving more until there is one.
+    while(m_bConnected) {
+        PacketView frame;
+        auto used = m_decoder.decode( m_recvBuf.data(), m_recvBuf.size(), frame );
+        if( frame.isValid() ) {
+            Packet *p = frame.toPacket().release();
+            m_recvBuf.consume( used );
+            FTSMSGDBG("Recv packet with ID 0x{1}, payload len: {2}", 5, toString(p->getType(), -1, ' ', std::ios::hex), toString(p->getPayloadLen()));
+            addRecvPacketStat(p);
+            return p;
         }
+        m_recvBuf.consume( used );
 
-        if(buf != 'T')
-            continue;
-
-        // Check for the next "S". If it isn't one, restart.
-        if( FTSC_ERR::OK != this->get_lowlevel( &buf, 1 ) ) {
-            FTSMSGDBG( "Reading S1.", 3 );
+        // Don't burn time on a counterpart that only sends garbage.
+        if( m_decoder.isCorrupt() ) {
+            FTSMSG( "Net: skipped more than {1} bytes without a valid packet, dropping the connection.", MsgType::Error, toString( D_FRAME_MAX_SKIP ) );
+            this->disconnect();
             return nullptr;
         }
 
-        if(buf != 'S')
-            continue;
-
-        // Check for the next "S". If it isn't one, restart.
-        if( FTSC_ERR::OK != this->get_lowlevel( &buf, 1 ) ) {
-            FTSMSGDBG( "Reading S2.", 3 );
+        if( m_recvBuf.empty() && FTSC_ERR::OK != this->fillReceiveBuffer( in_deadline ) ) {
+            FTSMSGDBG( m_decoder.isInFrame() ? "Reading packet failed." : "Reading header failed.", 3 );
             return nullptr;
         }
-
-        if(buf != 'S')
-            continue;
-        break;
     }
 
-    // We already got the "FTSS" header, now get the rest of the header.
-    Packet *p = new Packet(DSRV_MSG_NULL);
-    if( FTSC_ERR::OK != this->get_lowlevel( &p->m_pData[4], sizeof( fts_packet_hdr_t ) - 4 ) ) {
-        FTSMSGDBG( "Reading header 2nd part failed.", 3);
-        delete p;
-        return nullptr;
-    }
+    return nullptr;
+}
 
-    // Now, prepare to get the packet's data.
-    if( p->getPayloadLen() <= 0 ) {
-        FTSMSG( "Net: the length of the packet is incorrect: {1}", MsgType::Error, toString(p->getPayloadLen()) );
-        delete p;
-        return nullptr;
+/// Receives the next packet, if it can be had without waiting.
+/** This is how event loops receive: when the socket is readable, they call
+ *  this until it returns NULL. Responses to asynchronous requests are handed
+ *  to their callback on the way. The queue is not looked at.
+ *
+ * \return If there is a packet: A pointer to the packet.
+ * \return Else:                  NULL, check isConnected to tell whether the
+ *                                connection has been lost.
+ */
+Packet *FTS::TraditionalConnection::getPacketIfReady()
+{
+    // A deadline in the past fails every wait right away: this parses what
+    // has been received before and does one recv at most.
+    while( Packet *p = this->getPacketUntil( Deadline::min() ) ) {
+        if( !this->dispatchResponse( p ) ) {
+            return p;
+        }
     }
+    return nullptr;
+}
 
-    p->realloc(p->getTotalLen());
-    // And get it.
-    if( FTSC_ERR::OK != this->get_lowlevel( p->getPayloadPtr(), p->getPayloadLen() ) ) {
-        FTSMSGDBG( "Reading payload failed.", 3 );
-        delete p;
-        return nullptr;
+/// Receives until all asynchronous requests got their response, see Connection::processResponses.
+std::size_t FTS::TraditionalConnection::processResponses( std::uint64_t in_ulMaxWaitMillisec )
+{
+    // The requests may still wait in the output buffer.
+    if( m_nPendingRequests == 0 || this->flushSendBuffer() != FTSC_ERR::OK ) {
+        return m_nPendingRequests;
     }
 
-    // All is good, check the package ID.
-    if(p->isValid()) {
-        FTSMSGDBG("Recv packet with ID 0x{1}, payload len: {2}", 5, toString(p->getType(), -1, ' ', std::ios::hex), toString(p->getPayloadLen()));
-        addRecvPacketStat(p);
-        return p;
+    auto deadline = deadlineIn( in_ulMaxWaitMillisec );
+    while( m_nPendingRequests > 0 ) {
+        // Leave the rest in the socket, so TCP blocks the counterpart.
+        if( this->isReceiveBlocked() ) {
+            break;
+        }
+
+        Packet *p = this->getPacketUntil( deadline );
+        if( p == nullptr ) {
+            break;
+        }
+        if( !this->dispatchResponse( p ) ) {
+            this->queuePacket( p );
+        }
     }
 
-    // Invalid packet received.
-    FTSMSG("Net: an invalid packet has been received: {1}", MsgType::Error, "No FTSS Header/Invalid request");
-    delete p;
-    return nullptr;
+    return m_nPendingRequests;
 }
 
 /// Waits for and then receives any packet.
@@ -594,7 +804,9 @@ Packet *FTS::TraditionalConnection::waitForThenGetPacket(bool in_bUseQueue)
  * \note The user has to free the returned value !
  * \note On linux, only an exactitude of 1-10 millisecond may be achieved.
  *       Anyway, on most PC's an exactitude of more the 10ms is nearly never possible.
- * \note If the queue is full, the first messages put in it are dropped!
+ * \note If the queue is full, the overflow policy decides what is dropped,
+ *       see setQueueCapacity. With QueueOverflow::BlockSender this rather
+ *       fails until packets are taken out of the queue.
  *
  * \author Pompei2
  */
@@ -611,6 +823,12 @@ Packet *FTS::TraditionalConnection::waitForThenGetPacketWithReq(master_request_t
 
     // Nothing in the queue, wait for a message.
     do {
+        // Leave the rest in the socket, so TCP blocks the counterpart.
+        if( this->isReceiveBlocked() ) {
+            FTSMSGDBG("Queue full, not receiving while waiting for ID 0x{1}", 5, toString(in_req, -1, ' ', std::ios::hex));
+            return nullptr;
+        }
+
         // We don't want recv to handle the queue as we would again add
         // messages to the queue that would cause infinite recursion.
         p = this->getPacket(false);
@@ -653,24 +871,40 @@ FTSC_ERR FTS::TraditionalConnection::send( const void *in_pData, std::size_t in_
 
     errno = 0;
 
+    // Keep the order of the data.
+    auto err = this->flushSendBuffer();
+    if(err != FTSC_ERR::OK)
+        return err;
+
     size_t uiToSend = in_uiLen;
     const int8_t *buf = (const int8_t *)in_pData;
+    auto deadline = deadlineIn(m_maxWaitMillisec);
 
     do {
+        ++m_ioStats.sendCalls;
 #if defined(_WIN32)
         auto iSent = ::send(m_sock, (const char *)buf, (int)uiToSend, 0);
-        if(iSent == SOCKET_ERROR && (WSAGetLastError() == WSAEINTR ||
-                                     WSAGetLastError() == WSATRY_AGAIN ||
-                                     WSAGetLastError() == WSAEWOULDBLOCK))
+        if(iSent == SOCKET_ERROR && WSAGetLastError() == WSAEINTR)
+            continue;
+        if(iSent == SOCKET_ERROR && (WSAGetLastError() == WSATRY_AGAIN ||
+                                     WSAGetLastError() == WSAEWOULDBLOCK)) {
 #else
         auto iSent = ::send(m_sock, buf, (int)uiToSend, 0);
-        if(iSent < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+        if(iSent < 0 && errno == EINTR)
+            continue;
+        if(iSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
 #endif
+            // The socket buffer is full, wait until the counterpart took some.
+            auto err = this->waitForSend(deadline);
+            if(err != FTSC_ERR::OK)
+                return err;
             continue;
+        }
         if(iSent < 0) {
             FTSMSG("Net: could not send data: {1} ({2})", MsgType::Error, strerror(errno), toString(errno));
             return FTSC_ERR::SEND;
         }
+        m_ioStats.bytesSent += iSent;
         uiToSend -= iSent;
         buf += iSent;
     } while(uiToSend > 0);
@@ -701,7 +935,203 @@ FTSC_ERR FTS::TraditionalConnection::send( Packet * in_pPacket )
     FTSMSGDBG("Sending packet with ID 0x{1}, payload len: {2}", 5, toString(in_pPacket->getType(), -1, ' ', std::ios::hex), toString(in_pPacket->getPayloadLen()));
     addSendPacketStat(in_pPacket);
 
-    return this->send( in_pPacket->m_pData, in_pPacket->getTotalLen() );
+    // The first vector is left for the packets collected before, see sendFrame.
+    IOVEC vecs[2];
+    setIoVec( vecs[1], in_pPacket->m_pData, in_pPacket->getTotalLen() );
+    return this->sendFrame( vecs, 2, in_pPacket->getTotalLen() );
+}
+
+/// Sends a packet made of a header and several payload fragments.
+/** This builds the header for the fragments and hands it to the kernel
+ *  together with the fragments in one go (like writev does), so big buffers
+ *  can be sent without concatenating them into a Packet first.
+ *
+ * \param in_req The request ID of the packet (DSRV_MSG_XXX).
+ * \param in_pFragments The payload fragments, in order.
+ * \param in_nFragments The number of fragments.
+ *
+ * \return If successful: OK
+ * \return If failed:     Error code
+ */
+FTSC_ERR FTS::TraditionalConnection::sendv( master_request_t in_req, const PacketFragment *in_pFragments, std::size_t in_nFragments )
+{
+    if( !m_bConnected )
+        return FTSC_ERR::NOT_CONNECTED;
+
+    if( in_pFragments == nullptr && in_nFragments != 0 )
+        return FTSC_ERR::INVALID_INPUT;
+
+    uint64_t uiPayloadLen = 0;
+    for( size_t i = 0; i < in_nFragments; ++i ) {
+        uiPayloadLen += in_pFragments[i].uiLen;
+    }
+    if( uiPayloadLen > UINT32_MAX )
+        return FTSC_ERR::INVALID_INPUT;
+
+    fts_packet_hdr_t hdr;
+    fillPacketHeader( &hdr, in_req );
+    hdr.data_len = (uint32_t)uiPayloadLen;
+
+    // Most packets are made of a few fragments only, don't allocate for them.
+    // The first vector is left for the packets collected before, see sendFrame.
+    IOVEC stackVecs[16];
+    std::vector<IOVEC> heapVecs;
+    IOVEC *pVecs = stackVecs;
+    if( in_nFragments + 2 > sizeof( stackVecs ) / sizeof( stackVecs[0] ) ) {
+        heapVecs.resize( in_nFragments + 2 );
+        pVecs = heapVecs.data();
+    }
+
+    size_t nVecs = 1;
+    setIoVec( pVecs[nVecs++], &hdr, sizeof( hdr ) );
+    for( size_t i = 0; i < in_nFragments; ++i ) {
+        if( in_pFragments[i].uiLen > 0 ) {
+            setIoVec( pVecs[nVecs++], in_pFragments[i].pData, in_pFragments[i].uiLen );
+        }
+    }
+
+    FTSMSGDBG("Sending packet with ID 0x{1}, payload len: {2} in {3} fragments", 5, toString(in_req, -1, ' ', std::ios::hex), toString(uiPayloadLen), toString(nVecs - 2));
+    addSendPacketStat(in_req);
+
+    return this->sendFrame( pVecs, nVecs, sizeof( hdr ) + (size_t)uiPayloadLen );
+}
+
+/// Starts collecting the packets sent, see Connection::cork.
+void FTS::TraditionalConnection::cork()
+{
+    m_bCorked = true;
+}
+
+/// Sends the collected packets with one system call and stops collecting.
+/**
+ * \return If successful: OK
+ * \return If failed:     Error code
+ */
+FTSC_ERR FTS::TraditionalConnection::flush()
+{
+    m_bCorked = false;
+    return this->flushSendBuffer();
+}
+
+/// Sends or collects one frame.
+/** If the connection isn't corked, the frame is sent right away. Else it is
+ *  copied behind the collected packets, unless that reaches the flush
+ *  threshold: then the collected packets and the frame are sent together
+ *  with one system call.
+ *
+ * \param io_pVecs The buffers of the frame, starting at index 1. The first
+ *                 vector is free and is used for the collected packets.
+ * \param in_nVecs The number of vectors, the free one included.
+ * \param in_uiLen The length of the frame.
+ *
+ * \return If successful: OK
+ * \return If failed:     Error code
+ */
+FTSC_ERR FTS::TraditionalConnection::sendFrame( IOVEC *io_pVecs, std::size_t in_nVecs, std::size_t in_uiLen )
+{
+    if( !m_bCorked && m_sendBuf.empty() ) {
+        return this->send( io_pVecs + 1, in_nVecs - 1 );
+    }
+
+    if( m_bCorked && m_sendBuf.size() + in_uiLen < m_uiFlushThreshold ) {
+        for( size_t i = 1; i < in_nVecs; ++i ) {
+            auto p = (const int8_t *)ioVecData( io_pVecs[i] );
+            m_sendBuf.insert( m_sendBuf.end(), p, p + ioVecLen( io_pVecs[i] ) );
+        }
+        return FTSC_ERR::OK;
+    }
+
+    setIoVec( io_pVecs[0], m_sendBuf.data(), m_sendBuf.size() );
+    auto err = this->send( io_pVecs, in_nVecs );
+    m_sendBuf.clear();
+    return err;
+}
+
+/// Sends the packets collected while corked, if there are any.
+/**
+ * \return If successful: OK
+ * \return If failed:     Error code
+ */
+FTSC_ERR FTS::TraditionalConnection::flushSendBuffer()
+{
+    if( m_sendBuf.empty() ) {
+        return FTSC_ERR::OK;
+    }
+
+    IOVEC vec;
+    setIoVec( vec, m_sendBuf.data(), m_sendBuf.size() );
+    auto err = this->send( &vec, 1 );
+    m_sendBuf.clear();
+    return err;
+}
+
+/// Sends the data of several buffers.
+/** This sends the buffers, in order, to the pc this connection is with. The
+ *  kernel gets as many buffers at once as it takes.
+ *
+ * \param io_pVecs The buffers to send. They are modified while sending.
+ * \param in_nVecs The number of buffers.
+ *
+ * \return If successful: OK
+ * \return If failed:     Error code
+ */
+FTSC_ERR FTS::TraditionalConnection::send( IOVEC *io_pVecs, std::size_t in_nVecs )
+{
+    if(!m_bConnected)
+        return FTSC_ERR::NOT_CONNECTED;
+
+    auto deadline = deadlineIn(m_maxWaitMillisec);
+    while( in_nVecs > 0 ) {
+        ++m_ioStats.sendCalls;
+#if defined(_WIN32)
+        DWORD dwSent = 0;
+        int iRet = ::WSASend( m_sock, io_pVecs, (DWORD)std::min<size_t>( in_nVecs, IOV_MAX ), &dwSent, 0, NULL, NULL );
+        if(iRet == SOCKET_ERROR && WSAGetLastError() == WSAEINTR)
+            continue;
+        if(iRet == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK) {
+            auto err = this->waitForSend(deadline);
+            if(err != FTSC_ERR::OK)
+                return err;
+            continue;
+        }
+        if(iRet == SOCKET_ERROR) {
+            FTSMSG("Net: could not send data: {1}", MsgType::Error, toString(WSAGetLastError()));
+            return FTSC_ERR::SEND;
+        }
+        size_t uiSent = dwSent;
+#else
+        msghdr msg;
+        memset( &msg, 0, sizeof( msg ) );
+        msg.msg_iov = io_pVecs;
+        msg.msg_iovlen = std::min<size_t>( in_nVecs, IOV_MAX );
+        auto iSent = ::sendmsg( m_sock, &msg, 0 );
+        if(iSent < 0 && errno == EINTR)
+            continue;
+        if(iSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            auto err = this->waitForSend(deadline);
+            if(err != FTSC_ERR::OK)
+                return err;
+            continue;
+        }
+        if(iSent < 0) {
+            FTSMSG("Net: could not send data: {1} ({2})", MsgType::Error, strerror(errno), toString(errno));
+            return FTSC_ERR::SEND;
+        }
+        size_t uiSent = (size_t)iSent;
+#endif
+        m_ioStats.bytesSent += uiSent;
+        // Skip what has been sent, the kernel may have taken only a part.
+        while( in_nVecs > 0 && uiSent >= ioVecLen( io_pVecs[0] ) ) {
+            uiSent -= ioVecLen( io_pVecs[0] );
+            ++io_pVecs;
+            --in_nVecs;
+        }
+        if( in_nVecs > 0 && uiSent > 0 ) {
+            setIoVec( io_pVecs[0], (const int8_t *)ioVecData( io_pVecs[0] ) + uiSent, ioVecLen( io_pVecs[0] ) - uiSent );
+        }
+    }
+
+    return FTSC_ERR::OK;
 }
 
 /*! The request packet is send to the master server. The function waits until the whole
@@ -719,22 +1149,72 @@ FTSC_ERR FTS::TraditionalConnection::send( Packet * in_pPacket )
  * @note Adapted by Pompei2.
  */
 FTSC_ERR FTS::TraditionalConnection::mreq(Packet *out_pPacket)
+{
+    PacketPtr pRsp;
+    auto err = this->sendThenWaitForResponse( out_pPacket, pRsp );
+    if( err != FTSC_ERR::OK ) {
+        return err;
+    }
+
+    // Transfer the receive buffer to the in packet
+    out_pPacket->transferData( pRsp.get() );
+
+    out_pPacket->rewind();
+    return FTSC_ERR::OK;
+}
+
+/*! The request packet is send to the master server and replaced by the response.
+ * Other than mreq(Packet*), no data is copied: the handle simply takes over the
+ * response packet and the request packet is freed.
+ *
+ * @param[in,out] io_pPacket The packet to send. Will be replaced by the response.
+ *
+ * @return If successful: OK
+ * @return If failed:     Error code, \a io_pPacket is left untouched.
+ */
+FTSC_ERR FTS::TraditionalConnection::mreq(PacketPtr& io_pPacket)
+{
+    PacketPtr pRsp;
+    auto err = this->sendThenWaitForResponse( io_pPacket.get(), pRsp );
+    if( err != FTSC_ERR::OK ) {
+        return err;
+    }
+
+    io_pPacket = std::move( pRsp );
+    io_pPacket->rewind();
+    return FTSC_ERR::OK;
+}
+
+/*! Sends the request and waits for the response with the same request ID.
+ *
+ * @param[in]  in_pPacket    The packet to send.
+ * @param[out] out_pResponse The response, if successful.
+ *
+ * @return If successful: OK
+ * @return If failed:     Error code 
+ */
+FTSC_ERR FTS::TraditionalConnection::sendThenWaitForResponse(Packet *in_pPacket, PacketPtr& out_pResponse)
 {
     if(!m_bConnected) {
         return FTSC_ERR::NOT_CONNECTED;
     }
 
-    master_request_t req = out_pPacket->getType();
+    if( in_pPacket == nullptr ) {
+        return FTSC_ERR::INVALID_INPUT;
+    }
+
+    master_request_t req = in_pPacket->getType();
     if(req == DSRV_MSG_NULL || req == DSRV_MSG_NONE || req > DSRV_MSG_MAX ) {
         return FTSC_ERR::WRONG_REQ;
     }
 
-    if( this->send( out_pPacket ) != FTSC_ERR::OK ) {
+    // The request must go out even if the connection is corked.
+    if( this->send( in_pPacket ) != FTSC_ERR::OK || this->flushSendBuffer() != FTSC_ERR::OK ) {
         FTSMSG( "Net: could not send data: {1} ({2})", MsgType::Error, strerror( errno ), toString(errno) );
         return FTSC_ERR::SEND;
     }
 
-    Packet *p = this->waitForThenGetPacketWithReq(req);
+    PacketPtr p( this->waitForThenGetPacketWithReq(req) );
     if( p == nullptr ) {
         return FTSC_ERR::RECEIVE;
     }
@@ -742,17 +1222,10 @@ FTSC_ERR FTS::TraditionalConnection::mreq(Packet *out_pPacket)
     if(p->getType() != req) {
         master_request_t id = p->getType();
         FTSMSG("Net: an invalid packet has been received: {1}", MsgType::Error, "got id "+toString(id)+", wanted "+toString(req));
-        delete p;
         return FTSC_ERR::WRONG_RSP;
     }
 
-    // Transfer the receive buffer to the in packet
-    out_pPacket->transferData( p );
-    
-    // delete the interim packet
-    delete p;
-
-    out_pPacket->rewind();
+    out_pResponse = std::move( p );
     return FTSC_ERR::OK;
 }
 
@@ -791,7 +1264,8 @@ int FTS::TraditionalConnection::setSocketBlocking( SOCKET in_socket, bool in_bBl
             return -1;
         }
 
-        if( fcntl( in_socket, F_SETFL, flags | O_NONBLOCK ) < 0 ) {
+        // Accepted sockets may be non-blocking already (accept4).
+        if( (flags & O_NONBLOCK) == 0 && fcntl( in_socket, F_SETFL, flags | O_NONBLOCK ) < 0 ) {
             FTSMSG( "Net: error setting fcntl: {1} ({2})", MsgType::Error, strerror( errno ), toString( errno ) );
             return -1;
         }
@@ -800,6 +1274,69 @@ int FTS::TraditionalConnection::setSocketBlocking( SOCKET in_socket, bool in_bBl
 #endif
 }
 
+/// Sets one integer socket option, warning if it can't be set.
+static int setIntSocketOption( SOCKET in_socket, int in_level, int in_name, int in_value, const char *in_pszName )
+{
+    if( setsockopt( in_socket, in_level, in_name, (const char *)&in_value, sizeof( in_value ) ) != 0 ) {
+        FTSMSG( "Net: could not set {1} to {2}: {3} ({4})", MsgType::Warning, in_pszName, toString( in_value ), strerror( errno ), toString( errno ) );
+        return -1;
+    }
+    return 0;
+}
+
+/*! Tunes a socket, see ConnectionOptions. Options the system doesn't
+*   know are skipped, options that can't be set are logged and skipped.
+*
+* @param[in] in_socket      socket to tune
+* @param[in] in_options     the options to set
+*
+* @return 0 on success ; -1 if at least one option could not be set.
+*/
+int FTS::TraditionalConnection::applySocketOptions( SOCKET in_socket, const ConnectionOptions &in_options )
+{
+    int iRet = 0;
+    if( in_options.bNoDelay )
+        iRet |= setIntSocketOption( in_socket, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY" );
+    if( in_options.iSendBufSize > 0 )
+        iRet |= setIntSocketOption( in_socket, SOL_SOCKET, SO_SNDBUF, in_options.iSendBufSize, "SO_SNDBUF" );
+    if( in_options.iRecvBufSize > 0 )
+        iRet |= setIntSocketOption( in_socket, SOL_SOCKET, SO_RCVBUF, in_options.iRecvBufSize, "SO_RCVBUF" );
+
+    if( in_options.bKeepAlive ) {
+        iRet |= setIntSocketOption( in_socket, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE" );
+#if defined(TCP_KEEPIDLE)
+        if( in_options.iKeepAliveIdleSec > 0 )
+            iRet |= setIntSocketOption( in_socket, IPPROTO_TCP, TCP_KEEPIDLE, in_options.iKeepAliveIdleSec, "TCP_KEEPIDLE" );
+#endif
+#if defined(TCP_KEEPINTVL)
+        if( in_options.iKeepAliveIntervalSec > 0 )
+            iRet |= setIntSocketOption( in_socket, IPPROTO_TCP, TCP_KEEPINTVL, in_options.iKeepAliveIntervalSec, "TCP_KEEPINTVL" );
+#endif
+#if defined(TCP_KEEPCNT)
+        if( in_options.iKeepAliveProbes > 0 )
+            iRet |= setIntSocketOption( in_socket, IPPROTO_TCP, TCP_KEEPCNT, in_options.iKeepAliveProbes, "TCP_KEEPCNT" );
+#endif
+    }
+
+#if defined(TCP_QUICKACK)
+    if( in_options.bQuickAck )
+        iRet |= setIntSocketOption( in_socket, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK" );
+#endif
+#if defined(SO_BUSY_POLL)
+    if( in_options.iBusyPollMicrosec > 0 )
+        iRet |= setIntSocketOption( in_socket, SOL_SOCKET, SO_BUSY_POLL, in_options.iBusyPollMicrosec, "SO_BUSY_POLL" );
+#endif
+#if defined(SO_REUSEPORT)
+    if( in_options.bReusePort )
+        iRet |= setIntSocketOption( in_socket, SOL_SOCKET, SO_REUSEPORT, 1, "SO_REUSEPORT" );
+#endif
+#if defined(SO_INCOMING_CPU)
+    if( in_options.iIncomingCpu >= 0 )
+        iRet |= setIntSocketOption( in_socket, SOL_SOCKET, SO_INCOMING_CPU, in_options.iIncomingCpu, "SO_INCOMING_CPU" );
+#endif
+    return iRet;
+}
+
 /// Gets a file via HTTP.
 /** This sends an HTTP server the request to get a file and then gets that file
  *  from the server.
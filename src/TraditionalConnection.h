@@ -11,17 +11,21 @@
 
 #if defined( _WIN32 )
 #  include <Winsock2.h>
+   using IOVEC = WSABUF;
 #else
 #  include <sys/types.h>
 #  include <sys/socket.h>
 #  include <netinet/in.h>
 #  include <netinet/ip.h>
+#  include <sys/uio.h>
    using SOCKET = int;
+   using IOVEC = struct iovec;
 
 #endif
 
 using SOCKADDR_IN = struct sockaddr_in;
 
+#include <chrono>
 #include <list>
 #include <sstream>
 #include <algorithm>
@@ -33,6 +37,8 @@ using SOCKADDR_IN = struct sockaddr_in;
 
 #include "connection.h"
 #include "packet.h"
+#include "receive_buffer.h"
+#include "frame_decoder.h"
 
 namespace FTS {
 
@@ -47,11 +53,13 @@ namespace FTS {
  **/
 class TraditionalConnection : public Connection {
     friend class OnDemandHTTPConnection;
+    friend class AsyncConnection;
+    friend class Reactor;
     friend FTSC_ERR getHTTPFile( std::vector<uint8_t>& out_data, const std::string &in_sServer, const std::string &in_sPath, std::uint64_t in_ulMaxWaitMillisec );
 
 public:
-    TraditionalConnection(const std::string &in_sName, std::uint16_t in_usPort, std::uint64_t in_ulTimeoutInMillisec);
-    TraditionalConnection(SOCKET in_sock, SOCKADDR_IN in_sa);
+    TraditionalConnection(const std::string &in_sName, std::uint16_t in_usPort, std::uint64_t in_ulTimeoutInMillisec, const ConnectionOptions &in_options = ConnectionOptions());
+    TraditionalConnection(SOCKET in_sock, SOCKADDR_IN in_sa, const ConnectionOptions &in_options = ConnectionOptions());
     virtual ~TraditionalConnection();
 
     eConnectionType getType() const { return eConnectionType::D_CONNECTION_TRADITIONAL; }
@@ -68,21 +76,47 @@ public:
 
     virtual FTSC_ERR send( Packet *in_pPacket );
     virtual FTSC_ERR mreq(Packet *in_pPacket);
+    virtual FTSC_ERR mreq(PacketPtr& io_pPacket);
+    using Connection::sendv;
+    virtual FTSC_ERR sendv(master_request_t in_req, const PacketFragment *in_pFragments, std::size_t in_nFragments);
+    virtual std::size_t processResponses( std::uint64_t in_ulMaxWaitMillisec );
+    Packet *getPacketIfReady();
+    SOCKET getSocket() const { return m_sock; }
+    virtual void cork();
+    virtual FTSC_ERR flush();
     static int setSocketBlocking( SOCKET in_socket, bool in_bBlocking );
+    static int applySocketOptions( SOCKET in_socket, const ConnectionOptions &in_options );
 
 protected:
     bool m_bConnected;              ///< Wether the connection is up or not.
     SOCKET m_sock;                  ///< The connection socket.
     SOCKADDR_IN m_saCounterpart;    ///< This is the address of our counterpart.
+    ConnectionOptions m_options;    ///< The tuning of the socket.
+    ReceiveBuffer m_recvBuf;        ///< The received bytes that haven't been parsed yet.
+    FrameDecoder m_decoder;         ///< Cuts the received bytes into packets.
+    std::vector<std::int8_t> m_sendBuf; ///< The packets collected while corked.
+    bool m_bCorked = false;         ///< Whether packets are collected instead of sent, see cork.
 
     FTSC_ERR connectByName( std::string in_sName, std::uint16_t in_usPort);
     virtual Packet *getPacket(bool in_bUseQueue, uint64_t timeOut = 0);
     virtual FTSC_ERR get_lowlevel(void *out_pBuf, std::size_t in_uiLen);
+
+    /// The point in time an operation on the socket has to be finished.
+    using Deadline = std::chrono::steady_clock::time_point;
+    static Deadline deadlineIn(std::uint64_t in_ulMillisec);
+    FTSC_ERR waitForSocket(bool in_bWrite, Deadline in_deadline);
+    FTSC_ERR waitForSend(Deadline in_deadline);
+    virtual FTSC_ERR recvSome(void *out_pBuf, std::size_t in_uiLen, std::size_t &out_uiGot, Deadline in_deadline);
+    FTSC_ERR fillReceiveBuffer(Deadline in_deadline);
+    Packet *getPacketUntil(Deadline in_deadline);
     virtual std::string getLine(const std::string& in_sLineEnding);
 
     virtual FTSC_ERR send( const void *in_pData, std::size_t in_uiLen );
+    virtual FTSC_ERR send( IOVEC *io_pVecs, std::size_t in_nVecs );
+    FTSC_ERR sendFrame( IOVEC *io_pVecs, std::size_t in_nVecs, std::size_t in_uiLen );
+    FTSC_ERR flushSendBuffer();
+    FTSC_ERR sendThenWaitForResponse( Packet *in_pPacket, PacketPtr& out_pResponse );
 
-private:
     void netlog( const std::string &in_s ); 
     void netlog2( const std::string &in_s, const void* id, size_t in_uiLen, const char *in_pBuf );
 
@@ -0,0 +1,149 @@
+/**
+ * \file byte_order.cpp
+ * \brief This file implements the conversion of integer arrays between
+ *        the host and a wire byte order.
+ **/
+
+#include <cstdint>
+#include <cstring>
+
+#include "byte_order.h"
+
+#if defined(__SSSE3__)
+#  include <tmmintrin.h>
+#  define FTS_BSWAP_SSSE3
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define FTS_BSWAP_SSE2
+#endif
+
+using namespace FTS;
+
+namespace {
+
+inline std::uint16_t bswap( std::uint16_t in ) { return (std::uint16_t) ((in << 8) | (in >> 8)); }
+
+inline std::uint32_t bswap( std::uint32_t in )
+{
+#if defined(__GNUC__)
+    return __builtin_bswap32( in );
+#else
+    return ((in & 0x000000ffu) << 24) | ((in & 0x0000ff00u) << 8) | ((in & 0x00ff0000u) >> 8) | (in >> 24);
+#endif
+}
+
+inline std::uint64_t bswap( std::uint64_t in )
+{
+#if defined(__GNUC__)
+    return __builtin_bswap64( in );
+#else
+    return ((std::uint64_t) bswap( (std::uint32_t) in ) << 32) | bswap( (std::uint32_t) (in >> 32) );
+#endif
+}
+
+/// Swaps the elements the vector kernels leave over at the end.
+template<class T>
+void copySwappedScalar( std::int8_t* out, const std::int8_t* in, std::size_t in_count )
+{
+    for( std::size_t i = 0; i < in_count; ++i ) {
+        T v;
+        memcpy( &v, in + i * sizeof( T ), sizeof( T ) );
+        v = bswap( v );
+        memcpy( out + i * sizeof( T ), &v, sizeof( T ) );
+    }
+}
+
+#if defined(FTS_BSWAP_SSSE3)
+/// One pshufb per 16 bytes, the mask reverses the bytes of each element.
+template<class T>
+std::size_t copySwappedVector( std::int8_t* out, const std::int8_t* in, std::size_t in_count )
+{
+    alignas(16) std::int8_t mask[16];
+    for( int i = 0; i < 16; ++i ) {
+        mask[i] = (std::int8_t) ((i / sizeof( T )) * sizeof( T ) + sizeof( T ) - 1 - i % sizeof( T ));
+    }
+    const __m128i vMask = _mm_load_si128( (const __m128i*) mask );
+
+    const std::size_t perVec = 16 / sizeof( T );
+    std::size_t i = 0;
+    for( ; i + 2 * perVec <= in_count; i += 2 * perVec ) {
+        __m128i a = _mm_loadu_si128( (const __m128i*) (in + i * sizeof( T )) );
+        __m128i b = _mm_loadu_si128( (const __m128i*) (in + i * sizeof( T ) + 16) );
+        _mm_storeu_si128( (__m128i*) (out + i * sizeof( T )), _mm_shuffle_epi8( a, vMask ) );
+        _mm_storeu_si128( (__m128i*) (out + i * sizeof( T ) + 16), _mm_shuffle_epi8( b, vMask ) );
+    }
+    for( ; i + perVec <= in_count; i += perVec ) {
+        __m128i a = _mm_loadu_si128( (const __m128i*) (in + i * sizeof( T )) );
+        _mm_storeu_si128( (__m128i*) (out + i * sizeof( T )), _mm_shuffle_epi8( a, vMask ) );
+    }
+    return i;
+}
+#elif defined(FTS_BSWAP_SSE2)
+/// Swaps the bytes of all 16 bit words.
+inline __m128i swap16( __m128i in )
+{
+    return _mm_or_si128( _mm_slli_epi16( in, 8 ), _mm_srli_epi16( in, 8 ) );
+}
+
+/// Without pshufb: swap the 16 bit words inside the element, then the
+/// bytes inside the words.
+template<class T>
+inline __m128i swapVec( __m128i in )
+{
+    if( sizeof( T ) == 4 ) {
+        in = _mm_shufflelo_epi16( in, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+        in = _mm_shufflehi_epi16( in, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+    } else if( sizeof( T ) == 8 ) {
+        in = _mm_shufflelo_epi16( in, _MM_SHUFFLE( 0, 1, 2, 3 ) );
+        in = _mm_shufflehi_epi16( in, _MM_SHUFFLE( 0, 1, 2, 3 ) );
+    }
+    return swap16( in );
+}
+
+template<class T>
+std::size_t copySwappedVector( std::int8_t* out, const std::int8_t* in, std::size_t in_count )
+{
+    const std::size_t perVec = 16 / sizeof( T );
+    std::size_t i = 0;
+    for( ; i + perVec <= in_count; i += perVec ) {
+        __m128i a = _mm_loadu_si128( (const __m128i*) (in + i * sizeof( T )) );
+        _mm_storeu_si128( (__m128i*) (out + i * sizeof( T )), swapVec<T>( a ) );
+    }
+    return i;
+}
+#else
+template<class T>
+std::size_t copySwappedVector( std::int8_t*, const std::int8_t*, std::size_t )
+{
+    return 0;
+}
+#endif
+
+template<class T>
+void copySwappedT( std::int8_t* out, const std::int8_t* in, std::size_t in_count )
+{
+    std::size_t done = copySwappedVector<T>( out, in, in_count );
+    copySwappedScalar<T>( out + done * sizeof( T ), in + done * sizeof( T ), in_count - done );
+}
+
+}
+
+/** Copies an array of integers, reversing the bytes of each of them.
+ *  Uses SSSE3 or SSE2 when the compiler targets them.
+ *
+ * \param out_pData Where to write the swapped integers, may be unaligned.
+ * \param in_pData The integers to swap, may be unaligned.
+ * \param in_count The number of integers.
+ * \param in_elemSize The size of one integer: 1, 2, 4 or 8 bytes.
+ */
+void FTS::copySwapped( void* out_pData, const void* in_pData, std::size_t in_count, std::size_t in_elemSize )
+{
+    auto out = (std::int8_t*) out_pData;
+    auto in = (const std::int8_t*) in_pData;
+    switch( in_elemSize ) {
+    case 2: copySwappedT<std::uint16_t>( out, in, in_count ); break;
+    case 4: copySwappedT<std::uint32_t>( out, in, in_count ); break;
+    case 8: copySwappedT<std::uint64_t>( out, in, in_count ); break;
+    default: memcpy( out, in, in_count * in_elemSize ); break;
+    }
+}
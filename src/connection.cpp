@@ -14,20 +14,28 @@
 #include <ostream>
 #include <iostream>
 #include <cstring>
+#include <cstdint>
 
 #include "connection.h"
 #include "packet.h"
 #include "Logger.h"
 #include "TraditionalConnection.h"
+#include "uring_connection.h"
 
 
 using namespace FTS;
 
-Connection * FTS::Connection::create( eConnectionType type, const std::string &in_sName, std::uint16_t in_usPort, std::uint64_t in_ulTimeoutInMillisec )
+Connection * FTS::Connection::create( eConnectionType type, const std::string &in_sName, std::uint16_t in_usPort, std::uint64_t in_ulTimeoutInMillisec, const ConnectionOptions &in_options )
 {
     switch( type ) {
         case eConnectionType::D_CONNECTION_TRADITIONAL:
-            return new TraditionalConnection( in_sName, in_usPort, in_ulTimeoutInMillisec );
+            return new TraditionalConnection( in_sName, in_usPort, in_ulTimeoutInMillisec, in_options );
+        case eConnectionType::D_CONNECTION_URING:
+#if defined(FTS_NET_HAVE_URING)
+            return new UringConnection( in_sName, in_usPort, in_ulTimeoutInMillisec, in_options );
+#else
+            return new TraditionalConnection( in_sName, in_usPort, in_ulTimeoutInMillisec, in_options );
+#endif
         default:
             return nullptr;
     }
@@ -35,6 +43,125 @@ Connection * FTS::Connection::create( eConnectionType type, const std::string &i
     return nullptr;
 }
 
+/// Sends a request and replaces it by the response.
+/** Handle flavour of mreq(Packet*). Implementations that can hand over the
+ *  received packet without copying override this.
+ *
+ * \param io_pPacket The packet to send. Will be replaced by the response.
+ *
+ * \return If successful: OK
+ * \return If failed:     Error code
+ */
+FTSC_ERR FTS::Connection::mreq( PacketPtr& io_pPacket )
+{
+    if( io_pPacket == nullptr ) {
+        return FTSC_ERR::INVALID_INPUT;
+    }
+    return this->mreq( io_pPacket.get() );
+}
+
+/// Sends a request without waiting for its response.
+/** The response is handed to \a in_cb as soon as it is received, by
+ *  processResponses or any other call receiving packets. Many requests may be
+ *  outstanding at once, so their round trips overlap. Responses are matched
+ *  by their request id: the first response of an id goes to the oldest
+ *  request of that id.\n
+ *  Together with cork, several requests go out in one system call.
+ *
+ * \param in_pPacket The request to send. It is left untouched.
+ * \param in_cb Gets the response. It is called on the thread receiving it.
+ *
+ * \return If successful: OK, \a in_cb will be called once.
+ * \return If failed:     Error code, \a in_cb won't be called.
+ */
+FTSC_ERR FTS::Connection::mreqAsync( Packet *in_pPacket, ResponseCallback in_cb )
+{
+    if( in_pPacket == nullptr || !in_cb ) {
+        return FTSC_ERR::INVALID_INPUT;
+    }
+
+    master_request_t req = in_pPacket->getType();
+    if( req == DSRV_MSG_NULL || req == DSRV_MSG_NONE || req > DSRV_MSG_MAX ) {
+        return FTSC_ERR::WRONG_REQ;
+    }
+
+    auto err = this->send( in_pPacket );
+    if( err != FTSC_ERR::OK ) {
+        return err;
+    }
+
+    m_pendingRequests[req].push_back( std::move( in_cb ) );
+    ++m_nPendingRequests;
+    return FTSC_ERR::OK;
+}
+
+/// Sends a request without waiting for its response, see mreqAsync.
+/**
+ * \param in_pPacket The request to send. It is left untouched.
+ *
+ * \return The future result, as the callback would get it: OK and the
+ *         response, or why the request failed and an empty handle.
+ *
+ * \note The future is only fulfilled while the connection receives, e.g.
+ *       in processResponses. Waiting for it without doing so blocks forever.
+ */
+std::future<std::pair<FTSC_ERR, PacketPtr>> FTS::Connection::mreqAsync( Packet *in_pPacket )
+{
+    auto pPromise = std::make_shared<std::promise<std::pair<FTSC_ERR, PacketPtr>>>();
+    auto future = pPromise->get_future();
+    auto err = this->mreqAsync( in_pPacket, [pPromise]( FTSC_ERR in_err, PacketPtr in_pResponse ) {
+        pPromise->set_value( std::make_pair( in_err, std::move( in_pResponse ) ) );
+    } );
+    if( err != FTSC_ERR::OK ) {
+        pPromise->set_value( std::make_pair( err, PacketPtr() ) );
+    }
+    return future;
+}
+
+/// Hands a received packet to the oldest asynchronous request of its id.
+/**
+ * \param in_pPacket The received packet.
+ *
+ * \return true if it has been a response and the callback took it over.
+ */
+bool FTS::Connection::dispatchResponse( Packet *in_pPacket )
+{
+    if( m_nPendingRequests == 0 ) {
+        return false;
+    }
+
+    auto i = m_pendingRequests.find( in_pPacket->getType() );
+    if( i == m_pendingRequests.end() || i->second.empty() ) {
+        return false;
+    }
+
+    auto cb = std::move( i->second.front() );
+    i->second.pop_front();
+    --m_nPendingRequests;
+
+    FTSMSGDBG("Dispatching response with ID 0x{1}, payload len: {2}", 5, toString(in_pPacket->getType(), -1, ' ', std::ios::hex), toString(in_pPacket->getPayloadLen()));
+    in_pPacket->rewind();
+    cb( FTSC_ERR::OK, PacketPtr( in_pPacket ) );
+    return true;
+}
+
+/// Calls the callbacks of all outstanding asynchronous requests with an error.
+/**
+ * \param in_err The reason the requests failed.
+ */
+void FTS::Connection::failPendingRequests( FTSC_ERR in_err )
+{
+    // The callbacks may send new requests.
+    auto pending = std::move( m_pendingRequests );
+    m_pendingRequests.clear();
+    m_nPendingRequests = 0;
+    for( auto& req : pending ) {
+        for( auto& cb : req.second ) {
+            cb( in_err, PacketPtr() );
+        }
+    }
+}
+
 /// Retrieves the packet in front of the queue or the first packet with a special ID.
 /** This takes out either the packet that is in front of the message queue (if \a in_req
  *  is DSRV_MSG_NONE) or the first packet whose request id is \a in_req and
@@ -50,46 +177,25 @@ Connection * FTS::Connection::create( eConnectionType type, const std::string &i
  */
 Packet *FTS::Connection::getFirstPacketFromQueue( master_request_t in_req )
 {
-    if( m_lpPacketQueue.empty() ) {
-        return nullptr;
-    }
-
-    // If we found none with that req_id, return NULL.
-    Packet *p = nullptr;
-
-    // Just get the first one ?
-    if( in_req == DSRV_MSG_NONE ) {
-        // Just get the first packet of the queue.
-        p = m_lpPacketQueue.front();
-        m_lpPacketQueue.pop_front();
-    } else {
-        // Search the list for the first packet with the corresponding request id.
-        auto i = std::find_if( std::begin( m_lpPacketQueue ), std::end( m_lpPacketQueue ), [in_req] ( Packet* packet ) {
-            return packet->getType() == in_req ;
-        } );
-
-        if( i != std::end( m_lpPacketQueue ) ) {
-            m_lpPacketQueue.erase( i );
-            p = *i;
-        }
-    }
+    // Just get the first one, or the first one with the corresponding request id.
+    Packet *p = in_req == DSRV_MSG_NONE ? m_packetQueue.pop() : m_packetQueue.pop( in_req );
 
     if( p != nullptr && Logger::DbgLevel() == 5) {
         FTSMSGDBG("Recv packet from queue with ID 0x{1}, payload len: {2}", 4, toString(p->getType(), -1, ' ', std::ios::hex), toString(p->getPayloadLen()));
-        std::string s = "Queue is now: (len:"+toString(m_lpPacketQueue.size())+")";
-        for(auto pPack : m_lpPacketQueue) {
-            s += "(0x" + toString(pPack->getType(), -1, ' ', std::ios::hex) + "," + toString(pPack->getPayloadLen()) + ")";
-        }
-        s += "End.";
-        FTSMSGDBG(s, 4);
+        FTSMSGDBG(this->describeQueue(), 4);
     }
 
     return p;
 }
 
 /// Adds a packet to the queue.
-/** This first adds a packet at the end of the queue, then checks if the queue is
- *  too big. If it is, it drops out the first packet in the front of the queue.
+/** This adds a packet at the end of the queue, if there is room for it: the
+ *  queue must be below its capacity and the packets of this type below their
+ *  limit. If there is no room, the overflow policy decides which packet is
+ *  dropped: the oldest one (of this type, if the type limit is hit) or the
+ *  new one. With QueueOverflow::BlockSender the connection rather stops
+ *  receiving while the queue is at its capacity, only a type limit drops
+ *  the oldest packet of that type.
  *  Also displays debugging messages about what it does.
  *
  * \author Pompei2
@@ -99,37 +205,122 @@ void FTS::Connection::queuePacket( Packet *in_pPacket )
     if( !in_pPacket )
         return;
 
-    m_lpPacketQueue.push_back( in_pPacket );
+    master_request_t req = in_pPacket->getType();
+    auto itLimit = m_queueLimits.find( req );
+    std::size_t uiTypeLimit = itLimit == m_queueLimits.end() ? SIZE_MAX : itLimit->second;
 
-    // Don't make the queue too big.
-    while( m_lpPacketQueue.size() > FTSC_MAX_QUEUE_LEN ) {
-        Packet *pPack = m_lpPacketQueue.front();
-        FTSMSGDBG( "Queue full, dropping packet with ID 0x{1}, payload len: {2}", 5,
-                   toString( pPack->getType(), -1, ' ', std::ios::hex ), toString( pPack->getPayloadLen() ) );
-        m_lpPacketQueue.pop_front();
-        delete pPack;
+    switch( m_queueOverflow ) {
+        case QueueOverflow::DropOldest:
+            // Make room: within the type first, then within the whole queue.
+            while( m_packetQueue.count( req ) > 0 && m_packetQueue.count( req ) >= uiTypeLimit ) {
+                this->dropPacket( m_packetQueue.pop( req ) );
+            }
+            while( !m_packetQueue.empty() && m_packetQueue.size() >= m_uiQueueCapacity ) {
+                this->dropPacket( m_packetQueue.pop() );
+            }
+            // A capacity of 0 keeps nothing at all.
+            if( m_packetQueue.size() >= m_uiQueueCapacity ) {
+                this->dropPacket( in_pPacket );
+                return;
+            }
+            break;
+        case QueueOverflow::DropNewest:
+            if( m_packetQueue.count( req ) >= uiTypeLimit || m_packetQueue.size() >= m_uiQueueCapacity ) {
+                this->dropPacket( in_pPacket );
+                return;
+            }
+            break;
+        case QueueOverflow::BlockSender:
+            // Blocking on a type would hold up the responses behind it.
+            while( m_packetQueue.count( req ) > 0 && m_packetQueue.count( req ) >= uiTypeLimit ) {
+                this->dropPacket( m_packetQueue.pop( req ) );
+            }
+            // Whoever receives checks isReceiveBlocked first and leaves the
+            // rest in the socket, so this never goes beyond the capacity.
+            break;
     }
 
+    m_packetQueue.push( in_pPacket );
+
     if( Logger::DbgLevel() == 5 ) {
 
         FTSMSGDBG( "Queued packet with ID 0x{1}, payload len: {2}", 5,
-                   toString( in_pPacket->getType(), -1, ' ', std::ios::hex ), toString( in_pPacket->getPayloadLen() ) );
-        std::string s = "Queue is now: (len:" + toString( m_lpPacketQueue.size() ) + ")";
-        for( auto pPack : m_lpPacketQueue ) {
-            s += "(0x" + toString( pPack->getType(), -1, ' ', std::ios::hex ) + "," + toString( pPack->getPayloadLen() ) + ")";
+                   toString( req, -1, ' ', std::ios::hex ), toString( in_pPacket->getPayloadLen() ) );
+        FTSMSGDBG( this->describeQueue(), 5 );
+    }
+}
+
+/// Whether the queue has hit its capacity or any of its type limits.
+bool FTS::Connection::isQueueFull() const
+{
+    if( m_packetQueue.size() >= m_uiQueueCapacity ) {
+        return true;
+    }
+    for( const auto& limit : m_queueLimits ) {
+        if( m_packetQueue.count( limit.first ) >= limit.second ) {
+            return true;
         }
-        s += "End.";
-        FTSMSGDBG( s, 5 );
+    }
+    return false;
+}
+
+/// Limits the number of queued packets of one type.
+/** When the limit is hit, the overflow policy of the queue applies, see
+ *  setQueueCapacity. QueueOverflow::BlockSender drops the oldest packet of
+ *  the type, as it only blocks on the capacity. It's e.g. used to keep chat messages from pushing the
+ *  game packets out of the queue.
+ *
+ * \param in_req The request id to limit.
+ * \param in_uiLimit The most packets of that type queued at once, 0 to
+ *                   remove the limit.
+ */
+void FTS::Connection::setQueueLimit( master_request_t in_req, std::size_t in_uiLimit )
+{
+    if( in_uiLimit == 0 ) {
+        m_queueLimits.erase( in_req );
+    } else {
+        m_queueLimits[in_req] = in_uiLimit;
     }
 }
 
+/// Deletes a packet the queue has no room for.
+void FTS::Connection::dropPacket( Packet *in_pPacket )
+{
+    FTSMSGDBG( "Queue full, dropping packet with ID 0x{1}, payload len: {2}", 5,
+               toString( in_pPacket->getType(), -1, ' ', std::ios::hex ), toString( in_pPacket->getPayloadLen() ) );
+    addDropPacketStat( in_pPacket );
+    delete in_pPacket;
+}
+
+/// Lists the type and length of each queued packet, for debugging.
+std::string FTS::Connection::describeQueue() const
+{
+    std::string s = "Queue is now: (len:" + toString( m_packetQueue.size() ) + ")";
+    m_packetQueue.forEach( [&s]( const Packet *pPack ) {
+        s += "(0x" + toString( pPack->getType(), -1, ' ', std::ios::hex ) + "," + toString( pPack->getPayloadLen() ) + ")";
+    } );
+    s += "End.";
+    return s;
+}
+
 void FTS::Connection::addSendPacketStat( Packet * p )
 {
-    ++m_statPackets[p->getType()].second;
+    addSendPacketStat( p->getType() );
+}
+
+void FTS::Connection::addSendPacketStat( master_request_t in_req )
+{
+    ++m_statPackets[in_req].sent;
+    ++m_ioStats.packetsSent;
 }
 
 void FTS::Connection::addRecvPacketStat( Packet * p )
 {
-    ++m_statPackets[p->getType()].first;
+    ++m_statPackets[p->getType()].received;
+    ++m_ioStats.packetsReceived;
 }
 
+void FTS::Connection::addDropPacketStat( Packet * p )
+{
+    ++m_statPackets[p->getType()].dropped;
+}
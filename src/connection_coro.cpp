@@ -0,0 +1,305 @@
+/**
+ * \file connection_coro.cpp
+ * \brief This file implements the C++20 coroutine interface of the
+ *        connections, driven by an EventLoop.
+ **/
+
+#include "connection_coro.h"
+#include "Logger.h"
+#include "TraditionalConnection.h"
+#include "socket_connection_waiter.h"
+
+using namespace FTS;
+
+void FTS::detail::DetachedTask::promise_type::unhandled_exception()
+{
+    FTSMSG( "An exception left a spawned task.", MsgType::Error );
+}
+
+/** Starts watching a connection. It is switched to non-blocking mode, if it
+ *  isn't already.
+ *
+ * \param in_loop The loop to watch the connection with.
+ * \param in_pConnection The connection, this takes over the ownership.
+ */
+FTS::AsyncConnection::AsyncConnection( EventLoop& in_loop, Connection* in_pConnection )
+    : m_loop( in_loop )
+    , m_pConnection( in_pConnection )
+{
+    if( m_pConnection == nullptr || m_pConnection->getType() != Connection::eConnectionType::D_CONNECTION_TRADITIONAL || !m_pConnection->isConnected() ) {
+        FTSMSG( "Net: only connected traditional connections can be awaited.", MsgType::Error );
+        return;
+    }
+
+    m_pTC = static_cast<TraditionalConnection*>( m_pConnection.get() );
+    m_sock = (NativeSocket) m_pTC->getSocket();
+    TraditionalConnection::setSocketBlocking( m_pTC->getSocket(), false );
+    this->watch();
+}
+
+/** Has the loop watch the socket, if it doesn't already.
+ */
+void FTS::AsyncConnection::watch()
+{
+    if( !m_bWatching ) {
+        m_bWatching = m_loop.add( m_sock, EventLoop::Readable, [this]( std::uint32_t ) { this->onReadable(); } );
+    }
+}
+
+/** Stops watching the connection and closes it.
+ */
+FTS::AsyncConnection::~AsyncConnection()
+{
+    if( m_bWatching ) {
+        m_loop.remove( m_sock );
+    }
+}
+
+/** Receives all that came in and hands it to the awaiting coroutines.
+ */
+void FTS::AsyncConnection::onReadable()
+{
+    auto pTC = m_pTC;
+
+    // The responses to requests are handed over by getPacketIfReady.
+    m_bInCallback = true;
+    while( true ) {
+        // Leave the rest in the socket, so TCP blocks the counterpart. The
+        // next receive watches it again.
+        if( m_pReceiver == nullptr && pTC->isReceiveBlocked() ) {
+            m_loop.remove( m_sock );
+            m_bWatching = false;
+            break;
+        }
+
+        Packet *p = pTC->getPacketIfReady();
+        if( p == nullptr ) {
+            break;
+        }
+        if( m_pReceiver ) {
+            m_pReceiver->m_pPacket.reset( p );
+            m_loop.cancelTimer( m_pReceiver->m_timer );
+            m_ready.push_back( m_pReceiver->m_h );
+            m_pReceiver = nullptr;
+        } else {
+            pTC->queuePacket( p );
+        }
+    }
+
+    // Lost connections fail all requests, the receiver has to know too.
+    if( !pTC->isConnected() ) {
+        m_loop.remove( m_sock );
+        m_bWatching = false;
+        if( m_pReceiver ) {
+            m_loop.cancelTimer( m_pReceiver->m_timer );
+            m_ready.push_back( m_pReceiver->m_h );
+            m_pReceiver = nullptr;
+        }
+    }
+    m_bInCallback = false;
+
+    this->resumeReady();
+}
+
+/** Resumes a coroutine now, or when onReadable is done with the connection.
+ *
+ * \param in_h The coroutine to resume.
+ */
+void FTS::AsyncConnection::resumeLater( std::coroutine_handle<> in_h )
+{
+    m_ready.push_back( in_h );
+    if( !m_bInCallback ) {
+        this->resumeReady();
+    }
+}
+
+/** Resumes the coroutines that got what they waited for. This has to be
+ *  the last thing done with the object, as they may destroy it.
+ */
+void FTS::AsyncConnection::resumeReady()
+{
+    auto ready = std::move( m_ready );
+    m_ready.clear();
+    for( auto h : ready ) {
+        h.resume();
+    }
+}
+
+/** Takes a packet that came in before, if there is one.
+ *
+ * \return true if there is no need to wait.
+ */
+bool FTS::AsyncConnection::ReceiveAwaitable::await_ready()
+{
+    auto pTC = m_conn.m_pTC;
+    if( pTC == nullptr ) {
+        return true;
+    }
+
+    m_pPacket.reset( pTC->getFirstPacketFromQueue() );
+    if( m_pPacket != nullptr && pTC->isConnected() && !pTC->isReceiveBlocked() ) {
+        // There is room again, see onReadable.
+        m_conn.watch();
+    }
+    if( m_pPacket == nullptr ) {
+        m_pPacket.reset( pTC->getPacketIfReady() );
+    }
+    return m_pPacket != nullptr || !pTC->isConnected() || m_conn.m_pReceiver != nullptr;
+}
+
+/** Waits for the loop to receive a packet.
+ *
+ * \param in_h The awaiting coroutine.
+ */
+void FTS::AsyncConnection::ReceiveAwaitable::await_suspend( std::coroutine_handle<> in_h )
+{
+    m_h = in_h;
+    m_conn.m_pReceiver = this;
+    // What comes in goes to this receiver, not to a full queue.
+    if( m_conn.m_pConnection->isConnected() ) {
+        m_conn.watch();
+    }
+    if( m_ulMaxWaitMillisec != (std::uint64_t) -1 ) {
+        m_timer = m_conn.m_loop.addTimer( m_ulMaxWaitMillisec, [this] {
+            m_conn.m_pReceiver = nullptr;
+            m_h.resume();
+        } );
+    }
+}
+
+/** Sends the request and waits for the loop to receive the response.
+ *
+ * \param in_h The awaiting coroutine.
+ *
+ * \return false if the request could not be sent, then there is no need to wait.
+ */
+bool FTS::AsyncConnection::RequestAwaitable::await_suspend( std::coroutine_handle<> in_h )
+{
+    auto pTC = m_conn.m_pTC;
+    auto pState = m_pState;
+    if( pTC == nullptr ) {
+        pState->bDone = true;
+        return false;
+    }
+
+    auto pConn = &m_conn;
+    pState->h = in_h;
+
+    // After a time out, the response is still matched to this request, but dropped.
+    auto err = pTC->mreqAsync( &m_request, [pState, pConn]( FTSC_ERR, PacketPtr in_pResponse ) {
+        if( pState->bDone ) {
+            return;
+        }
+        pState->bDone = true;
+        pState->pResponse = std::move( in_pResponse );
+        if( pState->bSuspended ) {
+            pConn->m_loop.cancelTimer( pState->timer );
+            pConn->resumeLater( pState->h );
+        }
+    } );
+
+    // A failed flush disconnects, which fails the request right here.
+    if( err == FTSC_ERR::OK ) {
+        pTC->flushSendBuffer();
+    }
+    if( err != FTSC_ERR::OK || pState->bDone ) {
+        pState->bDone = true;
+        return false;
+    }
+
+    pState->bSuspended = true;
+    if( m_ulMaxWaitMillisec != (std::uint64_t) -1 ) {
+        pState->timer = m_conn.m_loop.addTimer( m_ulMaxWaitMillisec, [pState] {
+            pState->bDone = true;
+            pState->h.resume();
+        } );
+    }
+    return true;
+}
+
+/** Starts watching the listening socket of a waiter.
+ *
+ * \param in_loop The loop to watch the socket with.
+ * \param in_pWaiter The waiter, init must have been called. This takes over the ownership.
+ *                   It has to be of type SOCKET, see the class.
+ */
+FTS::AsyncConnectionWaiter::AsyncConnectionWaiter( EventLoop& in_loop, ConnectionWaiter* in_pWaiter )
+    : m_loop( in_loop )
+    , m_pWaiter( in_pWaiter )
+{
+    // A waiter of another kind has no listening socket to watch, and the
+    // connections of a URING one can't be awaited.
+    m_pSocketWaiter = dynamic_cast<SocketConnectionWaiter*>( m_pWaiter.get() );
+    if( m_pSocketWaiter == nullptr || m_pSocketWaiter->getType() != ConnectionWaiter::ConnectionType::SOCKET ) {
+        FTSMSG( "Net: only connection waiters of type SOCKET can be awaited.", MsgType::Error );
+        m_pSocketWaiter = nullptr;
+        return;
+    }
+
+    m_sock = (NativeSocket) m_pSocketWaiter->getSocket();
+    if( !m_loop.add( m_sock, 0, [this]( std::uint32_t ) { this->onReadable(); } ) ) {
+        m_pSocketWaiter = nullptr;
+    }
+}
+
+/** Stops watching the listening socket and closes it.
+ */
+FTS::AsyncConnectionWaiter::~AsyncConnectionWaiter()
+{
+    if( m_pSocketWaiter ) {
+        m_loop.remove( m_sock );
+    }
+}
+
+/** Accepts the waiting connection and resumes the awaiting coroutine.
+ */
+void FTS::AsyncConnectionWaiter::onReadable()
+{
+    if( m_pAccepter == nullptr ) {
+        return;
+    }
+
+    auto pCon = m_pSocketWaiter->acceptIfAny();
+    if( pCon == nullptr ) {
+        return;
+    }
+
+    // Nobody waits anymore, so don't wake up for the next ones.
+    auto pAccepter = m_pAccepter;
+    m_pAccepter = nullptr;
+    m_loop.modify( m_sock, 0 );
+    m_loop.cancelTimer( pAccepter->m_timer );
+    pAccepter->m_pConnection = pCon;
+    pAccepter->m_h.resume();
+}
+
+/** Accepts a connection that is waiting already.
+ *
+ * \return true if there is no need to wait.
+ */
+bool FTS::AsyncConnectionWaiter::AcceptAwaitable::await_ready()
+{
+    if( m_waiter.m_pAccepter != nullptr || m_waiter.m_pSocketWaiter == nullptr ) {
+        return true;
+    }
+    m_pConnection = m_waiter.m_pSocketWaiter->acceptIfAny();
+    return m_pConnection != nullptr;
+}
+
+/** Waits for the loop to see a connection coming in.
+ *
+ * \param in_h The awaiting coroutine.
+ */
+void FTS::AsyncConnectionWaiter::AcceptAwaitable::await_suspend( std::coroutine_handle<> in_h )
+{
+    m_h = in_h;
+    m_waiter.m_pAccepter = this;
+    m_waiter.m_loop.modify( m_waiter.m_sock, EventLoop::Readable );
+    if( m_ulMaxWaitMillisec != (std::uint64_t) -1 ) {
+        m_timer = m_waiter.m_loop.addTimer( m_ulMaxWaitMillisec, [this] {
+            m_waiter.m_pAccepter = nullptr;
+            m_waiter.m_loop.modify( m_waiter.m_sock, 0 );
+            m_h.resume();
+        } );
+    }
+}
@@ -0,0 +1,103 @@
+/**
+ * \file connection_queue.cpp
+ * \brief This file implements the lock-free queue new connections are handed
+ *        over from one thread to another in.
+ **/
+
+#include "connection_queue.h"
+
+using namespace FTS;
+
+/** Creates an empty queue.
+ *
+ * \param in_uiCapacity The most connections to hold, at least 2. It is
+ *                      rounded up to a power of 2.
+ */
+FTS::ConnectionQueue::ConnectionQueue( std::size_t in_uiCapacity )
+{
+    std::size_t uiSize = 2;
+    while( uiSize < in_uiCapacity ) {
+        uiSize <<= 1;
+    }
+    m_pSlots.reset( new Slot[uiSize] );
+    for( std::size_t i = 0; i < uiSize; ++i ) {
+        m_pSlots[i].seq.store( i, std::memory_order_relaxed );
+        m_pSlots[i].pCon = nullptr;
+    }
+    m_uiMask = uiSize - 1;
+}
+
+/** Deletes the connections still queued. Nobody may push or pop anymore.
+ */
+FTS::ConnectionQueue::~ConnectionQueue()
+{
+    while( Connection *pCon = this->pop() ) {
+        delete pCon;
+    }
+}
+
+/** Appends a connection, from any thread.
+ *
+ * \param in_pCon The connection, the queue owns it if successful.
+ *
+ * \return false if the queue is full (or in_pCon is NULL), the caller keeps
+ *         the connection.
+ */
+bool FTS::ConnectionQueue::push( Connection *in_pCon )
+{
+    if( in_pCon == nullptr ) {
+        return false;
+    }
+
+    std::size_t uiTurn = m_uiTail.load( std::memory_order_relaxed );
+    while( true ) {
+        Slot &slot = m_pSlots[uiTurn & m_uiMask];
+        std::size_t uiSeq = slot.seq.load( std::memory_order_acquire );
+        auto iDiff = (std::ptrdiff_t) uiSeq - (std::ptrdiff_t) uiTurn;
+        if( iDiff == 0 ) {
+            // The slot is free for this turn, claim the turn.
+            if( m_uiTail.compare_exchange_weak( uiTurn, uiTurn + 1, std::memory_order_relaxed ) ) {
+                slot.pCon = in_pCon;
+                slot.seq.store( uiTurn + 1, std::memory_order_release );
+                return true;
+            }
+        } else if( iDiff < 0 ) {
+            // Still filled from the last round: the queue is full.
+            return false;
+        } else {
+            // Another producer took this turn.
+            uiTurn = m_uiTail.load( std::memory_order_relaxed );
+        }
+    }
+}
+
+/** Takes the oldest connection, from any thread.
+ *
+ * \return The connection, the caller owns it. NULL if the queue is empty.
+ */
+Connection *FTS::ConnectionQueue::pop()
+{
+    std::size_t uiTurn = m_uiHead.load( std::memory_order_relaxed );
+    while( true ) {
+        Slot &slot = m_pSlots[uiTurn & m_uiMask];
+        std::size_t uiSeq = slot.seq.load( std::memory_order_acquire );
+        auto iDiff = (std::ptrdiff_t) uiSeq - (std::ptrdiff_t) (uiTurn + 1);
+        if( iDiff == 0 ) {
+            // The slot has been filled for this turn, claim the turn.
+            if( m_uiHead.compare_exchange_weak( uiTurn, uiTurn + 1, std::memory_order_relaxed ) ) {
+                Connection *pCon = slot.pCon;
+                // Free for the producer of the next round.
+                slot.seq.store( uiTurn + m_uiMask + 1, std::memory_order_release );
+                return pCon;
+            }
+        } else if( iDiff < 0 ) {
+            // Not filled yet: the queue is empty.
+            return nullptr;
+        } else {
+            // Another consumer took this turn.
+            uiTurn = m_uiHead.load( std::memory_order_relaxed );
+        }
+    }
+}
+
+ /* EOF */
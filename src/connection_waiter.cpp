@@ -1,11 +1,19 @@
 #include "connection_waiter.h"
 #include "socket_connection_waiter.h"
+#include "uring_connection_waiter.h"
 
 namespace FTS {
 
 FTS::ConnectionWaiter * FTS::ConnectionWaiter::create( ConnectionWaiter::ConnectionType t )
 {
-    return new SocketConnectionWaiter();
+    switch( t ) {
+#if defined(FTS_NET_HAVE_URING)
+        case ConnectionType::URING:
+            return new UringConnectionWaiter();
+#endif
+        default:
+            return new SocketConnectionWaiter();
+    }
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,413 @@
+/**
+ * \file event_loop.cpp
+ * \brief This file implements the loop that waits for many sockets, timers
+ *        and posted functions at once.
+ **/
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include "event_loop.h"
+#include "Logger.h"
+
+#if defined(_WIN32)
+#  include <WinSock2.h>
+#else
+#  include <unistd.h>
+#  include <fcntl.h>
+#  include <poll.h>
+#endif
+#if defined(__linux__)
+#  include <sys/epoll.h>
+#  include <sys/eventfd.h>
+#endif
+
+using namespace FTS;
+
+/// Without a wake descriptor, the loop has to look for posted functions this often.
+#define D_EVENTLOOP_POLL_MS 10
+
+/// The number of events taken from the kernel at once.
+#define D_EVENTLOOP_MAX_EVENTS 256
+
+/** Creates the loop and the descriptor that wakes it up.
+ */
+FTS::EventLoop::EventLoop()
+{
+#if defined(__linux__)
+    m_epoll = epoll_create1( EPOLL_CLOEXEC );
+    m_wakeFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if( m_epoll < 0 || m_wakeFd < 0 ) {
+        FTSMSG( "Net: could not create the event loop: {1} ({2})", MsgType::Error, strerror( errno ), toString( errno ) );
+        return;
+    }
+
+    epoll_event ev;
+    memset( &ev, 0, sizeof( ev ) );
+    ev.events = EPOLLIN;
+    ev.data.u64 = UINT64_MAX;
+    if( epoll_ctl( m_epoll, EPOLL_CTL_ADD, m_wakeFd, &ev ) != 0 ) {
+        FTSMSG( "Net: could not create the event loop: {1} ({2})", MsgType::Error, strerror( errno ), toString( errno ) );
+        return;
+    }
+#elif !defined(_WIN32)
+    int fds[2];
+    if( pipe( fds ) != 0 ) {
+        FTSMSG( "Net: could not create the event loop: {1} ({2})", MsgType::Error, strerror( errno ), toString( errno ) );
+        return;
+    }
+    m_wakeFd = fds[0];
+    m_wakeWriteFd = fds[1];
+    fcntl( m_wakeFd, F_SETFL, fcntl( m_wakeFd, F_GETFL, 0 ) | O_NONBLOCK );
+    fcntl( m_wakeWriteFd, F_SETFL, fcntl( m_wakeWriteFd, F_GETFL, 0 ) | O_NONBLOCK );
+#endif
+    m_bValid = true;
+}
+
+/** Closes the loop. The callbacks that are left are not called.
+ */
+FTS::EventLoop::~EventLoop()
+{
+#if !defined(_WIN32)
+    if( m_epoll >= 0 )
+        close( m_epoll );
+    if( m_wakeFd >= 0 )
+        close( m_wakeFd );
+    if( m_wakeWriteFd >= 0 )
+        close( m_wakeWriteFd );
+#endif
+}
+
+/** Starts watching a socket.
+ *
+ * \param in_sock The socket to watch. It should be non-blocking.
+ * \param in_events What to wait for: Readable, Writable or both.
+ * \param in_cb Is called with what happened. Error is always reported.
+ *
+ * \return false if the socket is watched already or the system refused it.
+ */
+bool FTS::EventLoop::add( NativeSocket in_sock, std::uint32_t in_events, SocketCallback in_cb )
+{
+    if( m_sockets.count( in_sock ) ) {
+        return false;
+    }
+
+    auto pWatch = std::make_shared<Watch>();
+    pWatch->sock = in_sock;
+    pWatch->events = in_events;
+    pWatch->gen = ++m_uiGen;
+    pWatch->cb = std::move( in_cb );
+
+#if defined(__linux__)
+    epoll_event ev;
+    memset( &ev, 0, sizeof( ev ) );
+    ev.events = (in_events & Readable ? (std::uint32_t) EPOLLIN : 0) | (in_events & Writable ? (std::uint32_t) EPOLLOUT : 0);
+    ev.data.u64 = ((std::uint64_t) pWatch->gen << 32) | (std::uint32_t) in_sock;
+    if( epoll_ctl( m_epoll, EPOLL_CTL_ADD, in_sock, &ev ) != 0 ) {
+        FTSMSG( "Net: could not watch the socket {1}: {2} ({3})", MsgType::Error, toString( in_sock ), strerror( errno ), toString( errno ) );
+        return false;
+    }
+#endif
+
+    m_sockets[in_sock] = std::move( pWatch );
+    return true;
+}
+
+/** Changes what to wait for on a watched socket.
+ *
+ * \param in_sock The watched socket.
+ * \param in_events What to wait for: Readable, Writable, both or none.
+ *
+ * \return false if the socket isn't watched or the system refused it.
+ */
+bool FTS::EventLoop::modify( NativeSocket in_sock, std::uint32_t in_events )
+{
+    auto i = m_sockets.find( in_sock );
+    if( i == m_sockets.end() ) {
+        return false;
+    }
+    if( i->second->events == in_events ) {
+        return true;
+    }
+
+#if defined(__linux__)
+    epoll_event ev;
+    memset( &ev, 0, sizeof( ev ) );
+    ev.events = (in_events & Readable ? (std::uint32_t) EPOLLIN : 0) | (in_events & Writable ? (std::uint32_t) EPOLLOUT : 0);
+    ev.data.u64 = ((std::uint64_t) i->second->gen << 32) | (std::uint32_t) in_sock;
+    if( epoll_ctl( m_epoll, EPOLL_CTL_MOD, in_sock, &ev ) != 0 ) {
+        FTSMSG( "Net: could not watch the socket {1}: {2} ({3})", MsgType::Error, toString( in_sock ), strerror( errno ), toString( errno ) );
+        return false;
+    }
+#endif
+
+    i->second->events = in_events;
+    return true;
+}
+
+/** Stops watching a socket. Its callback won't be called anymore, not even
+ *  for events that are already reported. Has to happen before the socket is
+ *  closed.
+ *
+ * \param in_sock The watched socket.
+ */
+void FTS::EventLoop::remove( NativeSocket in_sock )
+{
+    auto i = m_sockets.find( in_sock );
+    if( i == m_sockets.end() ) {
+        return;
+    }
+
+#if defined(__linux__)
+    epoll_ctl( m_epoll, EPOLL_CTL_DEL, in_sock, nullptr );
+#endif
+    m_sockets.erase( i );
+}
+
+/** Calls a function at a given time.
+ *
+ * \param in_when When to call \a in_cb, at the earliest.
+ * \param in_cb The function to call.
+ *
+ * \return The id to cancel the timer with.
+ */
+EventLoop::TimerId FTS::EventLoop::addTimer( Clock::time_point in_when, Callback in_cb )
+{
+    TimerId id = ++m_lastTimerId;
+    m_timers.emplace( std::make_pair( in_when, id ), std::move( in_cb ) );
+    m_timerIds.emplace( id, in_when );
+    return id;
+}
+
+/** Removes a timer that hasn't been called yet.
+ *
+ * \param in_id The id addTimer returned. Unknown or called timers are ignored.
+ */
+void FTS::EventLoop::cancelTimer( TimerId in_id )
+{
+    auto i = m_timerIds.find( in_id );
+    if( i == m_timerIds.end() ) {
+        return;
+    }
+    m_timers.erase( std::make_pair( i->second, in_id ) );
+    m_timerIds.erase( i );
+}
+
+/** Has the loop call a function as soon as possible, on the loop's thread.
+ *  This may be called from any thread.
+ *
+ * \param in_cb The function to call.
+ */
+void FTS::EventLoop::post( Callback in_cb )
+{
+    {
+        std::lock_guard<std::mutex> lock( m_postMtx );
+        m_posted.push_back( std::move( in_cb ) );
+    }
+    this->wake();
+}
+
+/** Makes run() return after the callbacks running right now. This may be
+ *  called from any thread.
+ */
+void FTS::EventLoop::stop()
+{
+    m_bStop = true;
+    this->wake();
+}
+
+/** Makes a waiting loop return, once for all calls done meanwhile. This may
+ *  be called from any thread, e.g. after filling a queue the loop's thread
+ *  looks into whenever runOnce returns.
+ */
+void FTS::EventLoop::wake()
+{
+    if( m_bWakePending.exchange( true ) ) {
+        return;
+    }
+#if defined(__linux__)
+    std::uint64_t one = 1;
+    auto iRet = write( m_wakeFd, &one, sizeof( one ) );
+    (void) iRet;
+#elif !defined(_WIN32)
+    char c = 0;
+    auto iRet = write( m_wakeWriteFd, &c, 1 );
+    (void) iRet;
+#endif
+}
+
+/** Runs the loop until stop() is called.
+ */
+void FTS::EventLoop::run()
+{
+    while( !m_bStop ) {
+        this->runOnce( -1 );
+    }
+    m_bStop = false;
+}
+
+/** Waits until something happens, then calls the callbacks of everything
+ *  that happened: ready sockets, due timers and posted functions.
+ *
+ * \param in_iMaxWaitMillisec How long to wait at most, -1 to wait until
+ *                            something happens, 0 to not wait at all.
+ *
+ * \return The number of callbacks called.
+ */
+std::size_t FTS::EventLoop::runOnce( std::int64_t in_iMaxWaitMillisec )
+{
+    if( !m_bValid ) {
+        return 0;
+    }
+
+    std::size_t nCalled = this->runPosted();
+    int iWaitMs = (int) this->getWaitMillisec( nCalled ? 0 : in_iMaxWaitMillisec );
+
+#if defined(__linux__)
+    epoll_event events[D_EVENTLOOP_MAX_EVENTS];
+    int n = epoll_wait( m_epoll, events, D_EVENTLOOP_MAX_EVENTS, iWaitMs );
+    if( n < 0 && errno != EINTR ) {
+        FTSMSG( "Net: error during epoll_wait: {1} ({2})", MsgType::Error, strerror( errno ), toString( errno ) );
+    }
+
+    for( int i = 0; i < n; ++i ) {
+        if( events[i].data.u64 == UINT64_MAX ) {
+            std::uint64_t val;
+            auto iRet = read( m_wakeFd, &val, sizeof( val ) );
+            (void) iRet;
+            m_bWakePending = false;
+            continue;
+        }
+
+        // The socket may have been removed, even reused, by a callback before.
+        auto sock = (NativeSocket) (std::uint32_t) events[i].data.u64;
+        auto gen = (std::uint32_t) (events[i].data.u64 >> 32);
+        auto w = m_sockets.find( sock );
+        if( w == m_sockets.end() || w->second->gen != gen ) {
+            continue;
+        }
+
+        std::uint32_t what = (events[i].events & EPOLLIN ? (std::uint32_t) Readable : 0)
+                           | (events[i].events & EPOLLOUT ? (std::uint32_t) Writable : 0)
+                           | (events[i].events & (EPOLLERR | EPOLLHUP) ? (std::uint32_t) Error : 0);
+        // Keep the watch alive, the callback may remove it.
+        auto pWatch = w->second;
+        pWatch->cb( what );
+        ++nCalled;
+    }
+#else
+    std::vector<pollfd> pfds;
+    std::vector<std::shared_ptr<Watch>> watches;
+    pfds.reserve( m_sockets.size() + 1 );
+    watches.reserve( m_sockets.size() );
+    for( auto& w : m_sockets ) {
+        pollfd pfd;
+        pfd.fd = w.second->sock;
+        pfd.events = (w.second->events & Readable ? POLLIN : 0) | (w.second->events & Writable ? POLLOUT : 0);
+        pfd.revents = 0;
+        pfds.push_back( pfd );
+        watches.push_back( w.second );
+    }
+#  if defined(_WIN32)
+    // Nothing wakes us up here, so look for posted functions regularly.
+    if( iWaitMs < 0 || iWaitMs > D_EVENTLOOP_POLL_MS )
+        iWaitMs = D_EVENTLOOP_POLL_MS;
+    int n = pfds.empty() ? (Sleep( iWaitMs ), 0) : WSAPoll( pfds.data(), (ULONG) pfds.size(), iWaitMs );
+    m_bWakePending = false;
+#  else
+    pollfd wakePfd;
+    wakePfd.fd = m_wakeFd;
+    wakePfd.events = POLLIN;
+    wakePfd.revents = 0;
+    pfds.push_back( wakePfd );
+    int n = poll( pfds.data(), (nfds_t) pfds.size(), iWaitMs );
+    if( pfds.back().revents & POLLIN ) {
+        char buf[64];
+        while( read( m_wakeFd, buf, sizeof( buf ) ) > 0 ) {
+        }
+        m_bWakePending = false;
+    }
+    pfds.pop_back();
+#  endif
+    if( n < 0 ) {
+        FTSMSG( "Net: error during poll: {1} ({2})", MsgType::Error, strerror( errno ), toString( errno ) );
+    }
+
+    for( std::size_t i = 0; n > 0 && i < watches.size(); ++i ) {
+        if( pfds[i].revents == 0 ) {
+            continue;
+        }
+        // The socket may have been removed, even reused, by a callback before.
+        auto w = m_sockets.find( watches[i]->sock );
+        if( w == m_sockets.end() || w->second != watches[i] ) {
+            continue;
+        }
+        std::uint32_t what = (pfds[i].revents & POLLIN ? (std::uint32_t) Readable : 0)
+                           | (pfds[i].revents & POLLOUT ? (std::uint32_t) Writable : 0)
+                           | (pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL) ? (std::uint32_t) Error : 0);
+        watches[i]->cb( what );
+        ++nCalled;
+    }
+#endif
+
+    nCalled += this->runTimers();
+    nCalled += this->runPosted();
+    return nCalled;
+}
+
+/** Calls the posted functions, also the ones they post.
+ *
+ * \return The number of functions called.
+ */
+std::size_t FTS::EventLoop::runPosted()
+{
+    std::vector<Callback> posted;
+    {
+        std::lock_guard<std::mutex> lock( m_postMtx );
+        posted.swap( m_posted );
+    }
+    for( auto& cb : posted ) {
+        cb();
+    }
+    return posted.size();
+}
+
+/** Calls the timers that are due.
+ *
+ * \return The number of timers called.
+ */
+std::size_t FTS::EventLoop::runTimers()
+{
+    std::size_t n = 0;
+    auto now = Clock::now();
+    while( !m_timers.empty() && m_timers.begin()->first.first <= now ) {
+        auto cb = std::move( m_timers.begin()->second );
+        m_timerIds.erase( m_timers.begin()->first.second );
+        m_timers.erase( m_timers.begin() );
+        cb();
+        ++n;
+    }
+    return n;
+}
+
+/** How long to sleep, so the next timer is called in time.
+ *
+ * \param in_iMaxWaitMillisec The longest wait wanted, -1 for no limit.
+ *
+ * \return The milliseconds to sleep, -1 for no limit.
+ */
+std::int64_t FTS::EventLoop::getWaitMillisec( std::int64_t in_iMaxWaitMillisec ) const
+{
+    using namespace std::chrono;
+
+    std::int64_t iWaitMs = in_iMaxWaitMillisec;
+    if( !m_timers.empty() ) {
+        // Rounded up, so we don't wake up just before the timer.
+        auto left = m_timers.begin()->first.first - Clock::now();
+        std::int64_t iTimerMs = std::max<std::int64_t>( 0, duration_cast<milliseconds>( left + milliseconds( 1 ) - nanoseconds( 1 ) ).count() );
+        iWaitMs = iWaitMs < 0 ? iTimerMs : std::min( iWaitMs, iTimerMs );
+    }
+    return std::min<std::int64_t>( iWaitMs, INT32_MAX );
+}
@@ -0,0 +1,259 @@
+/**
+ * \file frame_decoder.cpp
+ * \brief This file implements the class that cuts a stream of received
+ *        bytes into packets.
+ **/
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "frame_decoder.h"
+#include "Logger.h"
+#include "TextFormatting.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define FTS_FRAME_SSE2
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#  endif
+#endif
+
+using namespace FTS;
+
+/// The buffer for cut frames is freed after a frame that made it grow beyond this.
+static constexpr std::size_t D_FRAME_KEEP_LEN = 65536;
+
+#if defined(FTS_FRAME_SSE2)
+/// The index of the lowest set bit of \a in_mask, which must not be 0.
+static inline unsigned lowestBit( unsigned in_mask )
+{
+#  if defined(_MSC_VER)
+    unsigned long idx = 0;
+    _BitScanForward( &idx, in_mask );
+    return (unsigned) idx;
+#  else
+    return (unsigned) __builtin_ctz( in_mask );
+#  endif
+}
+#endif
+
+/// Finds where the next frame may start.
+/** With SSE2, 16 positions are tested for the whole identifier at once by
+ *  comparing four shifted loads. Only the last few bytes are looked at one
+ *  by one, for an identifier cut by the end of the data.
+ *
+ * \return The offset of the first "FTSS" identifier in \a in_pData, or of the
+ *         start of an identifier cut by the end of the data, or \a in_uiLen
+ *         if there is none.
+ */
+static std::size_t findFrameStart( const std::int8_t* in_pData, std::size_t in_uiLen )
+{
+    std::size_t i = 0;
+#if defined(FTS_FRAME_SSE2)
+    const __m128i vF = _mm_set1_epi8( 'F' );
+    const __m128i vT = _mm_set1_epi8( 'T' );
+    const __m128i vS = _mm_set1_epi8( 'S' );
+    for( ; i + 16 + 3 <= in_uiLen; i += 16 ) {
+        const std::int8_t* p = in_pData + i;
+        __m128i f = _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*) p ), vF );
+        __m128i t = _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*) (p + 1) ), vT );
+        __m128i s1 = _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*) (p + 2) ), vS );
+        __m128i s2 = _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*) (p + 3) ), vS );
+        unsigned mask = (unsigned) _mm_movemask_epi8( _mm_and_si128( _mm_and_si128( f, t ), _mm_and_si128( s1, s2 ) ) );
+        if( mask != 0 ) {
+            return i + lowestBit( mask );
+        }
+    }
+#endif
+
+    const std::int8_t* pEnd = in_pData + in_uiLen;
+    for( const std::int8_t* p = in_pData + i; (p = (const std::int8_t*) memchr( p, 'F', (std::size_t) (pEnd - p) )) != nullptr; ++p ) {
+        if( memcmp( p, "FTSS", std::min<std::size_t>( (std::size_t) (pEnd - p), 4 ) ) == 0 ) {
+            return (std::size_t) (p - in_pData);
+        }
+    }
+    return in_uiLen;
+}
+
+/** Creates a decoder that waits for the start of a frame.
+ *
+ * \param in_uiMaxPayloadLen Frames with a longer payload are dropped.
+ * \param in_uiMaxSkip After skipping or dropping more bytes than this without
+ *                     a valid frame in between, the stream is corrupt.
+ */
+FTS::FrameDecoder::FrameDecoder( std::uint32_t in_uiMaxPayloadLen, std::size_t in_uiMaxSkip )
+    : m_uiMaxPayloadLen( in_uiMaxPayloadLen )
+    , m_uiMaxSkip( in_uiMaxSkip )
+{
+}
+
+/** Forgets about the frame being decoded, e.g. when the connection is
+ *  closed. The counters are kept.
+ */
+void FTS::FrameDecoder::reset()
+{
+    m_partial.clear();
+    m_uiFrameLen = 0;
+    m_bComplete = false;
+    m_uiDiscard = 0;
+    m_uiSkippedInRow = 0;
+}
+
+/** Decodes the next frame of a stream.
+ *
+ * \param in_pData The next bytes of the stream.
+ * \param in_uiLen The number of bytes at \a in_pData.
+ * \param out_frame Is set to the decoded frame, or to an invalid view if the
+ *                  bytes used didn't complete a frame. The view is valid until
+ *                  the next call.
+ *
+ * \return The number of bytes used. It is above 0 if \a in_uiLen is, the
+ *         remaining bytes have to be passed again with the next call.
+ */
+std::size_t FTS::FrameDecoder::decode( const void* in_pData, std::size_t in_uiLen, PacketView& out_frame )
+{
+    out_frame = PacketView();
+
+    // The last frame returned was cut, the view of it isn't used anymore.
+    if( m_bComplete ) {
+        m_bComplete = false;
+        m_uiFrameLen = 0;
+        m_partial.clear();
+        if( m_partial.capacity() > D_FRAME_KEEP_LEN ) {
+            std::vector<std::int8_t>().swap( m_partial );
+        }
+    }
+
+    auto p = (const std::int8_t*) in_pData;
+    if( m_uiDiscard > 0 ) {
+        return this->dropFrame( 0, in_uiLen );
+    }
+
+    if( !m_partial.empty() ) {
+        return this->continueFrame( p, in_uiLen, out_frame );
+    }
+
+    // First, ignore everything until the "FTSS" identifier.
+    auto skip = findFrameStart( p, in_uiLen );
+    if( skip > 0 ) {
+        m_uiSkipped += skip;
+        m_uiSkippedInRow += skip;
+        return skip;
+    }
+
+    // The whole frame is there, return a view of it.
+    std::size_t frameLen = 0;
+    if( in_uiLen >= D_PACKET_HDR_LEN ) {
+        if( !this->checkHeader( p, frameLen ) ) {
+            return this->dropFrame( frameLen, in_uiLen );
+        }
+
+        if( frameLen <= in_uiLen ) {
+            out_frame = PacketView( (master_request_t) p[offsetof( fts_packet_hdr_t, req_id )], p + D_PACKET_HDR_LEN, frameLen - D_PACKET_HDR_LEN );
+            m_uiSkippedInRow = 0;
+            return frameLen;
+        }
+    }
+
+    // The frame is cut by the end of the chunk, keep what there is.
+    m_partial.assign( p, p + in_uiLen );
+    m_uiFrameLen = frameLen;
+    return in_uiLen;
+}
+
+/** Adds the next bytes to a frame that has been cut by the end of a chunk.
+ *
+ * \return The number of bytes used.
+ */
+std::size_t FTS::FrameDecoder::continueFrame( const std::int8_t* in_pData, std::size_t in_uiLen, PacketView& out_frame )
+{
+    std::size_t used = 0;
+    if( m_uiFrameLen == 0 ) {
+        // Complete the header first.
+        auto have = m_partial.size();
+        used = std::min( D_PACKET_HDR_LEN - have, in_uiLen );
+        m_partial.insert( m_partial.end(), in_pData, in_pData + used );
+
+        // What looked like a cut identifier may turn out not to be one. Only
+        // its first byte is an 'F', so none of it can start an identifier.
+        if( memcmp( m_partial.data(), "FTSS", std::min<std::size_t>( m_partial.size(), 4 ) ) != 0 ) {
+            m_uiSkipped += have;
+            m_uiSkippedInRow += have;
+            m_partial.clear();
+            return this->decode( in_pData, in_uiLen, out_frame );
+        }
+
+        if( m_partial.size() < D_PACKET_HDR_LEN ) {
+            return used;
+        }
+
+        std::size_t frameLen = 0;
+        if( !this->checkHeader( m_partial.data(), frameLen ) ) {
+            m_partial.clear();
+            m_uiSkippedInRow += D_PACKET_HDR_LEN;
+            return used + this->dropFrame( frameLen - D_PACKET_HDR_LEN, in_uiLen - used );
+        }
+        m_uiFrameLen = frameLen;
+        m_partial.reserve( frameLen );
+    }
+
+    auto n = std::min( m_uiFrameLen - m_partial.size(), in_uiLen - used );
+    m_partial.insert( m_partial.end(), in_pData + used, in_pData + used + n );
+    used += n;
+
+    if( m_partial.size() == m_uiFrameLen ) {
+        m_bComplete = true;
+        m_uiSkippedInRow = 0;
+        out_frame = PacketView( (master_request_t) m_partial[offsetof( fts_packet_hdr_t, req_id )], m_partial.data() + D_PACKET_HDR_LEN, m_uiFrameLen - D_PACKET_HDR_LEN );
+    }
+    return used;
+}
+
+/** Checks the header of a frame.
+ *
+ * \param in_pHdr The header, starting with the identifier.
+ * \param out_uiLen Is set to the length of the frame, or if it is invalid, to
+ *                  the number of bytes to drop.
+ *
+ * \return Whether the frame is valid.
+ */
+bool FTS::FrameDecoder::checkHeader( const std::int8_t* in_pHdr, std::size_t& out_uiLen )
+{
+    fts_packet_hdr_t hdr;
+    memcpy( &hdr, in_pHdr, sizeof( hdr ) );
+
+    // The length can't be trusted, so only the header is dropped.
+    if( hdr.data_len == 0 || hdr.data_len > m_uiMaxPayloadLen ) {
+        FTSMSG( "Net: the length of the packet is incorrect: {1}", MsgType::Error, toString( hdr.data_len ) );
+        ++m_uiDropped;
+        out_uiLen = D_PACKET_HDR_LEN;
+        return false;
+    }
+
+    out_uiLen = D_PACKET_HDR_LEN + hdr.data_len;
+    if( !isPacketHeaderValid( &hdr ) ) {
+        FTSMSG( "Net: an invalid packet has been received: {1}", MsgType::Error, "No FTSS Header/Invalid request" );
+        ++m_uiDropped;
+        return false;
+    }
+    return true;
+}
+
+/** Skips the bytes of a dropped frame.
+ *
+ * \param in_uiFrameLen The number of bytes to drop, besides those still to
+ *                      be discarded.
+ * \param in_uiLen The number of bytes available.
+ *
+ * \return The number of bytes used, the rest is skipped with the next calls.
+ */
+std::size_t FTS::FrameDecoder::dropFrame( std::size_t in_uiFrameLen, std::size_t in_uiLen )
+{
+    m_uiDiscard += in_uiFrameLen;
+    auto n = std::min( m_uiDiscard, in_uiLen );
+    m_uiDiscard -= n;
+    m_uiSkippedInRow += n;
+    return n;
+}
@@ -0,0 +1,224 @@
+/**
+ * \file multi_reactor.cpp
+ * \brief This file implements the multi-reactor, which serves the connections
+ *        of one port from a reactor per core.
+ **/
+
+#include <algorithm>
+#include <cstring>
+
+#include "multi_reactor.h"
+#include "Logger.h"
+#include "TraditionalConnection.h"
+
+#if defined(_WIN32)
+#  include <windows.h>
+#elif defined(__linux__)
+#  include <pthread.h>
+#  include <sched.h>
+#endif
+
+// Only Linux spreads the connections among the listeners sharing a port,
+// the BSDs hand them all to one of them.
+#if defined(__linux__) && defined(SO_REUSEPORT)
+#  define FTS_NET_REUSEPORT_BALANCES 1
+#endif
+
+using namespace FTS;
+
+/** Pins the calling thread to a core. Failing is logged, the thread runs
+ *  nonetheless.
+ *
+ * \param in_uiCpu The core.
+ */
+static void pinThisThread( unsigned in_uiCpu )
+{
+#if defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO( &cpus );
+    CPU_SET( in_uiCpu, &cpus );
+    int iErr = pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+    if( iErr != 0 ) {
+        FTSMSG( "Net: could not pin the reactor thread to cpu {1}: {2}", MsgType::Warning, toString( in_uiCpu ), strerror( iErr ) );
+    }
+#elif defined(_WIN32)
+    if( SetThreadAffinityMask( GetCurrentThread(), DWORD_PTR( 1 ) << in_uiCpu ) == 0 ) {
+        FTSMSG( "Net: could not pin the reactor thread to cpu {1}: {2}", MsgType::Warning, toString( in_uiCpu ), toString( GetLastError() ) );
+    }
+#else
+    (void) in_uiCpu;
+#endif
+}
+
+/** The cores the process may run on, which may be fewer than the machine
+ *  has, e.g. in a container or under taskset.
+ *
+ * \return The cores, never empty.
+ */
+static std::vector<unsigned> allowedCpus()
+{
+    std::vector<unsigned> cpus;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    if( sched_getaffinity( 0, sizeof( set ), &set ) == 0 ) {
+        for( unsigned i = 0; i < CPU_SETSIZE; ++i ) {
+            if( CPU_ISSET( i, &set ) ) {
+                cpus.push_back( i );
+            }
+        }
+    }
+#elif defined(_WIN32)
+    DWORD_PTR processMask = 0, systemMask = 0;
+    if( GetProcessAffinityMask( GetCurrentProcess(), &processMask, &systemMask ) ) {
+        for( unsigned i = 0; i < sizeof( processMask ) * 8; ++i ) {
+            if( processMask & ( DWORD_PTR( 1 ) << i ) ) {
+                cpus.push_back( i );
+            }
+        }
+    }
+#endif
+    if( cpus.empty() ) {
+        unsigned nCpus = std::max( 1u, std::thread::hardware_concurrency() );
+        for( unsigned i = 0; i < nCpus; ++i ) {
+            cpus.push_back( i );
+        }
+    }
+    return cpus;
+}
+
+/** Creates the reactors, the threads are started with start.
+ *
+ * \param in_nThreads The number of threads, 0 for one per core the process
+ *                    may run on.
+ */
+FTS::MultiReactor::MultiReactor( unsigned in_nThreads )
+    : m_cpus( allowedCpus() )
+{
+    if( in_nThreads == 0 ) {
+        in_nThreads = (unsigned) m_cpus.size();
+    }
+    for( unsigned i = 0; i < in_nThreads; ++i ) {
+        m_reactors.emplace_back( new Reactor() );
+    }
+}
+
+/** Stops the threads, then closes all connections and listeners without
+ *  calling any callback.
+ */
+FTS::MultiReactor::~MultiReactor()
+{
+    this->stop();
+}
+
+/** Starts accepting connections on every reactor. Call it before start.
+ *
+ * \param in_usPort The port to listen on.
+ * \param in_onAccept Gets every new connection on the thread of the reactor
+ *                    it belongs to, e.g. to add it there.
+ * \param in_options The socket options of the new connections.
+ *
+ * \return What ConnectionWaiter::init returns, 0 on success. The port may
+ *         not be shared with a listener outside of this multi-reactor. On
+ *         failure, none of the reactors listens.
+ */
+int FTS::MultiReactor::listen( std::uint16_t in_usPort, AcceptCallback in_onAccept, const ConnectionOptions& in_options )
+{
+    m_onAccept = std::move( in_onAccept );
+
+#if defined(FTS_NET_REUSEPORT_BALANCES)
+    m_bSharingPort = m_reactors.size() > 1;
+#else
+    m_bSharingPort = false;
+#endif
+
+    if( !m_bSharingPort ) {
+        return m_reactors[0]->listen( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ), in_usPort,
+                                      [this]( Connection* in_pCon ) { this->dealOut( in_pCon ); }, in_options );
+    }
+
+    ConnectionOptions listenOptions = in_options;
+    listenOptions.bReusePort = true;
+    for( std::size_t i = 0; i < m_reactors.size(); ++i ) {
+        // The kernel picks the listener whose core received the handshake.
+        listenOptions.iIncomingCpu = m_bPinThreads ? (int) this->getCpu( i ) : -1;
+        Reactor *pReactor = m_reactors[i].get();
+        int iRet = pReactor->listen( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ), in_usPort,
+                                     [this, pReactor]( Connection* in_pCon ) { m_onAccept( *pReactor, in_pCon ); }, listenOptions );
+        if( iRet != 0 ) {
+            // Else the port would stay half open.
+            for( std::size_t j = 0; j < i; ++j ) {
+                m_reactors[j]->stopListening();
+            }
+            return iRet;
+        }
+    }
+    return 0;
+}
+
+/** Starts a thread per reactor, each one serving until stop is called.
+ *  Nothing happens if they are running already.
+ */
+void FTS::MultiReactor::start()
+{
+    if( !m_threads.empty() ) {
+        return;
+    }
+
+    for( std::size_t i = 0; i < m_reactors.size(); ++i ) {
+        Reactor *pReactor = m_reactors[i].get();
+        int iCpu = m_bPinThreads ? (int) this->getCpu( i ) : -1;
+        m_threads.emplace_back( [pReactor, iCpu] {
+            if( iCpu >= 0 ) {
+                pinThisThread( (unsigned) iCpu );
+            }
+            pReactor->run();
+        } );
+    }
+}
+
+/** Stops all reactors and waits for their threads. The connections stay
+ *  with their reactors, start serves them again.
+ */
+void FTS::MultiReactor::stop()
+{
+    for( auto& pReactor : m_reactors ) {
+        pReactor->stop();
+    }
+    for( auto& t : m_threads ) {
+        t.join();
+    }
+    m_threads.clear();
+}
+
+/** The core a reactor's thread runs on.
+ *
+ * \param in_i The reactor.
+ *
+ * \return The core, the reactors go round the allowed cores if there are more.
+ */
+unsigned FTS::MultiReactor::getCpu( std::size_t in_i ) const
+{
+    return m_cpus[in_i % m_cpus.size()];
+}
+
+/** Hands a connection accepted by the first reactor to the reactors in
+ *  turn, when they can't listen each on their own.
+ *
+ * \param in_pCon The new connection.
+ */
+void FTS::MultiReactor::dealOut( Connection* in_pCon )
+{
+    std::size_t i = m_uiNext++ % m_reactors.size();
+    Reactor *pReactor = m_reactors[i].get();
+    if( i == 0 ) {
+        m_onAccept( *pReactor, in_pCon );
+        return;
+    }
+
+    // If the reactor goes away before running it, the connection is freed.
+    auto pHeld = std::make_shared<std::unique_ptr<Connection>>( in_pCon );
+    pReactor->getLoop().post( [this, pReactor, pHeld] { m_onAccept( *pReactor, pHeld->release() ); } );
+}
+
+ /* EOF */
@@ -9,8 +9,10 @@
 #include <algorithm>
 #include <assert.h>
 #include <cstring>
+#include <new>
 
 #include "packet.h"
+#include "packet_buffer_pool.h"
 
 using namespace FTS;
 using namespace std;
@@ -27,7 +29,8 @@ using namespace std;
  */
 FTS::Packet::Packet(master_request_t in_cType)
 {
-    m_pData = new int8_t[D_PACKET_HDR_LEN];
+    m_pData = m_inline;
+    m_uiCapacity = D_PACKET_INLINE_LEN;
     memset(m_pData, 0, D_PACKET_HDR_LEN);
     fillPacketHeader((fts_packet_hdr_t *)m_pData, in_cType);
 
@@ -43,9 +46,9 @@ FTS::Packet::Packet(master_request_t in_cType)
  */
 FTS::Packet::Packet( Packet&& in_packet ) noexcept
 {
-    m_pData = in_packet.m_pData;
+    m_pData = nullptr;
+    takeData( in_packet );
     m_uiCursor = in_packet.m_uiCursor;
-    in_packet.m_pData = nullptr;
     in_packet.m_uiCursor = 0 ;
 }
 
@@ -57,9 +60,12 @@ FTS::Packet::Packet( Packet&& in_packet ) noexcept
  */
 Packet& FTS::Packet::operator=( Packet&& in_packet ) noexcept
 {
-    m_pData = in_packet.m_pData;
+    if( this == &in_packet ) {
+        return *this;
+    }
+    releaseData();
+    takeData( in_packet );
     m_uiCursor = in_packet.m_uiCursor;
-    in_packet.m_pData = nullptr;
     in_packet.m_uiCursor = 0;
     return *this;
 }
@@ -71,7 +77,7 @@ Packet& FTS::Packet::operator=( Packet&& in_packet ) noexcept
  */
 FTS::Packet::~Packet()
 {
-    delete m_pData;
+    releaseData();
 }
 
 /// Checks wether the data is valid.
@@ -143,17 +149,38 @@ Packet *FTS::Packet::rewind(void)
  *
  * \author Pompei2
  */
-Packet *FTS::Packet::append(std::string in)
+Packet *FTS::Packet::append(const std::string& in)
 {
-    size_t iLen =  in.length() + m_uiCursor + 1;
-    realloc(iLen);
-    if(in.c_str() == nullptr) {
+    return this->appendString(in.c_str(), in.length());
+}
+
+/// Appends a string to the message.
+/** This appends a zero terminated string at the current cursor position in
+ *  the message. After adding the data, the cursor is moved to point right
+ *  behind it. Other than the std::string version, this needs no temporary string.
+ *
+ * \param in The data to append. On nullptr an empty string is appended.
+ *
+ * \return a pointer to itself (this)
+ */
+Packet *FTS::Packet::append(const char *in)
+{
+    if(in == nullptr) {
         // special case : on NULL ptr a \0 string should be generated.
-        m_pData[m_uiCursor] = 0;
-    } else {
-        strcpy((char *)&m_pData[m_uiCursor], in.c_str());
+        return this->appendString("", 0);
     }
-    m_uiCursor += in.length() + 1;
+    return this->appendString(in, strlen(in));
+}
+
+/** Appends \a in_len characters and a terminating \0.
+ */
+Packet *FTS::Packet::appendString(const char *in, std::size_t in_len)
+{
+    size_t iLen =  in_len + m_uiCursor + 1;
+    ensureCapacity(iLen);
+    memcpy(&m_pData[m_uiCursor], in, in_len);
+    m_pData[m_uiCursor + in_len] = 0;
+    m_uiCursor += in_len + 1;
     ((fts_packet_hdr_t*) m_pData)->data_len = (std::uint32_t) (m_uiCursor - D_PACKET_HDR_LEN);
     return this;
 }
@@ -176,7 +203,7 @@ Packet *FTS::Packet::append(std::string in)
 Packet *FTS::Packet::append(const void *in_pData, std::size_t in_iSize)
 {
     auto iLen = in_iSize + m_uiCursor + 1;
-    realloc(iLen);
+    ensureCapacity(iLen);
     if(in_pData == nullptr) {
         // special case : on NULL ptr a \0 should be generated.
         m_pData[m_uiCursor] = 0;
@@ -189,41 +216,67 @@ Packet *FTS::Packet::append(const void *in_pData, std::size_t in_iSize)
     return this;
 }
 
+/// Makes room for data at the cursor.
+/** This grows the payload by \a in_iSize bytes at the current cursor position
+ *  and moves the cursor behind them. The caller then writes the data directly
+ *  into the returned memory, e.g. when serializing a whole message at once.
+ *
+ * \param in_iSize The number of bytes to make room for.
+ *
+ * \return A pointer to the (uninitialized) bytes. It is valid until the
+ *         packet is modified the next time.
+ */
+std::int8_t *FTS::Packet::appendRaw(std::size_t in_iSize)
+{
+    ensureCapacity(m_uiCursor + in_iSize);
+    std::int8_t *p = &m_pData[m_uiCursor];
+    m_uiCursor += in_iSize;
+    ((fts_packet_hdr_t*)m_pData)->data_len = (std::uint32_t) (m_uiCursor - D_PACKET_HDR_LEN);
+    return p;
+}
+
 /** This returns the string that is at the current cursor's position
  *  in the message. After reading the data, the cursor is moved to
  *  point right behind it.
  *
  * \return the string that has been read.
  *
- * \note
+ * \note If there is no terminating \0 the packet is corrupt: an empty
+ *       string is returned and the cursor is moved to the end.
  *
  * \author Pompei2
  */
 std::string FTS::Packet::get_string()
+{
+    return std::string(this->get_string_view());
+}
+
+/** This returns the string that is at the current cursor's position
+ *  in the message, without copying it. The terminating \0 is searched
+ *  once by memchr, which compares 16 or more bytes per step, and the
+ *  length is taken from there. After reading the data, the cursor is
+ *  moved to point right behind it.
+ *
+ * \return the string that has been read. It points into the packet and
+ *         is valid until the packet is modified the next time.
+ *
+ * \note If there is no terminating \0 the packet is corrupt: an empty
+ *       string is returned and the cursor is moved to the end.
+ */
+std::string_view FTS::Packet::get_string_view()
 {
     auto len = this->getTotalLen();
     if(m_uiCursor >= len)
-        return "";
+        return std::string_view();
 
-    // Check if a \0 is in the buffer, otherwise return empty string and move to cursor to the end, since the buffer is corrupt.
-    bool foundEnd = false;
-    for( size_t i = 0; i < (len - m_uiCursor); ++i )
-    {
-        if( m_pData[m_uiCursor + i] == 0 )
-        {
-            foundEnd = true;
-            break;
-        }
-    }
-    if ( !foundEnd )
-    {
+    auto pStart = (const char *)&m_pData[m_uiCursor];
+    auto pEnd = (const char *)memchr(pStart, 0, len - m_uiCursor);
+    if(pEnd == nullptr) {
         m_uiCursor = len;
-        return "";
+        return std::string_view();
     }
 
-    // The strings can be build.
-    auto ret = std::string((char *)&m_pData[m_uiCursor]);
-
+    std::string_view ret(pStart, (std::size_t)(pEnd - pStart));
     m_uiCursor += ret.length() + 1;
     return ret;
 }
@@ -231,11 +284,13 @@ std::string FTS::Packet::get_string()
 /** This returns the string that is at the current cursor's position
  *  in the message and then removes it from the message. After this
  *  operation, the cursor should be at the same absolute place as before,
- *  but the data behind the cursor should be different.
+ *  but the data behind the cursor should be different.\n
+ *  The string is removed in place, only the bytes behind it are moved.
  *
  * \return the string that has been removed.
  *
- * \note
+ * \note If there is no terminating \0 the packet is corrupt: an empty
+ *       string is returned and nothing is removed.
  *
  * \author Pompei2
  */
@@ -245,19 +300,20 @@ std::string FTS::Packet::extractString()
     if(m_uiCursor >= len)
         return "";
 
-    auto ret = std::string((char *)&m_pData[m_uiCursor]);
+    auto pStart = (const char *)&m_pData[m_uiCursor];
+    auto pEnd = (const char *)memchr(pStart, 0, len - m_uiCursor);
+    if(pEnd == nullptr)
+        return "";
 
-    // Now we got the string, we still need to remove it from the data.
-    auto byteCount = ret.length();
-    int8_t *pNewData = (int8_t *)calloc(1,len - (byteCount + 1));
-    memcpy(pNewData, m_pData, m_uiCursor);
-    memcpy(&pNewData[m_uiCursor], &m_pData[m_uiCursor+byteCount+1], len - byteCount - 1 - m_uiCursor);
+    auto byteCount = (size_t)(pEnd - pStart);
+    auto ret = std::string(pStart, byteCount);
 
-    // The data size is less now.
-    ((fts_packet_hdr_t*)pNewData)->data_len -= (std::uint32_t) (byteCount + 1);
+    // Now we got the string, we still need to remove it from the data. The
+    // bytes behind it are moved down in place, the buffer is kept as it is.
+    memmove(&m_pData[m_uiCursor], &m_pData[m_uiCursor + byteCount + 1], len - m_uiCursor - byteCount - 1);
 
-    delete m_pData;
-    m_pData = pNewData;
+    // The data size is less now.
+    ((fts_packet_hdr_t*)m_pData)->data_len -= (std::uint32_t) (byteCount + 1);
 
     // We do not move the cursor!
     return ret;
@@ -356,8 +412,8 @@ int FTS::Packet::readFromPacket(Packet *in_pPack)
     in_pPack->get(type);
     in_pPack->get(uiPayloadSize);
     
-    delete m_pData;
-    m_pData = (int8_t *)calloc(1,D_PACKET_HDR_LEN + uiPayloadSize);
+    releaseData();
+    allocateData(D_PACKET_HDR_LEN + uiPayloadSize);
     memset(m_pData, 0, D_PACKET_HDR_LEN + uiPayloadSize);
     m_pData[0] = 'F';
     m_pData[1] = 'T';
@@ -395,6 +451,8 @@ int FTS::Packet::printToFile(FILE *in_pFile) const
 }
 
 /** Reallocates the data buffer to the new size.
+ *  The buffer is never shrunk, so this only makes sure that \a in_newSize
+ *  bytes (header included) fit into the buffer.
  *
  * \param in_newSize    The new size of the internal data buffer
  *
@@ -404,11 +462,47 @@ int FTS::Packet::printToFile(FILE *in_pFile) const
  */
 Packet * FTS::Packet::realloc( size_t in_newSize )
 {
-    m_pData = ( int8_t* ) ::realloc( m_pData, in_newSize );
+    if( in_newSize <= m_uiCapacity ) {
+        return this;
+    }
+
+    if( !ownsData() ) {
+        // Spill the inline (or trailing) buffer to the heap.
+        auto pOld = m_pData;
+        m_pData = ( int8_t* ) PacketBufferPool::instance().allocate( in_newSize );
+        memcpy( m_pData, pOld, m_uiCapacity );
+    } else {
+        m_pData = ( int8_t* ) PacketBufferPool::instance().reallocate( m_pData, in_newSize );
+    }
     assert( m_pData != nullptr );
+    m_uiCapacity = PacketBufferPool::capacity( m_pData );
     return this;
 }
 
+/** Makes sure the buffer can hold a payload of \a in_payloadLen bytes without
+ *  reallocating. Use this before appending many fields to a packet.
+ *  The payload length (what gets sent) is not changed.
+ *
+ * \param in_payloadLen    The payload size to make room for.
+ *
+ * \return this
+ */
+Packet * FTS::Packet::reserve( size_t in_payloadLen )
+{
+    return this->realloc( D_PACKET_HDR_LEN + in_payloadLen );
+}
+
+/** Grows the buffer to hold at least \a in_needed bytes (header included).
+ *  The capacity is at least doubled, so appending field by field costs
+ *  amortized constant time.
+ *
+ * \param in_needed    The minimum size of the buffer.
+ */
+void FTS::Packet::grow( size_t in_needed )
+{
+    this->realloc( std::max( in_needed, 2 * m_uiCapacity ) );
+}
+
 /** Moves the internal data buffer of the input Packet to this one.
  *  The input buffer is cleared and contains a nullptr after the move.
  *
@@ -421,13 +515,105 @@ Packet * FTS::Packet::realloc( size_t in_newSize )
 Packet* FTS::Packet::transferData( Packet* p )
 {
     // Free the data buffer
-    delete m_pData ;
+    releaseData();
 
     // Put the other buffer pointer in to the in packet
-    m_pData = p->m_pData;
-
-    // In order that the delete works, set data pointer to NULL
-    p->m_pData = nullptr;
+    takeData( *p );
 
     return this;
 }
+
+/** Allocates a new data buffer of at least \a in_size bytes. Small buffers
+ *  are inside the object, only bigger ones come from the buffer pool.
+ *  The current buffer has to be released before.
+ *
+ * \param in_size    The size of the new buffer, header included.
+ */
+void FTS::Packet::allocateData( size_t in_size )
+{
+    if( in_size <= D_PACKET_INLINE_LEN ) {
+        m_pData = m_inline;
+        m_uiCapacity = D_PACKET_INLINE_LEN;
+    } else {
+        m_pData = ( int8_t* ) PacketBufferPool::instance().allocate( in_size );
+        m_uiCapacity = PacketBufferPool::capacity( m_pData );
+    }
+}
+
+/** Gives the data buffer back to the pool, if it isn't the inline one.
+ *  Afterwards, the packet has no buffer.
+ */
+void FTS::Packet::releaseData()
+{
+    if( ownsData() ) {
+        PacketBufferPool::instance().release( m_pData );
+    }
+    m_pData = nullptr;
+    m_uiCapacity = 0;
+}
+
+/** Takes over the data buffer of another packet, which has no buffer afterwards.
+ *  An inline or trailing buffer can't be handed over, its content is copied instead.
+ *  The current buffer has to be released before.
+ *
+ * \param in_packet    The packet to take the buffer from.
+ */
+void FTS::Packet::takeData( Packet& in_packet )
+{
+    if( !in_packet.ownsData() ) {
+        auto len = in_packet.getTotalLen();
+        allocateData( len );
+        memcpy( m_pData, in_packet.m_pData, len );
+    } else {
+        m_pData = in_packet.m_pData;
+        m_uiCapacity = in_packet.m_uiCapacity;
+    }
+    in_packet.m_pData = nullptr;
+    in_packet.m_uiCapacity = 0;
+}
+
+/** Whether m_pData is a pool buffer owned by this packet, as opposed to the
+ *  inline buffer or the storage behind the object (see create()).
+ */
+bool FTS::Packet::ownsData() const
+{
+    return m_pData != m_inline && m_pData != trailingData();
+}
+
+/** Creates a packet whose object and buffer live in one single allocation.
+ *  The buffer is placed right behind the object and is big enough for a
+ *  payload of \a in_payloadLen bytes. If the packet grows beyond that, it
+ *  moves into a pool buffer like any other packet.\n
+ *  Small packets just use their inline buffer.
+ *
+ * \param in_cType The type of the message.
+ * \param in_payloadLen The payload size the packet shall be able to hold.
+ *
+ * \return The packet. It may be released with delete as well.
+ */
+PacketPtr FTS::Packet::create( master_request_t in_cType, std::size_t in_payloadLen )
+{
+    auto uiTotalLen = D_PACKET_HDR_LEN + in_payloadLen;
+    if( uiTotalLen <= D_PACKET_INLINE_LEN ) {
+        return PacketPtr( new Packet( in_cType ) );
+    }
+
+    void* pBlock = PacketBufferPool::instance().allocate( sizeof( Packet ) + uiTotalLen );
+    Packet* p = ::new( pBlock ) Packet( in_cType );
+    p->m_pData = p->trailingData();
+    p->m_uiCapacity = PacketBufferPool::capacity( pBlock ) - sizeof( Packet );
+    memcpy( p->m_pData, p->m_inline, D_PACKET_HDR_LEN );
+    return PacketPtr( p );
+}
+
+/** Packets on the heap come from the buffer pool, too.
+ */
+void* FTS::Packet::operator new( std::size_t in_size )
+{
+    return PacketBufferPool::instance().allocate( in_size );
+}
+
+void FTS::Packet::operator delete( void* in_p )
+{
+    PacketBufferPool::instance().release( in_p );
+}
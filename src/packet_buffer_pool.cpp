@@ -0,0 +1,369 @@
+/**
+ * \file packet_buffer_pool.cpp
+ * \brief This file implements the size-classed pool the packets draw
+ *        their data buffers from.
+ **/
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "packet_buffer_pool.h"
+
+using namespace FTS;
+
+namespace {
+
+/// The hidden header in front of every buffer handed out by the pool.
+struct BlockHeader {
+    std::uint32_t cls;         ///< The size class or NO_CLASS for heap buffers.
+    std::uint32_t generation;  ///< The pool configuration the block belongs to.
+    std::size_t capacity;      ///< The usable size of the buffer.
+#if SIZE_MAX == UINT32_MAX
+    std::uint32_t pad;         ///< Fills the header up to 16 bytes on 32 bit systems.
+#endif
+};
+
+static_assert( sizeof( BlockHeader ) % 16 == 0, "Buffers need to stay 16 bytes aligned." );
+
+constexpr std::uint32_t NO_CLASS = 0xFFFFFFFF;
+
+inline BlockHeader* headerOf( const void* in_p )
+{
+    return (BlockHeader*) ((std::int8_t*) in_p - sizeof( BlockHeader ));
+}
+
+inline void* bufferOf( BlockHeader* in_pHdr )
+{
+    return (std::int8_t*) in_pHdr + sizeof( BlockHeader );
+}
+
+/// Free blocks are chained through their first bytes.
+inline void*& nextOf( void* in_block )
+{
+    return *(void**) bufferOf( (BlockHeader*) in_block );
+}
+
+}
+
+namespace FTS {
+
+/// The per thread cache of free blocks.
+/** Destroying it (on thread exit) hands all cached blocks back to the pool.
+ **/
+struct PacketBufferThreadCache {
+    std::uint32_t generation = 0;
+    void* head[PacketBufferPool::MAX_CLASSES] = {};
+    std::size_t count[PacketBufferPool::MAX_CLASSES] = {};
+
+    ~PacketBufferThreadCache() { flush(); }
+
+    void flush()
+    {
+        auto& pool = PacketBufferPool::instance();
+        for( std::size_t i = 0; i < PacketBufferPool::MAX_CLASSES; ++i ) {
+            while( head[i] ) {
+                void* block = head[i];
+                head[i] = nextOf( block );
+                pool.releaseBlock( block );
+            }
+            count[i] = 0;
+        }
+    }
+};
+
+}
+
+static thread_local PacketBufferThreadCache t_cache;
+
+/// Returns the process wide pool.
+/** The pool is never destroyed, so buffers may still be released by
+ *  threads that exit after main().
+ **/
+PacketBufferPool& FTS::PacketBufferPool::instance()
+{
+    static PacketBufferPool* pPool = new PacketBufferPool();
+    return *pPool;
+}
+
+FTS::PacketBufferPool::PacketBufferPool()
+    : m_nClasses( 0 )
+    , m_generation( 1 )
+    , m_maxFree( DEFAULT_MAX_FREE )
+    , m_allocations( 0 )
+    , m_releases( 0 )
+    , m_hits( 0 )
+    , m_misses( 0 )
+    , m_oversized( 0 )
+    , m_trimmed( 0 )
+{
+    // Most packets are small chat or lobby messages, some carry game lists or maps.
+    const std::size_t classes[] = { 64, 128, 256, 512, 1024, 4096, 16384, 65536 };
+    std::copy( std::begin( classes ), std::end( classes ), m_classes );
+    m_nClasses.store( std::end( classes ) - std::begin( classes ) );
+}
+
+/// Sets the size classes of the pool.
+/** All cached buffers are freed, buffers currently in use stay valid and are
+ *  freed instead of cached when they come back.
+ *
+ * \param in_classes The buffer sizes to pool, in any order. At most MAX_CLASSES.
+ * \param in_maxFreePerClass The number of free buffers to keep per class.
+ *
+ * \return true if the classes have been taken over, false if they are invalid.
+ *
+ * \note Call this at start-up, before traffic starts, as allocations done
+ *       concurrently to the reconfiguration may pick the old classes.
+ */
+bool FTS::PacketBufferPool::configure( const std::vector<std::size_t>& in_classes, std::size_t in_maxFreePerClass )
+{
+    if( in_classes.empty() || in_classes.size() > MAX_CLASSES ) {
+        return false;
+    }
+
+    std::vector<std::size_t> classes( in_classes );
+    std::sort( classes.begin(), classes.end() );
+    classes.erase( std::unique( classes.begin(), classes.end() ), classes.end() );
+    if( classes.front() < sizeof( void* ) ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( m_configMtx );
+    trim();
+    std::copy( classes.begin(), classes.end(), m_classes );
+    m_maxFree = in_maxFreePerClass;
+    m_nClasses.store( classes.size() );
+    m_generation.fetch_add( 1 );
+    return true;
+}
+
+/// Returns the currently configured size classes.
+std::vector<std::size_t> FTS::PacketBufferPool::getClasses() const
+{
+    std::lock_guard<std::mutex> lock( m_configMtx );
+    return std::vector<std::size_t>( m_classes, m_classes + m_nClasses.load() );
+}
+
+/// Gets a buffer of at least \a in_size bytes.
+/** \return The buffer. It has to be given back with release().
+ */
+void* FTS::PacketBufferPool::allocate( std::size_t in_size )
+{
+    m_allocations.fetch_add( 1, std::memory_order_relaxed );
+    auto cls = findClass( in_size );
+    if( cls < 0 ) {
+        m_oversized.fetch_add( 1, std::memory_order_relaxed );
+        return bufferOf( (BlockHeader*) allocateBlock( cls, in_size ) );
+    }
+
+    auto generation = m_generation.load( std::memory_order_relaxed );
+    if( t_cache.generation != generation ) {
+        t_cache.flush();
+        t_cache.generation = generation;
+    }
+
+    void* block = t_cache.head[cls];
+    if( block == nullptr ) {
+        block = popGlobal( cls );
+    } else {
+        t_cache.head[cls] = nextOf( block );
+        t_cache.count[cls]--;
+    }
+
+    if( block == nullptr ) {
+        m_misses.fetch_add( 1, std::memory_order_relaxed );
+        block = allocateBlock( cls, m_classes[cls] );
+    } else {
+        m_hits.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    return bufferOf( (BlockHeader*) block );
+}
+
+/// Resizes a buffer.
+/** If the buffer is already big enough, nothing happens. Else a bigger buffer
+ *  is taken and the content copied over.
+ *
+ * \param in_p The buffer to resize, may be nullptr.
+ * \param in_newSize The size needed.
+ *
+ * \return The resized buffer, \a in_p is not valid anymore if it differs.
+ */
+void* FTS::PacketBufferPool::reallocate( void* in_p, std::size_t in_newSize )
+{
+    if( in_p == nullptr ) {
+        return allocate( in_newSize );
+    }
+
+    auto pHdr = headerOf( in_p );
+    if( pHdr->capacity >= in_newSize ) {
+        return in_p;
+    }
+
+    // A heap buffer that stays a heap buffer can be grown in place.
+    if( pHdr->cls == NO_CLASS && findClass( in_newSize ) < 0 ) {
+        m_oversized.fetch_add( 1, std::memory_order_relaxed );
+        pHdr = (BlockHeader*) ::realloc( pHdr, sizeof( BlockHeader ) + in_newSize );
+        assert( pHdr != nullptr );
+        pHdr->capacity = in_newSize;
+        return bufferOf( pHdr );
+    }
+
+    void* pNew = allocate( in_newSize );
+    memcpy( pNew, in_p, pHdr->capacity );
+    release( in_p );
+    return pNew;
+}
+
+/// Gives a buffer back to the pool.
+/** \param in_p The buffer got by allocate() or reallocate(). May be nullptr.
+ */
+void FTS::PacketBufferPool::release( void* in_p )
+{
+    if( in_p == nullptr ) {
+        return;
+    }
+
+    m_releases.fetch_add( 1, std::memory_order_relaxed );
+    auto pHdr = headerOf( in_p );
+    if( pHdr->cls == NO_CLASS || pHdr->generation != t_cache.generation ) {
+        releaseBlock( pHdr );
+        return;
+    }
+
+    auto cls = pHdr->cls;
+    nextOf( pHdr ) = t_cache.head[cls];
+    t_cache.head[cls] = pHdr;
+
+    // Give half of the cache back when it overflows, so a thread that only
+    // releases (e.g. a consumer of another thread's packets) does not hoard.
+    if( ++t_cache.count[cls] > THREAD_CACHE_LEN ) {
+        while( t_cache.count[cls] > THREAD_CACHE_LEN / 2 ) {
+            void* block = t_cache.head[cls];
+            t_cache.head[cls] = nextOf( block );
+            t_cache.count[cls]--;
+            releaseBlock( block );
+        }
+    }
+}
+
+/// Returns the usable size of a buffer got from the pool.
+std::size_t FTS::PacketBufferPool::capacity( const void* in_p )
+{
+    return in_p == nullptr ? 0 : headerOf( in_p )->capacity;
+}
+
+/// Frees all buffers cached in the global free lists and in the calling thread.
+void FTS::PacketBufferPool::trim()
+{
+    t_cache.flush();
+    for( std::size_t i = 0; i < MAX_CLASSES; ++i ) {
+        std::lock_guard<std::mutex> lock( m_free[i].mtx );
+        while( m_free[i].head ) {
+            void* block = m_free[i].head;
+            m_free[i].head = nextOf( block );
+            ::free( block );
+        }
+        m_free[i].count = 0;
+    }
+}
+
+/// Returns a snapshot of the pool counters.
+PacketBufferPoolStats FTS::PacketBufferPool::getStats() const
+{
+    PacketBufferPoolStats stats;
+    stats.allocations = m_allocations.load( std::memory_order_relaxed );
+    stats.releases = m_releases.load( std::memory_order_relaxed );
+    stats.hits = m_hits.load( std::memory_order_relaxed );
+    stats.misses = m_misses.load( std::memory_order_relaxed );
+    stats.oversized = m_oversized.load( std::memory_order_relaxed );
+    stats.trimmed = m_trimmed.load( std::memory_order_relaxed );
+    return stats;
+}
+
+/// Sets all counters back to 0.
+void FTS::PacketBufferPool::resetStats()
+{
+    m_allocations.store( 0 );
+    m_releases.store( 0 );
+    m_hits.store( 0 );
+    m_misses.store( 0 );
+    m_oversized.store( 0 );
+    m_trimmed.store( 0 );
+}
+
+int FTS::PacketBufferPool::findClass( std::size_t in_size ) const
+{
+    auto n = m_nClasses.load( std::memory_order_relaxed );
+    for( std::size_t i = 0; i < n; ++i ) {
+        if( in_size <= m_classes[i] ) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+void* FTS::PacketBufferPool::allocateBlock( int in_class, std::size_t in_size )
+{
+    auto pHdr = (BlockHeader*) ::malloc( sizeof( BlockHeader ) + in_size );
+    assert( pHdr != nullptr );
+    pHdr->cls = in_class < 0 ? NO_CLASS : (std::uint32_t) in_class;
+    pHdr->generation = m_generation.load( std::memory_order_relaxed );
+    pHdr->capacity = in_size;
+    return pHdr;
+}
+
+/// Puts a block into its global free list or frees it if that is full or stale.
+void FTS::PacketBufferPool::releaseBlock( void* in_block )
+{
+    auto pHdr = (BlockHeader*) in_block;
+    if( pHdr->cls == NO_CLASS || pHdr->generation != m_generation.load( std::memory_order_relaxed ) ) {
+        ::free( pHdr );
+        return;
+    }
+    pushGlobal( (int) pHdr->cls, pHdr );
+}
+
+void FTS::PacketBufferPool::pushGlobal( int in_class, void* in_block )
+{
+    auto& list = m_free[in_class];
+    {
+        std::lock_guard<std::mutex> lock( list.mtx );
+        if( list.count < m_maxFree ) {
+            nextOf( in_block ) = list.head;
+            list.head = in_block;
+            list.count++;
+            return;
+        }
+    }
+    m_trimmed.fetch_add( 1, std::memory_order_relaxed );
+    ::free( in_block );
+}
+
+/// Takes a block out of the global free list.
+/** Takes some more blocks to refill the thread cache, so the next
+ *  allocations of this class do not need the lock.
+ */
+void* FTS::PacketBufferPool::popGlobal( int in_class )
+{
+    auto& list = m_free[in_class];
+    std::lock_guard<std::mutex> lock( list.mtx );
+    void* block = list.head;
+    if( block == nullptr ) {
+        return nullptr;
+    }
+    list.head = nextOf( block );
+    list.count--;
+
+    while( list.head && t_cache.count[in_class] < THREAD_CACHE_LEN / 2 ) {
+        void* cached = list.head;
+        list.head = nextOf( cached );
+        list.count--;
+        nextOf( cached ) = t_cache.head[in_class];
+        t_cache.head[in_class] = cached;
+        t_cache.count[in_class]++;
+    }
+    return block;
+}
@@ -0,0 +1,108 @@
+/**
+ * \file packet_queue.cpp
+ * \brief This file implements the queue of the packets a connection has
+ *        received but nobody asked for yet.
+ **/
+
+#include "packet_queue.h"
+
+using namespace FTS;
+
+/** Adds a packet behind the most recent one. The queue takes the ownership.
+ *
+ * \param in_pPacket The packet to queue. It must not be in a queue already.
+ */
+void FTS::PacketQueue::push( Packet *in_pPacket )
+{
+    if( in_pPacket == nullptr ) {
+        return;
+    }
+
+    in_pPacket->m_pQueuePrev = m_pTail;
+    in_pPacket->m_pQueueNext = nullptr;
+    in_pPacket->m_pQueueNextSame = nullptr;
+    if( m_pTail ) {
+        m_pTail->m_pQueueNext = in_pPacket;
+    } else {
+        m_pHead = in_pPacket;
+    }
+    m_pTail = in_pPacket;
+
+    ReqList& l = m_perReq[in_pPacket->getType()];
+    if( l.pTail ) {
+        l.pTail->m_pQueueNextSame = in_pPacket;
+    } else {
+        l.pHead = in_pPacket;
+    }
+    l.pTail = in_pPacket;
+    ++l.uiCount;
+    ++m_uiSize;
+}
+
+/** Takes out the oldest packet.
+ *
+ * \return The packet, the caller has to free it. NULL if the queue is empty.
+ */
+Packet *FTS::PacketQueue::pop()
+{
+    Packet *p = m_pHead;
+    if( p ) {
+        this->unlink( p );
+    }
+    return p;
+}
+
+/** Takes out the oldest packet with the request id \a in_req.
+ *
+ * \param in_req The request id to look for.
+ *
+ * \return The packet, the caller has to free it. NULL if there is none.
+ */
+Packet *FTS::PacketQueue::pop( master_request_t in_req )
+{
+    Packet *p = m_perReq[in_req].pHead;
+    if( p ) {
+        this->unlink( p );
+    }
+    return p;
+}
+
+/** Deletes all queued packets.
+ */
+void FTS::PacketQueue::clear()
+{
+    while( Packet *p = this->pop() ) {
+        delete p;
+    }
+}
+
+/** Takes a packet out of both lists. It has to be the oldest one of its
+ *  request id, which is always the case as packets are taken in order.
+ *
+ * \param in_pPacket The packet to take out.
+ */
+void FTS::PacketQueue::unlink( Packet *in_pPacket )
+{
+    if( in_pPacket->m_pQueuePrev ) {
+        in_pPacket->m_pQueuePrev->m_pQueueNext = in_pPacket->m_pQueueNext;
+    } else {
+        m_pHead = in_pPacket->m_pQueueNext;
+    }
+    if( in_pPacket->m_pQueueNext ) {
+        in_pPacket->m_pQueueNext->m_pQueuePrev = in_pPacket->m_pQueuePrev;
+    } else {
+        m_pTail = in_pPacket->m_pQueuePrev;
+    }
+
+    ReqList& l = m_perReq[in_pPacket->getType()];
+    l.pHead = in_pPacket->m_pQueueNextSame;
+    if( l.pHead == nullptr ) {
+        l.pTail = nullptr;
+    }
+    --l.uiCount;
+    --m_uiSize;
+
+    in_pPacket->m_pQueuePrev = nullptr;
+    in_pPacket->m_pQueueNext = nullptr;
+    in_pPacket->m_pQueueNextSame = nullptr;
+}
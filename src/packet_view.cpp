@@ -0,0 +1,146 @@
+/**
+ * \file packet_view.cpp
+ * \brief This file implements a read-only view onto the bytes of a
+ *        received packet.
+ **/
+
+#include <algorithm>
+#include <cstring>
+
+#include "packet_view.h"
+
+using namespace FTS;
+
+/** Creates a view of a payload.
+ *
+ * \param in_cType The type of the packet.
+ * \param in_pPayload The first byte of the payload.
+ * \param in_uiPayloadLen The length of the payload.
+ */
+FTS::PacketView::PacketView( master_request_t in_cType, const void* in_pPayload, std::size_t in_uiPayloadLen )
+    : m_pPayload( (const std::int8_t*) in_pPayload )
+    , m_uiLen( in_uiPayloadLen )
+    , m_cType( in_cType )
+    , m_bValid( in_pPayload != nullptr || in_uiPayloadLen == 0 )
+{
+}
+
+/** Creates a view of the payload of a packet.
+ *  The view does not see the data appended to the packet later on.
+ *
+ * \param in_packet The packet to view.
+ */
+FTS::PacketView::PacketView( const Packet& in_packet )
+    : PacketView( in_packet.getType(), in_packet.getPayloadPtr(), in_packet.getPayloadLen() )
+{
+    m_bValid = in_packet.isValid();
+}
+
+/** Creates a view of a whole frame as it came over the net: the FTSS header
+ *  followed by the payload.
+ *
+ * \param in_pData The first byte of the header.
+ * \param in_uiLen The number of bytes available at \a in_pData.
+ *
+ * \return The view. It is invalid if the header is corrupt or the payload
+ *         is not completely in the buffer.
+ */
+PacketView FTS::PacketView::fromFrame( const void* in_pData, std::size_t in_uiLen )
+{
+    if( in_pData == nullptr || in_uiLen < D_PACKET_HDR_LEN ) {
+        return PacketView();
+    }
+
+    fts_packet_hdr_t hdr;
+    memcpy( &hdr, in_pData, sizeof( hdr ) );
+    if( !isPacketHeaderValid( &hdr ) || hdr.data_len > in_uiLen - D_PACKET_HDR_LEN ) {
+        return PacketView();
+    }
+
+    return PacketView( hdr.req_id, (const std::int8_t*) in_pData + D_PACKET_HDR_LEN, hdr.data_len );
+}
+
+/** This returns the string that is at the current cursor's position
+ *  in the payload, without copying it. After reading the data, the cursor
+ *  is moved to point right behind the terminating \0.
+ *
+ * \return the string that has been read. It points into the viewed bytes.
+ *
+ * \note If there is no terminating \0 the payload is corrupt: an empty
+ *       string is returned and the cursor is moved to the end.
+ */
+std::string_view FTS::PacketView::get_string_view()
+{
+    auto remaining = getRemaining();
+    if( remaining == 0 ) {
+        return std::string_view();
+    }
+
+    auto pStart = (const char*) m_pPayload + m_uiCursor;
+    auto pEnd = (const char*) memchr( pStart, 0, remaining );
+    if( pEnd == nullptr ) {
+        m_uiCursor = m_uiLen;
+        return std::string_view();
+    }
+
+    std::string_view ret( pStart, (std::size_t) (pEnd - pStart) );
+    m_uiCursor += ret.length() + 1;
+    return ret;
+}
+
+/** This copies binary data that is at the current cursor's position
+ *  in the payload. If you want it to read more then there is, it will
+ *  stop reading at the end of the payload. If you want it to read "0" bytes,
+ *  it will read everything till the end of the payload.\n
+ *  After reading the data, the cursor is moved to point right behind it.
+ *
+ * \param out_pData A pointer to allocated memory where to store the read data.
+ * \param in_uiSize The length of the data to retrieve.
+ *
+ * \return The number of bytes copied.
+ */
+std::size_t FTS::PacketView::get( void* out_pData, std::size_t in_uiSize )
+{
+    auto len = in_uiSize == 0 ? getRemaining() : std::min( getRemaining(), in_uiSize );
+    memcpy( out_pData, m_pPayload + m_uiCursor, len );
+    m_uiCursor += len;
+    return len;
+}
+
+/** Returns a view of a packet stored inside this one by Packet::writeToPacket,
+ *  this is the zero-copy version of Packet::readFromPacket.
+ *  The cursor is moved behind the nested packet.
+ *
+ * \return The view of the nested packet. It is invalid if the payload is
+ *         too short to hold it.
+ */
+PacketView FTS::PacketView::getPacketView()
+{
+    master_request_t cType = DSRV_MSG_NULL;
+    std::uint32_t uiPayloadLen = 0;
+    if( !this->get( cType ) || !this->get( uiPayloadLen ) || uiPayloadLen > getRemaining() ) {
+        m_uiCursor = m_uiLen;
+        return PacketView();
+    }
+
+    PacketView ret( cType, m_pPayload + m_uiCursor, uiPayloadLen );
+    m_uiCursor += uiPayloadLen;
+    return ret;
+}
+
+/** Copies the viewed packet into a packet of its own, e.g. to keep a
+ *  received packet beyond the lifetime of the receive buffer.
+ *
+ * \return The packet, made in one single allocation. Its cursor is at the
+ *         start of the payload.
+ */
+PacketPtr FTS::PacketView::toPacket() const
+{
+    auto p = Packet::create( m_cType, m_uiLen );
+    // Exactly what create made room for, append would want a byte more.
+    if( m_uiLen > 0 ) {
+        memcpy( p->appendRaw( m_uiLen ), m_pPayload, m_uiLen );
+    }
+    p->rewind();
+    return p;
+}
@@ -0,0 +1,210 @@
+/**
+ * \file reactor.cpp
+ * \brief This file implements the reactor, which serves many connections
+ *        from one thread.
+ **/
+
+#include "reactor.h"
+#include "Logger.h"
+#include "TraditionalConnection.h"
+#include "socket_connection_waiter.h"
+
+using namespace FTS;
+
+FTS::Reactor::Reactor()
+{
+}
+
+/** Closes all connections and the listening socket, without calling any
+ *  callback.
+ */
+FTS::Reactor::~Reactor()
+{
+    for( auto& c : m_connections ) {
+        m_loop.remove( c.second->sock );
+    }
+    if( m_pWaiter ) {
+        m_loop.remove( (NativeSocket) m_pWaiter->getSocket() );
+    }
+}
+
+/** Starts serving a connection.
+ *
+ * \param in_pCon The connection, the reactor takes it over. It is freed when
+ *                it is lost or removed.
+ * \param in_onPacket Gets every packet received on the connection.
+ * \param in_onClose Is told when the connection has been lost, may be empty.
+ *
+ * \return false if the connection can't be served, then it has been freed.
+ */
+bool FTS::Reactor::add( Connection* in_pCon, PacketCallback in_onPacket, CloseCallback in_onClose )
+{
+    auto pEntry = std::make_shared<Entry>();
+    pEntry->pCon.reset( in_pCon );
+    if( in_pCon == nullptr || !in_onPacket ) {
+        return false;
+    }
+    if( in_pCon->getType() != Connection::eConnectionType::D_CONNECTION_TRADITIONAL || !in_pCon->isConnected() ) {
+        FTSMSG( "Net: only connected traditional connections can be served by the reactor.", MsgType::Error );
+        return false;
+    }
+
+    auto pTC = static_cast<TraditionalConnection*>( in_pCon );
+    pEntry->sock = (NativeSocket) pTC->getSocket();
+    pEntry->onPacket = std::move( in_onPacket );
+    pEntry->onClose = std::move( in_onClose );
+
+    TraditionalConnection::setSocketBlocking( pTC->getSocket(), false );
+    if( !m_loop.add( pEntry->sock, EventLoop::Readable, [this, pEntry]( std::uint32_t ) { this->onReadable( pEntry ); } ) ) {
+        return false;
+    }
+    m_connections[in_pCon] = pEntry;
+
+    // What has been queued while it was used the blocking way goes out first.
+    if( !pTC->m_packetQueue.empty() ) {
+        m_loop.post( [this, pEntry] { this->onReadable( pEntry ); } );
+    }
+    return true;
+}
+
+/** Stops serving a connection and frees it. The close callback isn't called.
+ *
+ * \param in_pCon The connection.
+ */
+void FTS::Reactor::remove( Connection* in_pCon )
+{
+    // A callback running for it keeps the entry alive until it returns.
+    this->unlink( in_pCon );
+}
+
+/** Stops serving a connection and hands it back.
+ *
+ * \param in_pCon The connection.
+ *
+ * \return The connection, the caller owns it. NULL if it isn't served.
+ */
+Connection* FTS::Reactor::release( Connection* in_pCon )
+{
+    auto pEntry = this->unlink( in_pCon );
+    return pEntry ? pEntry->pCon.release() : nullptr;
+}
+
+/** Takes a connection out of the loop and the list.
+ *
+ * \param in_pCon The connection.
+ *
+ * \return Its entry, or nothing if it isn't served.
+ */
+std::shared_ptr<Reactor::Entry> FTS::Reactor::unlink( Connection* in_pCon )
+{
+    auto i = m_connections.find( in_pCon );
+    if( i == m_connections.end() ) {
+        return nullptr;
+    }
+
+    auto pEntry = std::move( i->second );
+    m_connections.erase( i );
+    m_loop.remove( pEntry->sock );
+    pEntry->bRemoved = true;
+    return pEntry;
+}
+
+/** Receives what is there and hands out the complete packets.
+ *
+ * \param in_pEntry The connection whose socket is readable.
+ */
+void FTS::Reactor::onReadable( const std::shared_ptr<Entry>& in_pEntry )
+{
+    // Keep it alive, the callback may remove it.
+    auto pEntry = in_pEntry;
+    auto pTC = static_cast<TraditionalConnection*>( pEntry->pCon.get() );
+
+    int i = 0;
+    for( ; i < D_REACTOR_MAX_PACKETS_PER_WAKEUP && !pEntry->bRemoved; ++i ) {
+        Packet *p = pTC->getFirstPacketFromQueue();
+        if( p == nullptr ) {
+            p = pTC->getPacketIfReady();
+        }
+        if( p == nullptr ) {
+            break;
+        }
+        pEntry->onPacket( *pTC, PacketPtr( p ) );
+    }
+
+    // What is left over may already sit in the receive buffer, where the
+    // socket doesn't see it anymore: come back after the others had their
+    // turn.
+    if( i == D_REACTOR_MAX_PACKETS_PER_WAKEUP && !pEntry->bRemoved ) {
+        m_loop.post( [this, pEntry] { this->onReadable( pEntry ); } );
+    }
+
+    if( !pEntry->bRemoved && !pTC->isConnected() ) {
+        this->unlink( pTC );
+        if( pEntry->onClose ) {
+            pEntry->onClose( *pTC );
+        }
+    }
+}
+
+/** Starts accepting connections.
+ *
+ * \param in_pWaiter The waiter to accept with, of type SOCKET. The reactor
+ *                   takes it over and calls its init. Others are freed and
+ *                   refused, as their connections can't be added.
+ * \param in_usPort The port to listen on.
+ * \param in_onAccept Gets every new connection, e.g. to add it.
+ * \param in_options The socket options of the new connections.
+ *
+ * \return What ConnectionWaiter::init returns, 0 on success, -1 for a
+ *         waiter of another type. On failure the reactor doesn't listen
+ *         anymore, also not on an earlier port.
+ */
+int FTS::Reactor::listen( ConnectionWaiter* in_pWaiter, std::uint16_t in_usPort, AcceptCallback in_onAccept, const ConnectionOptions& in_options )
+{
+    this->stopListening();
+
+    auto pSocketWaiter = dynamic_cast<SocketConnectionWaiter*>( in_pWaiter );
+    if( pSocketWaiter == nullptr || pSocketWaiter->getType() != ConnectionWaiter::ConnectionType::SOCKET ) {
+        FTSMSG( "Net: a reactor can only listen with a waiter of type SOCKET.", MsgType::Error );
+        delete in_pWaiter;
+        return -1;
+    }
+    m_pWaiter.reset( pSocketWaiter );
+    m_onAccept = std::move( in_onAccept );
+
+    int iRet = m_pWaiter->init( in_usPort, []( Connection* in_pCon ) { delete in_pCon; }, in_options );
+    if( iRet != 0 ) {
+        m_pWaiter.reset();
+        return iRet;
+    }
+
+    auto sock = (NativeSocket) m_pWaiter->getSocket();
+    m_loop.add( sock, EventLoop::Readable, [this]( std::uint32_t ) { this->onAcceptable(); } );
+    return 0;
+}
+
+/** Stops accepting and closes the listening socket. The connections
+ *  accepted stay. Nothing happens if the reactor isn't listening.
+ */
+void FTS::Reactor::stopListening()
+{
+    if( m_pWaiter ) {
+        m_loop.remove( (NativeSocket) m_pWaiter->getSocket() );
+        m_pWaiter.reset();
+    }
+}
+
+/** Accepts all the connections that are waiting.
+ */
+void FTS::Reactor::onAcceptable()
+{
+    // The callback may listen anew, which frees this waiter.
+    auto pWaiter = m_pWaiter.get();
+    while( pWaiter == m_pWaiter.get() ) {
+        Connection *pCon = pWaiter->acceptIfAny();
+        if( pCon == nullptr ) {
+            break;
+        }
+        m_onAccept( pCon );
+    }
+}
@@ -0,0 +1,51 @@
+/**
+ * \file receive_buffer.cpp
+ * \brief This file implements the buffer a connection receives into.
+ **/
+
+#include <algorithm>
+#include <cstring>
+
+#include "receive_buffer.h"
+
+using namespace FTS;
+
+/** Returns where to receive new bytes to. The unread bytes are moved to the
+ *  front first when less than a quarter of the buffer is free at the end.
+ *
+ * \param out_uiFree Is set to the number of bytes that may be written.
+ *
+ * \return The first free byte. Call commit with the number of bytes written.
+ */
+std::int8_t* FTS::ReceiveBuffer::prepare( std::size_t& out_uiFree )
+{
+    if( m_buf.empty() ) {
+        m_buf.resize( m_uiCapacity );
+    }
+
+    if( m_uiBegin > 0 && m_uiCapacity - m_uiEnd < m_uiCapacity / 4 ) {
+        memmove( m_buf.data(), m_buf.data() + m_uiBegin, size() );
+        m_uiEnd -= m_uiBegin;
+        m_uiBegin = 0;
+    }
+
+    out_uiFree = m_uiCapacity - m_uiEnd;
+    return m_buf.data() + m_uiEnd;
+}
+
+/** Copies unread bytes out of the buffer and marks them as read.
+ *
+ * \param out_pBuf Where to copy the bytes to.
+ * \param in_uiLen The maximum number of bytes to copy.
+ *
+ * \return The number of bytes copied.
+ */
+std::size_t FTS::ReceiveBuffer::read( void* out_pBuf, std::size_t in_uiLen )
+{
+    auto len = std::min( in_uiLen, size() );
+    if( len > 0 ) {
+        memcpy( out_pBuf, data(), len );
+        consume( len );
+    }
+    return len;
+}
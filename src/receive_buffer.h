@@ -0,0 +1,62 @@
+/**
+ * \file receive_buffer.h
+ * \brief This file describes the buffer a connection receives into.
+ **/
+
+#ifndef FTS_RECEIVEBUFFER_H
+#define FTS_RECEIVEBUFFER_H
+
+#include <cstdint>
+#include <vector>
+
+namespace FTS {
+
+/// The default size of the receive buffer of a connection.
+constexpr std::size_t D_RECV_BUFFER_LEN = 16384;
+
+/// The bytes a connection has received but not yet parsed.
+/** The connection reads as much as fits into the free space at the end with
+ *  one recv and parses the bytes at the front. Consuming only moves the read
+ *  offset; the unread bytes are moved down to the front when the end is
+ *  nearly full.
+ *  So, unlike a wrapping ring buffer, the unread bytes are always contiguous
+ *  and a packet can be parsed right where it has been received.
+ **/
+class ReceiveBuffer {
+public:
+    explicit ReceiveBuffer( std::size_t in_uiCapacity = D_RECV_BUFFER_LEN ) : m_uiCapacity( in_uiCapacity ) {}
+
+    /// The number of received but unread bytes.
+    std::size_t size() const { return m_uiEnd - m_uiBegin; }
+    bool empty() const { return m_uiEnd == m_uiBegin; }
+    std::size_t capacity() const { return m_uiCapacity; }
+    /// The first unread byte.
+    const std::int8_t* data() const { return m_buf.data() + m_uiBegin; }
+
+    /// Marks \a in_uiLen bytes at the front as read.
+    void consume( std::size_t in_uiLen )
+    {
+        m_uiBegin += in_uiLen;
+        if( m_uiBegin == m_uiEnd ) {
+            m_uiBegin = m_uiEnd = 0;
+        }
+    }
+
+    std::int8_t* prepare( std::size_t& out_uiFree );
+    /// Adds \a in_uiLen bytes that have been written to the pointer prepare returned.
+    void commit( std::size_t in_uiLen ) { m_uiEnd += in_uiLen; }
+    std::size_t read( void* out_pBuf, std::size_t in_uiLen );
+    void clear() { m_uiBegin = m_uiEnd = 0; }
+
+private:
+    std::vector<std::int8_t> m_buf; ///< The storage, allocated on first use.
+    std::size_t m_uiCapacity;       ///< The size m_buf gets.
+    std::size_t m_uiBegin = 0;      ///< The offset of the first unread byte.
+    std::size_t m_uiEnd = 0;        ///< The offset behind the last received byte.
+};
+
+}
+
+#endif /* FTS_RECEIVEBUFFER_H */
+
+ /* EOF */
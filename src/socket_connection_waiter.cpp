@@ -6,7 +6,9 @@
  *        Network stuff at the server-side.
  **/
 
+#include <algorithm>
 #include <thread>
+#include <mutex>
 #include <chrono>
 
 #include "Logger.h"
@@ -25,6 +27,8 @@ inline void close( SOCKET s )
 #else
 #  include <unistd.h> // close
 #  include <string.h> // strerror
+#  include <poll.h>
+#  include <sys/socket.h>
 #endif
 
  /// The common NO error return value
@@ -35,13 +39,15 @@ using namespace std;
 
 FTS::SocketConnectionWaiter::~SocketConnectionWaiter()
 {
-    close( m_listenSocket );
+    if( m_listenSocket > 0 )
+        close( m_listenSocket );
 }
 
-int FTS::SocketConnectionWaiter::init(std::uint16_t in_usPort, std::function<void( FTS::Connection* )> in_cb )
+int FTS::SocketConnectionWaiter::init(std::uint16_t in_usPort, std::function<void( FTS::Connection* )> in_cb, const ConnectionOptions &in_options )
 {
     m_cb = in_cb;
     m_port = in_usPort;
+    m_options = in_options;
     SOCKADDR_IN serverAddress;
 
     // Choose our options.
@@ -55,9 +61,23 @@ int FTS::SocketConnectionWaiter::init(std::uint16_t in_usPort, std::function<voi
         return -1;
     }
 
+    // The buffer sizes have to be known before the handshake, as they decide
+    // on the TCP window scale. The accepted sockets inherit them. Sharing
+    // the port has to be asked for before binding.
+    ConnectionOptions listenOptions;
+    listenOptions.iSendBufSize = m_options.iSendBufSize;
+    listenOptions.iRecvBufSize = m_options.iRecvBufSize;
+    listenOptions.bReusePort = m_options.bReusePort;
+    listenOptions.iIncomingCpu = m_options.iIncomingCpu;
+    TraditionalConnection::applySocketOptions(m_listenSocket, listenOptions);
+    // These are for the listener, not for the connections accepted.
+    m_options.bReusePort = false;
+    m_options.iIncomingCpu = -1;
+
     if(::bind(m_listenSocket, (sockaddr *) & serverAddress, sizeof(serverAddress)) < 0) {
         FTSMSG("[ERROR] socket bind: "+string(strerror(errno)), MsgType::Error);
         close(m_listenSocket);
+        m_listenSocket = 0;
         return -2;
     }
 
@@ -67,6 +87,7 @@ int FTS::SocketConnectionWaiter::init(std::uint16_t in_usPort, std::function<voi
     if(listen(m_listenSocket, 100) < 0) {
         FTSMSG("[ERROR] socket listen: "+string(strerror(errno)), MsgType::Error);
         close(m_listenSocket);
+        m_listenSocket = 0;
         return -3;
     }
 
@@ -74,8 +95,21 @@ int FTS::SocketConnectionWaiter::init(std::uint16_t in_usPort, std::function<voi
     return ERR_OK;
 }
 
+/// How long to sleep at most when the listening socket is readable but
+/// accept gets nobody, as when out of file descriptors.
+#define D_ACCEPT_BACKOFF_MAX_MS 100
+/// The least time between two logs of the same failing accept.
+#define D_ACCEPT_ERROR_LOG_MS   5000
+
+/// Logs why accept failed, only once in D_ACCEPT_ERROR_LOG_MS for the same
+/// error, as it fails over and over while descriptors are out.
 void printSocketError()
 {
+    static std::mutex mtx;
+    static int lastErr = 0;
+    static std::chrono::steady_clock::time_point lastLog;
+    static std::uint64_t ulSuppressed = 0;
+
     if( errno == EAGAIN || errno == EWOULDBLOCK ) {
         return;
     } else {
@@ -84,44 +118,134 @@ void printSocketError()
         if( err == WSAEWOULDBLOCK ) {
             return ;
         }
-        FTSMSG( "[ERROR] socket accept: " + toString( err ), MsgType::Error );
+        std::string sErr = toString( err );
     #else
-        // Some error ... but continue waiting for a connection.
-        FTSMSG( "[ERROR] socket accept: " + string( strerror( errno ) ), MsgType::Error );
+        int err = errno;
+        std::string sErr = string( strerror( err ) );
     #endif
+        // Some error ... but continue waiting for a connection.
+        std::lock_guard<std::mutex> lock( mtx );
+        auto now = std::chrono::steady_clock::now();
+        if( err == lastErr && now - lastLog < std::chrono::milliseconds( D_ACCEPT_ERROR_LOG_MS ) ) {
+            ++ulSuppressed;
+            return;
+        }
+        if( ulSuppressed > 0 )
+            sErr += " (" + toString( ulSuppressed ) + " more not logged)";
+        FTSMSG( "[ERROR] socket accept: " + sErr, MsgType::Error );
+        lastErr = err;
+        lastLog = now;
+        ulSuppressed = 0;
     }
 }
 
+/// Waits for connections and hands them to the callback given to init.
+/** This sleeps in poll (select on windows) until the listening socket is
+ *  readable, so a connection is handed out as soon as it's there and
+ *  waiting doesn't cost any CPU. Then all the connections waiting are
+ *  accepted at once, the callback is called for each of them.
+ *
+ * \param in_ulMaxWaitMillisec How long to wait, FTSC_WAIT_FOREVER (or any
+ *                            negative) for ever.
+ *
+ * \return true if at least one connection has been handed to the callback.
+ */
 bool FTS::SocketConnectionWaiter::waitForThenDoConnection(std::int64_t in_ulMaxWaitMillisec)
 {
-    auto startTime = std::chrono::steady_clock::now();
-    // wait for connections a certain amount of time or infinitely.
+    using namespace std::chrono;
+    auto deadline = in_ulMaxWaitMillisec < 0 ? steady_clock::time_point::max() : steady_clock::now() + milliseconds( in_ulMaxWaitMillisec );
+    auto backoff = milliseconds( 1 );
     while(true) {
-        // Nothing correct got in time, bye.
-        auto nowTime = std::chrono::steady_clock::now();
-        auto diffTime = std::chrono::duration_cast<std::chrono::milliseconds>(nowTime - startTime).count();
-        if( diffTime >= in_ulMaxWaitMillisec )
+        int64_t iWaitMs = -1;
+        if( deadline != steady_clock::time_point::max() ) {
+            auto now = steady_clock::now();
+            auto left = deadline > now ? deadline - now : steady_clock::duration::zero();
+            // Rounded up, so we don't wake up just before the deadline.
+            iWaitMs = std::min<int64_t>( duration_cast<milliseconds>( left + milliseconds( 1 ) - nanoseconds( 1 ) ).count(), INT32_MAX );
+        }
+
+#if defined(_WIN32)
+        fd_set fds;
+        FD_ZERO( &fds );
+        FD_SET( m_listenSocket, &fds );
+        timeval tv = { (long)(iWaitMs / 1000), (long)(iWaitMs % 1000) * 1000 };
+        int serr = ::select( 1, &fds, NULL, NULL, iWaitMs < 0 ? NULL : &tv );
+        if( serr == SOCKET_ERROR && WSAGetLastError() == WSAEINTR )
+            continue;
+#else
+        pollfd pfd;
+        pfd.fd = m_listenSocket;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int serr = ::poll( &pfd, 1, (int)iWaitMs );
+        if( serr == SOCKET_ERROR && errno == EINTR )
+            continue;
+#endif
+        if( serr == SOCKET_ERROR ) {
+            FTSMSG("Net: error during select: {1} ({2})", MsgType::Error, std::string(strerror(errno)), toString(errno));
+            return false;
+        }
+        if( serr == 0 ) {
+            // Nothing correct got in time, bye.
             return false;
+        }
 
-        SOCKADDR_IN clientAddress;
-        socklen_t iClientAddressSize = sizeof( clientAddress );
-        SOCKET connectSocket = accept( m_listenSocket, (sockaddr *) & clientAddress, &iClientAddressSize );
-        if( connectSocket != -1 ) {
+        ++m_acceptStats.wakeups;
+        bool bGotOne = false;
+        while( Connection *pCon = this->acceptIfAny() ) {
             // Yeah, we got someone !
-
-            // Build up a class that will work this connection.
-            Connection *pCon = new TraditionalConnection( connectSocket, clientAddress );
             m_cb( pCon );
-            return true;
-        } else {
-            printSocketError();
-            // Even if an error occured we don't leave.
-            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
-            continue;
+            bGotOne = true;
         }
+        if( bGotOne )
+            return true;
+
+        // Readable but nobody to accept: the client gave up already, or an
+        // error like running out of descriptors, which poll would report
+        // again at once. So wait longer each time, for what's left at most.
+        auto now = steady_clock::now();
+        if( now >= deadline )
+            return false;
+        std::this_thread::sleep_for( deadline == steady_clock::time_point::max() ? backoff : std::min<steady_clock::duration>( backoff, deadline - now ) );
+        backoff = std::min( backoff * 2, milliseconds( D_ACCEPT_BACKOFF_MAX_MS ) );
+    }
+}
+
+/// Accepts a connection, if there is one waiting.
+/** This doesn't wait and doesn't call the callback given to init, it's how
+ *  event loops accept when the listening socket is readable.
+ *
+ * \return The new connection, or NULL if nobody is waiting or accept failed.
+ */
+Connection *FTS::SocketConnectionWaiter::acceptIfAny()
+{
+    SOCKADDR_IN clientAddress;
+    socklen_t iClientAddressSize = sizeof( clientAddress );
+    ++m_acceptStats.acceptCalls;
+#if defined(__linux__)
+    // Sets what the connection needs in the same system call.
+    SOCKET connectSocket = accept4( m_listenSocket, (sockaddr *) & clientAddress, &iClientAddressSize, SOCK_NONBLOCK | SOCK_CLOEXEC );
+#else
+    SOCKET connectSocket = accept( m_listenSocket, (sockaddr *) & clientAddress, &iClientAddressSize );
+#endif
+    if( connectSocket == -1 ) {
+        printSocketError();
+        return nullptr;
     }
+    ++m_acceptStats.accepted;
 
-    // Should never come here.
-    return false;
+    return this->newConnection( connectSocket, clientAddress );
+}
+
+/// Builds up the class that will work an accepted connection.
+/**
+ * \param in_sock The accepted socket, non-blocking.
+ * \param in_sa The address of the counterpart.
+ *
+ * \return The new connection.
+ */
+Connection *FTS::SocketConnectionWaiter::newConnection( SOCKET in_sock, const sockaddr_in &in_sa )
+{
+    return new TraditionalConnection( in_sock, in_sa, m_options );
 }
 
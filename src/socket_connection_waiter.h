@@ -16,6 +16,7 @@
 #else
  // windows compatibility.
 using SOCKET = int;
+struct sockaddr_in;
 #endif
 
 namespace FTS {
@@ -25,13 +26,20 @@ public:
     SocketConnectionWaiter() {};
     ~SocketConnectionWaiter();
 
-    int init(std::uint16_t in_usPort, std::function<void( FTS::Connection* )> in_cb );
+    int init(std::uint16_t in_usPort, std::function<void( FTS::Connection* )> in_cb, const ConnectionOptions &in_options = ConnectionOptions() );
     bool waitForThenDoConnection(std::int64_t in_ulMaxWaitMillisec = FTSC_TIME_OUT);
+    virtual Connection *acceptIfAny();
+    SOCKET getSocket() const { return m_listenSocket; }
+    /// The kind of connections accepted, see ConnectionWaiter::create.
+    virtual ConnectionType getType() const { return ConnectionType::SOCKET; }
 
 protected:
+    virtual Connection *newConnection( SOCKET in_sock, const sockaddr_in &in_sa );
+
     SOCKET m_listenSocket = 0;   ///< The socket that has been prepared for listening.
     unsigned short m_port = 0;   ///< For debugging hold the port no we listening.
     std::function<void( FTS::Connection* )> m_cb;
+    ConnectionOptions m_options; ///< Applied to every connection accepted.
 };
 
 } // namespace FTSSrv2
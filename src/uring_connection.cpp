@@ -0,0 +1,375 @@
+/**
+ * \file uring_connection.cpp
+ * \brief This file implements the connection that does its I/O through
+ *        io_uring.
+ **/
+
+#include "uring_connection.h"
+
+#if defined(FTS_NET_HAVE_URING)
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <netinet/tcp.h>
+
+#include "Logger.h"
+
+#ifndef IOV_MAX
+#  define IOV_MAX 1024
+#endif
+
+using namespace FTS;
+
+/// What the completions of a connection are for.
+#define D_URING_TAG_RECV   1
+#define D_URING_TAG_SEND   2
+#define D_URING_TAG_CANCEL 3
+
+/// A receive, a send and a cancel are submitted at most.
+#define D_URING_CONNECTION_ENTRIES 4
+
+/** Connects, then sets up the ring.
+ *
+ * \param in_sName The name or IP of the server.
+ * \param in_usPort The port of the server.
+ * \param in_ulTimeoutInMillisec How long to try connecting.
+ * \param in_options The tuning of the socket.
+ */
+FTS::UringConnection::UringConnection(const std::string &in_sName, std::uint16_t in_usPort, std::uint64_t in_ulTimeoutInMillisec, const ConnectionOptions &in_options)
+    : TraditionalConnection(in_sName, in_usPort, in_ulTimeoutInMillisec, in_options)
+    , m_ring(D_URING_CONNECTION_ENTRIES)
+{
+    this->setupRing();
+}
+
+/** Takes over an accepted socket, then sets up the ring.
+ *
+ * \param in_sock The socket.
+ * \param in_sa The address of the counterpart.
+ * \param in_options The tuning of the socket.
+ */
+FTS::UringConnection::UringConnection(SOCKET in_sock, SOCKADDR_IN in_sa, const ConnectionOptions &in_options)
+    : TraditionalConnection(in_sock, in_sa, in_options)
+    , m_ring(D_URING_CONNECTION_ENTRIES)
+{
+    this->setupRing();
+}
+
+/** Closes the connection, after the kernel is done with the buffers.
+ */
+FTS::UringConnection::~UringConnection()
+{
+    this->disconnect();
+}
+
+/** Registers the receive buffer and switches the socket to blocking mode:
+ *  io_uring would hand back EAGAIN instead of waiting on a non-blocking one.
+ */
+void FTS::UringConnection::setupRing()
+{
+    if( !m_bConnected ) {
+        return;
+    }
+    if( !m_ring.isValid() ) {
+        static std::atomic<bool> bWarned( false );
+        if( !bWarned.exchange( true ) ) {
+            FTSMSG( "Net: io_uring is not available, the connections use poll instead.", MsgType::Warning );
+        }
+        return;
+    }
+
+    m_fixedBuf.resize( D_RECV_BUFFER_LEN );
+    iovec vec;
+    vec.iov_base = m_fixedBuf.data();
+    vec.iov_len = m_fixedBuf.size();
+    m_bFixed = m_ring.registerBuffers( &vec, 1 );
+
+    setSocketBlocking( m_sock, true );
+    m_bUring = true;
+}
+
+/** Closes the connection. The receive still submitted is cancelled first,
+ *  as the kernel keeps the socket open as long as it is.
+ */
+void FTS::UringConnection::disconnect()
+{
+    if( m_bUring ) {
+        if( m_bConnected ) {
+            this->flushSendBuffer();
+        }
+        this->cancelAndWait( D_URING_TAG_RECV, m_bRecvPending );
+        m_uiFixedBegin = m_uiFixedEnd = 0;
+        m_iRecvError = 1;
+    }
+    TraditionalConnection::disconnect();
+}
+
+/** Submits a receive into the registered buffer.
+ *
+ * \return false if the ring is full, which can't happen.
+ */
+bool FTS::UringConnection::postRecv()
+{
+    io_uring_sqe *pSqe = m_ring.getSqe();
+    if( pSqe == nullptr ) {
+        return false;
+    }
+
+    pSqe->opcode = m_bFixed ? IORING_OP_READ_FIXED : IORING_OP_RECV;
+    pSqe->fd = m_sock;
+    pSqe->addr = (std::uint64_t) (uintptr_t) m_fixedBuf.data();
+    pSqe->len = (std::uint32_t) m_fixedBuf.size();
+    pSqe->buf_index = 0;
+    pSqe->user_data = D_URING_TAG_RECV;
+    m_bRecvPending = true;
+    return true;
+}
+
+/** Takes all completions there are and notes their results.
+ */
+void FTS::UringConnection::reap()
+{
+    io_uring_cqe cqe;
+    while( m_ring.peekCqe( cqe ) ) {
+        switch( cqe.user_data ) {
+        case D_URING_TAG_RECV:
+            m_bRecvPending = false;
+            if( cqe.res > 0 ) {
+                m_uiFixedBegin = 0;
+                m_uiFixedEnd = (std::size_t) cqe.res;
+            } else if( cqe.res != -EAGAIN && cqe.res != -EINTR && cqe.res != -ECANCELED ) {
+                m_iRecvError = cqe.res;
+            }
+            break;
+        case D_URING_TAG_SEND:
+            m_bSendPending = false;
+            m_iSendResult = cqe.res;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/** Cancels a submitted operation and waits until the kernel is done with it.
+ *
+ * \param in_tag The operation.
+ * \param io_bPending Whether it is still submitted, reset by reap.
+ */
+void FTS::UringConnection::cancelAndWait(std::uint64_t in_tag, bool &io_bPending)
+{
+    this->reap();
+    if( !io_bPending ) {
+        return;
+    }
+
+    io_uring_sqe *pSqe = m_ring.getSqe();
+    if( pSqe != nullptr ) {
+        pSqe->opcode = IORING_OP_ASYNC_CANCEL;
+        pSqe->addr = in_tag;
+        pSqe->user_data = D_URING_TAG_CANCEL;
+    }
+    while( io_bPending ) {
+        if( m_ring.submitAndWait( 1, Deadline::max() ) < 0 ) {
+            break;
+        }
+        this->reap();
+    }
+}
+
+/// Receives whatever is there, up to some amount of data, see TraditionalConnection::recvSome.
+/** This hands out what the submitted receive got into the registered
+ *  buffer. If there is nothing, it submits a receive (unless there is one)
+ *  and waits for it in the same system call.
+ */
+FTSC_ERR FTS::UringConnection::recvSome(void *out_pBuf, std::size_t in_uiLen, std::size_t &out_uiGot, Deadline in_deadline)
+{
+    if( !m_bUring ) {
+        return TraditionalConnection::recvSome( out_pBuf, in_uiLen, out_uiGot, in_deadline );
+    }
+
+    out_uiGot = 0;
+    while( true ) {
+        this->reap();
+        if( m_uiFixedEnd > m_uiFixedBegin ) {
+            out_uiGot = std::min( in_uiLen, m_uiFixedEnd - m_uiFixedBegin );
+            memcpy( out_pBuf, m_fixedBuf.data() + m_uiFixedBegin, out_uiGot );
+            m_uiFixedBegin += out_uiGot;
+            m_ioStats.bytesReceived += out_uiGot;
+#if defined(TCP_QUICKACK)
+            if( m_options.bQuickAck ) {
+                int iOn = 1;
+                setsockopt( m_sock, IPPROTO_TCP, TCP_QUICKACK, &iOn, sizeof( iOn ) );
+            }
+#endif
+            return FTSC_ERR::OK;
+        }
+
+        if( m_iRecvError <= 0 ) {
+            if( m_iRecvError == 0 ) {
+                FTSMSG( "Net: could not recieve data: connection lost", MsgType::Error );
+            } else {
+                FTSMSG( "Net: could not recieve data: {1} ({2})", MsgType::Error, strerror( -m_iRecvError ), toString( -m_iRecvError ) );
+            }
+            this->disconnect();
+            return FTSC_ERR::RECEIVE;
+        }
+
+        // A submitted receive has had its chance, don't call the kernel
+        // only to learn that the time is over.
+        bool bTimeIsOver = in_deadline <= std::chrono::steady_clock::now();
+        if( m_bRecvPending && bTimeIsOver ) {
+            return FTSC_ERR::TIMEOUT;
+        }
+        if( !m_bRecvPending && !this->postRecv() ) {
+            return FTSC_ERR::RECEIVE;
+        }
+
+        ++m_ioStats.recvCalls;
+        int iRet = m_ring.submitAndWait( bTimeIsOver ? 0 : 1, in_deadline );
+        if( iRet == -ETIME ) {
+            this->reap();
+            if( m_uiFixedEnd > m_uiFixedBegin || m_iRecvError <= 0 ) {
+                continue;
+            }
+            netlog( "Dropping due to timeout (allowed " + toString( m_maxWaitMillisec ) + " ms)!" );
+            return FTSC_ERR::TIMEOUT;
+        }
+        if( iRet < 0 ) {
+            FTSMSG( "Net: error during io_uring_enter: {1} ({2})", MsgType::Error, strerror( -iRet ), toString( -iRet ) );
+            return FTSC_ERR::SELECT;
+        }
+        if( bTimeIsOver ) {
+            this->reap();
+            if( m_uiFixedEnd == m_uiFixedBegin && m_iRecvError > 0 ) {
+                return FTSC_ERR::TIMEOUT;
+            }
+        }
+    }
+}
+
+/** Sends a piece of data, see TraditionalConnection::send.
+ */
+FTSC_ERR FTS::UringConnection::send( const void *in_pData, std::size_t in_uiLen )
+{
+    if( !m_bUring ) {
+        return TraditionalConnection::send( in_pData, in_uiLen );
+    }
+    if( !m_bConnected ) {
+        return FTSC_ERR::NOT_CONNECTED;
+    }
+
+    // Keep the order of the data.
+    auto err = this->flushSendBuffer();
+    if( err != FTSC_ERR::OK ) {
+        return err;
+    }
+
+    iovec vec;
+    vec.iov_base = const_cast<void *>( in_pData );
+    vec.iov_len = in_uiLen;
+    err = this->send( &vec, 1 );
+    if( err == FTSC_ERR::OK ) {
+        netlog2( "send", this, in_uiLen, (const char *)in_pData );
+    }
+    return err;
+}
+
+/** Waits until the kernel is done with the submitted send.
+ *
+ * \param in_deadline When to give up, the send is cancelled then.
+ *
+ * \return If successful:  OK, see m_iSendResult.
+ * \return If failed:      TIMEOUT or SELECT
+ */
+FTSC_ERR FTS::UringConnection::waitForSendCompletion(Deadline in_deadline)
+{
+    while( true ) {
+        int iRet = m_ring.submitAndWait( 1, in_deadline );
+        this->reap();
+        if( !m_bSendPending ) {
+            return FTSC_ERR::OK;
+        }
+        if( iRet == -ETIME ) {
+            // The kernel may still read the buffers, so wait for the cancel.
+            this->cancelAndWait( D_URING_TAG_SEND, m_bSendPending );
+            FTSMSG( "Net: could not send data: timed out after {1} ms", MsgType::Error, toString( m_maxWaitMillisec ) );
+            return FTSC_ERR::TIMEOUT;
+        }
+        if( iRet < 0 ) {
+            FTSMSG( "Net: error during io_uring_enter: {1} ({2})", MsgType::Error, strerror( -iRet ), toString( -iRet ) );
+            this->cancelAndWait( D_URING_TAG_SEND, m_bSendPending );
+            return FTSC_ERR::SELECT;
+        }
+    }
+}
+
+/** Sends the data of several buffers, see TraditionalConnection::send.
+ *  The receive for the response is submitted along with the send.
+ */
+FTSC_ERR FTS::UringConnection::send( IOVEC *io_pVecs, std::size_t in_nVecs )
+{
+    if( !m_bUring ) {
+        return TraditionalConnection::send( io_pVecs, in_nVecs );
+    }
+    if( !m_bConnected ) {
+        return FTSC_ERR::NOT_CONNECTED;
+    }
+
+    auto deadline = deadlineIn( m_maxWaitMillisec );
+    while( in_nVecs > 0 ) {
+        msghdr msg;
+        memset( &msg, 0, sizeof( msg ) );
+        msg.msg_iov = io_pVecs;
+        msg.msg_iovlen = std::min<size_t>( in_nVecs, IOV_MAX );
+
+        io_uring_sqe *pSqe = m_ring.getSqe();
+        if( pSqe == nullptr ) {
+            return FTSC_ERR::SEND;
+        }
+        pSqe->opcode = IORING_OP_SENDMSG;
+        pSqe->fd = m_sock;
+        pSqe->addr = (std::uint64_t) (uintptr_t) &msg;
+        pSqe->len = 1;
+        pSqe->msg_flags = MSG_NOSIGNAL;
+        pSqe->user_data = D_URING_TAG_SEND;
+        m_bSendPending = true;
+
+        // The counterpart will answer: have the receive waiting already.
+        if( !m_bRecvPending && m_uiFixedEnd == m_uiFixedBegin && m_iRecvError > 0 ) {
+            this->postRecv();
+        }
+
+        ++m_ioStats.sendCalls;
+        auto err = this->waitForSendCompletion( deadline );
+        if( err != FTSC_ERR::OK ) {
+            return err;
+        }
+        if( m_iSendResult == -EAGAIN || m_iSendResult == -EINTR ) {
+            continue;
+        }
+        if( m_iSendResult < 0 ) {
+            FTSMSG( "Net: could not send data: {1} ({2})", MsgType::Error, strerror( -m_iSendResult ), toString( -m_iSendResult ) );
+            return FTSC_ERR::SEND;
+        }
+
+        size_t uiSent = (size_t) m_iSendResult;
+        m_ioStats.bytesSent += uiSent;
+        // Skip what has been sent, the kernel may have taken only a part.
+        while( in_nVecs > 0 && uiSent >= io_pVecs[0].iov_len ) {
+            uiSent -= io_pVecs[0].iov_len;
+            ++io_pVecs;
+            --in_nVecs;
+        }
+        if( in_nVecs > 0 && uiSent > 0 ) {
+            io_pVecs[0].iov_base = (std::int8_t *) io_pVecs[0].iov_base + uiSent;
+            io_pVecs[0].iov_len -= uiSent;
+        }
+    }
+
+    return FTSC_ERR::OK;
+}
+
+#endif /* FTS_NET_HAVE_URING */
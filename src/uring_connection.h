@@ -0,0 +1,77 @@
+/**
+ * \file uring_connection.h
+ * \brief This file describes the connection that does its I/O through
+ *        io_uring.
+ **/
+
+#ifndef FTS_URINGCONNECTION_H
+#define FTS_URINGCONNECTION_H
+
+#include "TraditionalConnection.h"
+#include "uring_ring.h"
+
+#if defined(FTS_NET_HAVE_URING)
+
+namespace FTS {
+
+/// A TCP/IP connection whose sends and receives go through io_uring.
+/** It is a TraditionalConnection in all but the system calls: the packets,
+ *  the queue, cork and the requests work the same.\n
+ *  Each connection has its own small ring and a receive buffer registered
+ *  with the kernel. There is always a receive submitted: a send submits the
+ *  receive for the response along with it in the same system call, and a
+ *  receive that timed out stays submitted for the next one. So a request
+ *  and its response take two system calls, where poll takes four.\n
+ *  The ring is the connection's own on purpose: its calls block until its
+ *  own I/O is done, and it may be handed to another thread (e.g. by a
+ *  WorkerPool) with a receive still submitted. A ring shared by a thread
+ *  would have each wait take the completions of the others and lose the
+ *  submitted receive on a move. This costs a descriptor and a pinned
+ *  buffer per connection and batches nothing across connections, so for
+ *  many connections on one thread, a Reactor is the better choice.\n
+ *  Connecting is done the traditional way. If the kernel has no io_uring
+ *  (or forbids it), everything is done the traditional way.
+ **/
+class UringConnection : public TraditionalConnection {
+public:
+    UringConnection(const std::string &in_sName, std::uint16_t in_usPort, std::uint64_t in_ulTimeoutInMillisec, const ConnectionOptions &in_options = ConnectionOptions());
+    UringConnection(SOCKET in_sock, SOCKADDR_IN in_sa, const ConnectionOptions &in_options = ConnectionOptions());
+    virtual ~UringConnection();
+
+    eConnectionType getType() const { return eConnectionType::D_CONNECTION_URING; }
+    virtual void disconnect();
+
+    /// Whether io_uring is used, or the traditional way as a fall back.
+    bool isUsingUring() const { return m_bUring; }
+
+protected:
+    virtual FTSC_ERR recvSome(void *out_pBuf, std::size_t in_uiLen, std::size_t &out_uiGot, Deadline in_deadline);
+    virtual FTSC_ERR send( const void *in_pData, std::size_t in_uiLen );
+    virtual FTSC_ERR send( IOVEC *io_pVecs, std::size_t in_nVecs );
+
+private:
+    void setupRing();
+    bool postRecv();
+    void reap();
+    FTSC_ERR waitForSendCompletion(Deadline in_deadline);
+    void cancelAndWait(std::uint64_t in_tag, bool &io_bPending);
+
+    UringRing m_ring;                   ///< This connection's io_uring.
+    std::vector<std::int8_t> m_fixedBuf; ///< The receive buffer registered with the kernel.
+    bool m_bUring = false;              ///< Whether io_uring is used at all.
+    bool m_bFixed = false;              ///< Whether m_fixedBuf has been registered.
+    bool m_bRecvPending = false;        ///< Whether a receive has been submitted and not completed.
+    bool m_bSendPending = false;        ///< Whether a send has been submitted and not completed.
+    int m_iRecvError = 1;               ///< The result of a failed receive (<= 0), 1 if none.
+    int m_iSendResult = 0;              ///< The result of the last send.
+    std::size_t m_uiFixedBegin = 0;     ///< The first byte of m_fixedBuf not handed out yet.
+    std::size_t m_uiFixedEnd = 0;       ///< Behind the last byte received into m_fixedBuf.
+};
+
+}
+
+#endif /* FTS_NET_HAVE_URING */
+
+#endif /* FTS_URINGCONNECTION_H */
+
+ /* EOF */
@@ -0,0 +1,191 @@
+/**
+ * \file uring_connection_waiter.cpp
+ * \brief This file implements the connection waiter that accepts through
+ *        io_uring.
+ **/
+
+#include "uring_connection_waiter.h"
+
+#if defined(FTS_NET_HAVE_URING)
+
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Logger.h"
+#include "uring_connection.h"
+
+using namespace FTS;
+
+/// What the completions of a waiter are for.
+#define D_URING_TAG_ACCEPT 1
+#define D_URING_TAG_CANCEL 2
+#define D_URING_TAG_POLL   3
+
+FTS::UringConnectionWaiter::UringConnectionWaiter()
+    : m_ring(2)
+{
+    memset( &m_acceptAddr, 0, sizeof( m_acceptAddr ) );
+}
+
+/** Cancels the submitted accept before the socket is closed: the kernel
+ *  would keep it listening otherwise.
+ */
+FTS::UringConnectionWaiter::~UringConnectionWaiter()
+{
+    this->reap();
+    if( m_bAcceptPending ) {
+        io_uring_sqe *pSqe = m_ring.getSqe();
+        pSqe->opcode = IORING_OP_ASYNC_CANCEL;
+        pSqe->addr = m_bPollPending ? D_URING_TAG_POLL : D_URING_TAG_ACCEPT;
+        pSqe->user_data = D_URING_TAG_CANCEL;
+        while( m_bAcceptPending && m_ring.submitAndWait( 1, UringRing::Deadline::max() ) == 0 ) {
+            this->reap();
+        }
+    }
+    if( m_iAccepted >= 0 ) {
+        close( m_iAccepted );
+    }
+}
+
+/** Starts listening, see SocketConnectionWaiter::init.
+ */
+int FTS::UringConnectionWaiter::init(std::uint16_t in_usPort, std::function<void( FTS::Connection* )> in_cb, const ConnectionOptions &in_options)
+{
+    int iRet = SocketConnectionWaiter::init( in_usPort, in_cb, in_options );
+    if( iRet != 0 || !m_ring.isValid() ) {
+        return iRet;
+    }
+
+    // The listening socket stays non-blocking, so acceptIfAny never waits.
+    m_bUring = true;
+    return iRet;
+}
+
+/** Accepts a connection, if there is one waiting, see
+ *  SocketConnectionWaiter::acceptIfAny. A connection the submitted accept
+ *  got comes first.
+ *
+ * \return The new connection, or NULL if nobody is waiting or accept failed.
+ */
+Connection *FTS::UringConnectionWaiter::acceptIfAny()
+{
+    if( m_bUring ) {
+        this->reap();
+        if( m_iAccepted >= 0 ) {
+            ++m_acceptStats.accepted;
+            Connection *pCon = this->newConnection( m_iAccepted, m_acceptAddr );
+            m_iAccepted = -1;
+            return pCon;
+        }
+    }
+    return SocketConnectionWaiter::acceptIfAny();
+}
+
+/** Builds up a UringConnection for an accepted socket.
+ *
+ * \param in_sock The accepted socket.
+ * \param in_sa The address of the counterpart.
+ *
+ * \return The new connection.
+ */
+Connection *FTS::UringConnectionWaiter::newConnection( SOCKET in_sock, const sockaddr_in &in_sa )
+{
+    return new UringConnection( in_sock, in_sa, m_options );
+}
+
+/** Takes all completions there are and notes their results.
+ */
+void FTS::UringConnectionWaiter::reap()
+{
+    io_uring_cqe cqe;
+    while( m_ring.peekCqe( cqe ) ) {
+        if( cqe.user_data == D_URING_TAG_POLL ) {
+            // Readable, the accept submitted next finds the connection.
+            m_bAcceptPending = m_bPollPending = false;
+            continue;
+        }
+        if( cqe.user_data != D_URING_TAG_ACCEPT ) {
+            continue;
+        }
+
+        m_bAcceptPending = false;
+        if( cqe.res >= 0 ) {
+            m_iAccepted = cqe.res;
+        } else if( cqe.res == -EAGAIN ) {
+            // Older kernels don't wait on a non-blocking socket, poll does.
+            m_bPollFirst = true;
+        } else if( cqe.res != -ECANCELED && cqe.res != -EINTR ) {
+            // Some error ... but continue waiting for a connection.
+            FTSMSG( "[ERROR] socket accept: " + std::string( strerror( -cqe.res ) ), MsgType::Error );
+        }
+    }
+}
+
+/** Waits for connections and hands all that are waiting to the callback,
+ *  see SocketConnectionWaiter::waitForThenDoConnection. The first one is
+ *  accepted by io_uring, the others by acceptIfAny.
+ *
+ * \param in_ulMaxWaitMillisec How long to wait, FTSC_WAIT_FOREVER (or any
+ *                            negative) for ever.
+ *
+ * \return true if at least one connection has been handed to the callback.
+ */
+bool FTS::UringConnectionWaiter::waitForThenDoConnection(std::int64_t in_ulMaxWaitMillisec)
+{
+    if( !m_bUring ) {
+        return SocketConnectionWaiter::waitForThenDoConnection( in_ulMaxWaitMillisec );
+    }
+
+    auto deadline = in_ulMaxWaitMillisec < 0 ? UringRing::Deadline::max() : std::chrono::steady_clock::now() + std::chrono::milliseconds( in_ulMaxWaitMillisec );
+    while( true ) {
+        this->reap();
+        if( m_iAccepted >= 0 ) {
+            // Yeah, we got someone ! And maybe more behind it.
+            ++m_acceptStats.wakeups;
+            while( Connection *pCon = this->acceptIfAny() ) {
+                m_cb( pCon );
+            }
+            return true;
+        }
+
+        if( !m_bAcceptPending && m_bPollFirst ) {
+            io_uring_sqe *pSqe = m_ring.getSqe();
+            pSqe->opcode = IORING_OP_POLL_ADD;
+            pSqe->fd = m_listenSocket;
+            pSqe->poll32_events = POLLIN;
+            pSqe->user_data = D_URING_TAG_POLL;
+            m_bAcceptPending = m_bPollPending = true;
+            m_bPollFirst = false;
+        } else if( !m_bAcceptPending ) {
+            io_uring_sqe *pSqe = m_ring.getSqe();
+            m_acceptAddrLen = sizeof( m_acceptAddr );
+            pSqe->opcode = IORING_OP_ACCEPT;
+            pSqe->fd = m_listenSocket;
+            pSqe->addr = (std::uint64_t) (uintptr_t) &m_acceptAddr;
+            pSqe->addr2 = (std::uint64_t) (uintptr_t) &m_acceptAddrLen;
+            pSqe->accept_flags = SOCK_CLOEXEC;
+            pSqe->user_data = D_URING_TAG_ACCEPT;
+            m_bAcceptPending = true;
+            ++m_acceptStats.acceptCalls;
+        }
+
+        int iRet = m_ring.submitAndWait( 1, deadline );
+        if( iRet == -ETIME ) {
+            this->reap();
+            if( m_iAccepted >= 0 ) {
+                continue;
+            }
+            // Nothing correct got in time, bye.
+            return false;
+        }
+        if( iRet < 0 ) {
+            FTSMSG( "Net: error during io_uring_enter: {1} ({2})", MsgType::Error, strerror( -iRet ), toString( -iRet ) );
+            return false;
+        }
+    }
+}
+
+#endif /* FTS_NET_HAVE_URING */
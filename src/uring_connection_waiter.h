@@ -0,0 +1,59 @@
+/**
+ * \file uring_connection_waiter.h
+ * \brief This file describes the connection waiter that accepts through
+ *        io_uring.
+ **/
+
+#ifndef FTS_URINGCONNECTIONWAITER_H
+#define FTS_URINGCONNECTIONWAITER_H
+
+#include "socket_connection_waiter.h"
+#include "uring_ring.h"
+
+#if defined(FTS_NET_HAVE_URING)
+
+#include <netinet/in.h>
+
+namespace FTS {
+
+/// Accepts through io_uring and hands out UringConnections.
+/** There is always an accept submitted: one that timed out stays submitted
+ *  for the next call, so waiting for a connection is one system call. The
+ *  connections that come in along with it are accepted by acceptIfAny,
+ *  which never waits, so the waiter can be used by a Reactor too.
+ *  If the kernel has no io_uring, it accepts the traditional way, the
+ *  connections are UringConnections anyway (which fall back on their own).
+ **/
+class UringConnectionWaiter : public SocketConnectionWaiter {
+public:
+    UringConnectionWaiter();
+    ~UringConnectionWaiter();
+
+    int init(std::uint16_t in_usPort, std::function<void( FTS::Connection* )> in_cb, const ConnectionOptions &in_options = ConnectionOptions() );
+    bool waitForThenDoConnection(std::int64_t in_ulMaxWaitMillisec = FTSC_TIME_OUT);
+    Connection *acceptIfAny();
+    ConnectionType getType() const { return ConnectionType::URING; }
+
+protected:
+    Connection *newConnection( SOCKET in_sock, const sockaddr_in &in_sa );
+
+private:
+    void reap();
+
+    UringRing m_ring;                   ///< The io_uring to accept with.
+    bool m_bUring = false;              ///< Whether io_uring is used.
+    bool m_bAcceptPending = false;      ///< Whether an accept (or poll) has been submitted and not completed.
+    bool m_bPollPending = false;        ///< Whether the one submitted is a poll.
+    bool m_bPollFirst = false;          ///< Whether to poll before the next accept, as the last one couldn't wait.
+    int m_iAccepted = -1;               ///< The socket accepted, not handed out yet, or the error.
+    sockaddr_in m_acceptAddr;           ///< The address of the counterpart accepted.
+    socklen_t m_acceptAddrLen = 0;      ///< Its length.
+};
+
+}
+
+#endif /* FTS_NET_HAVE_URING */
+
+#endif /* FTS_URINGCONNECTIONWAITER_H */
+
+ /* EOF */
@@ -0,0 +1,216 @@
+/**
+ * \file uring_ring.cpp
+ * \brief This file implements a minimal io_uring instance, driven by the raw
+ *        system calls.
+ **/
+
+#include "uring_ring.h"
+
+#if defined(FTS_NET_HAVE_URING)
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Logger.h"
+
+using namespace FTS;
+
+static int sys_io_uring_setup( unsigned in_uiEntries, io_uring_params *io_pParams )
+{
+    return (int) syscall( __NR_io_uring_setup, in_uiEntries, io_pParams );
+}
+
+static int sys_io_uring_enter( int in_fd, unsigned in_nSubmit, unsigned in_nWait, unsigned in_uiFlags, const void *in_pArg, std::size_t in_uiArgLen )
+{
+    return (int) syscall( __NR_io_uring_enter, in_fd, in_nSubmit, in_nWait, in_uiFlags, in_pArg, in_uiArgLen );
+}
+
+static int sys_io_uring_register( int in_fd, unsigned in_uiOpcode, const void *in_pArg, unsigned in_nArgs )
+{
+    return (int) syscall( __NR_io_uring_register, in_fd, in_uiOpcode, in_pArg, in_nArgs );
+}
+
+/** Sets up the instance and maps its queues.
+ *
+ * \param in_uiEntries The size of the submission queue, a power of 2.
+ */
+FTS::UringRing::UringRing( unsigned in_uiEntries )
+{
+    io_uring_params params;
+    memset( &params, 0, sizeof( params ) );
+    int fd = sys_io_uring_setup( in_uiEntries, &params );
+    if( fd < 0 ) {
+        FTSMSGDBG( "Net: io_uring is not available: {1}", 3, strerror( errno ) );
+        return;
+    }
+
+    // Without these, waiting with a time out is not possible.
+    if( !(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG) ) {
+        FTSMSGDBG( "Net: io_uring is too old, features {1}", 3, toString( params.features, -1, ' ', std::ios::hex ) );
+        close( fd );
+        return;
+    }
+
+    m_uiSqMapLen = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+    m_uiCqMapLen = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+    m_uiSqMapLen = m_uiCqMapLen = std::max( m_uiSqMapLen, m_uiCqMapLen );
+    m_pSqMap = mmap( nullptr, m_uiSqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+    if( m_pSqMap == MAP_FAILED ) {
+        FTSMSG( "Net: could not map the io_uring: {1}", MsgType::Error, strerror( errno ) );
+        m_pSqMap = nullptr;
+        close( fd );
+        return;
+    }
+    m_pCqMap = m_pSqMap;
+
+    m_uiSqesLen = params.sq_entries * sizeof( io_uring_sqe );
+    void *pSqes = mmap( nullptr, m_uiSqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+    if( pSqes == MAP_FAILED ) {
+        FTSMSG( "Net: could not map the io_uring: {1}", MsgType::Error, strerror( errno ) );
+        munmap( m_pSqMap, m_uiSqMapLen );
+        m_pSqMap = m_pCqMap = nullptr;
+        close( fd );
+        return;
+    }
+    m_pSqes = (io_uring_sqe *) pSqes;
+
+    auto pSq = (char *) m_pSqMap;
+    m_pSqHead = (unsigned *) (pSq + params.sq_off.head);
+    m_pSqTail = (unsigned *) (pSq + params.sq_off.tail);
+    m_pSqArray = (unsigned *) (pSq + params.sq_off.array);
+    m_uiSqMask = *(unsigned *) (pSq + params.sq_off.ring_mask);
+    m_uiSqEntries = params.sq_entries;
+    m_uiSqTail = *m_pSqTail;
+
+    auto pCq = (char *) m_pCqMap;
+    m_pCqHead = (unsigned *) (pCq + params.cq_off.head);
+    m_pCqTail = (unsigned *) (pCq + params.cq_off.tail);
+    m_uiCqMask = *(unsigned *) (pCq + params.cq_off.ring_mask);
+    m_pCqes = (io_uring_cqe *) (pCq + params.cq_off.cqes);
+
+    m_fd = fd;
+}
+
+/** Unmaps the queues and closes the instance. Whoever submitted must have
+ *  waited for the completions, the kernel may still write to the buffers
+ *  otherwise.
+ */
+FTS::UringRing::~UringRing()
+{
+    if( m_pSqes )
+        munmap( m_pSqes, m_uiSqesLen );
+    if( m_pSqMap )
+        munmap( m_pSqMap, m_uiSqMapLen );
+    if( m_fd >= 0 )
+        close( m_fd );
+}
+
+/** Takes a free submission entry.
+ *
+ * \return The cleared entry, or NULL if the queue is full. It is submitted
+ *         with the next submitAndWait.
+ */
+io_uring_sqe *FTS::UringRing::getSqe()
+{
+    unsigned head = __atomic_load_n( m_pSqHead, __ATOMIC_ACQUIRE );
+    if( m_uiSqTail - head >= m_uiSqEntries ) {
+        return nullptr;
+    }
+
+    unsigned idx = m_uiSqTail & m_uiSqMask;
+    io_uring_sqe *pSqe = &m_pSqes[idx];
+    memset( pSqe, 0, sizeof( *pSqe ) );
+    m_pSqArray[idx] = idx;
+    ++m_uiSqTail;
+    ++m_nToSubmit;
+    return pSqe;
+}
+
+/** Submits the entries taken and waits for completions, in one system call.
+ *
+ * \param in_uiWaitNr The completions to wait for, 0 to only submit.
+ * \param in_deadline When to give up waiting.
+ *
+ * \return 0 if successful, else -errno, -ETIME when the time is over. If
+ *         there is nothing to submit and nothing to wait for, the kernel
+ *         isn't called at all.
+ */
+int FTS::UringRing::submitAndWait( unsigned in_uiWaitNr, Deadline in_deadline )
+{
+    using namespace std::chrono;
+
+    unsigned nSubmit = m_nToSubmit;
+    if( nSubmit == 0 && in_uiWaitNr == 0 ) {
+        return 0;
+    }
+    __atomic_store_n( m_pSqTail, m_uiSqTail, __ATOMIC_RELEASE );
+    m_nToSubmit = 0;
+
+    unsigned uiFlags = in_uiWaitNr ? IORING_ENTER_GETEVENTS : 0;
+    __kernel_timespec ts;
+    io_uring_getevents_arg arg;
+    memset( &arg, 0, sizeof( arg ) );
+    if( in_uiWaitNr && in_deadline != Deadline::max() ) {
+        auto now = steady_clock::now();
+        auto left = in_deadline > now ? duration_cast<nanoseconds>( in_deadline - now ).count() : 0;
+        ts.tv_sec = left / 1000000000;
+        ts.tv_nsec = left % 1000000000;
+        arg.ts = (std::uint64_t) (uintptr_t) &ts;
+    }
+    arg.sigmask_sz = _NSIG / 8;
+    uiFlags |= IORING_ENTER_EXT_ARG;
+
+    while( true ) {
+        int iRet = sys_io_uring_enter( m_fd, nSubmit, in_uiWaitNr, uiFlags, &arg, sizeof( arg ) );
+        if( iRet >= 0 ) {
+            return 0;
+        }
+        // The kernel takes no more entries than there are, so submitting
+        // again after a signal is harmless.
+        if( errno == EINTR )
+            continue;
+        return -errno;
+    }
+}
+
+/** Takes the oldest completion.
+ *
+ * \param out_cqe Is set to the completion.
+ *
+ * \return false if there is none.
+ */
+bool FTS::UringRing::peekCqe( io_uring_cqe &out_cqe )
+{
+    unsigned head = *m_pCqHead;
+    if( head == __atomic_load_n( m_pCqTail, __ATOMIC_ACQUIRE ) ) {
+        return false;
+    }
+
+    out_cqe = m_pCqes[head & m_uiCqMask];
+    __atomic_store_n( m_pCqHead, head + 1, __ATOMIC_RELEASE );
+    return true;
+}
+
+/** Registers buffers with the kernel, for IORING_OP_READ_FIXED.
+ *
+ * \param in_pVecs The buffers, they must live as long as the ring.
+ * \param in_nVecs Their number.
+ *
+ * \return false if the kernel refused, e.g. because of RLIMIT_MEMLOCK.
+ */
+bool FTS::UringRing::registerBuffers( const iovec *in_pVecs, unsigned in_nVecs )
+{
+    if( sys_io_uring_register( m_fd, IORING_REGISTER_BUFFERS, in_pVecs, in_nVecs ) < 0 ) {
+        FTSMSGDBG( "Net: could not register the io_uring buffers: {1}", 3, strerror( errno ) );
+        return false;
+    }
+    return true;
+}
+
+#endif /* FTS_NET_HAVE_URING */
@@ -0,0 +1,79 @@
+/**
+ * \file uring_ring.h
+ * \brief This file describes a minimal io_uring instance, driven by the raw
+ *        system calls.
+ **/
+
+#ifndef FTS_URINGRING_H
+#define FTS_URINGRING_H
+
+#if defined(__linux__) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    define FTS_NET_HAVE_URING 1
+#  endif
+#endif
+
+#if defined(FTS_NET_HAVE_URING)
+
+#include <chrono>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+namespace FTS {
+
+/// One io_uring: a submission and a completion queue shared with the kernel.
+/** Only what the connections need is here, without liburing: take an entry
+ *  with getSqe, fill it in, and submit it together with all the others
+ *  taken since the last submit in one io_uring_enter. The completions are
+ *  then taken with peekCqe.\n
+ *  A kernel without io_uring (or without waiting with a time out, 5.11)
+ *  or a sandbox forbidding it makes isValid return false. The caller then
+ *  has to go the classic way.
+ **/
+class UringRing {
+public:
+    using Deadline = std::chrono::steady_clock::time_point;
+
+    explicit UringRing( unsigned in_uiEntries );
+    UringRing( const UringRing& ) = delete;
+    UringRing& operator=( const UringRing& ) = delete;
+    ~UringRing();
+
+    bool isValid() const { return m_fd >= 0; }
+
+    io_uring_sqe *getSqe();
+    int submitAndWait( unsigned in_uiWaitNr, Deadline in_deadline );
+    bool peekCqe( io_uring_cqe &out_cqe );
+    bool registerBuffers( const iovec *in_pVecs, unsigned in_nVecs );
+
+private:
+    int m_fd = -1;                      ///< The io_uring instance.
+    void *m_pSqMap = nullptr;           ///< The mapped submission queue ring.
+    std::size_t m_uiSqMapLen = 0;       ///< Its length.
+    void *m_pCqMap = nullptr;           ///< The mapped completion queue ring, may be m_pSqMap.
+    std::size_t m_uiCqMapLen = 0;       ///< Its length.
+    io_uring_sqe *m_pSqes = nullptr;    ///< The mapped submission entries.
+    std::size_t m_uiSqesLen = 0;        ///< Their length.
+
+    unsigned *m_pSqHead = nullptr;      ///< Moved by the kernel as it takes entries.
+    unsigned *m_pSqTail = nullptr;      ///< Moved by us as we add entries.
+    unsigned *m_pSqArray = nullptr;     ///< The index of each entry in m_pSqes.
+    unsigned m_uiSqMask = 0;            ///< The ring size - 1.
+    unsigned m_uiSqEntries = 0;         ///< The ring size.
+    unsigned m_uiSqTail = 0;            ///< Our tail, published on submit.
+    unsigned m_nToSubmit = 0;           ///< The entries taken since the last submit.
+
+    unsigned *m_pCqHead = nullptr;      ///< Moved by us as we take completions.
+    unsigned *m_pCqTail = nullptr;      ///< Moved by the kernel as it adds completions.
+    unsigned m_uiCqMask = 0;            ///< The ring size - 1.
+    io_uring_cqe *m_pCqes = nullptr;    ///< The completions.
+};
+
+}
+
+#endif /* FTS_NET_HAVE_URING */
+
+#endif /* FTS_URINGRING_H */
+
+ /* EOF */
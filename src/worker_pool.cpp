@@ -0,0 +1,210 @@
+/**
+ * \file worker_pool.cpp
+ * \brief This file implements the worker pool, which takes the new
+ *        connections off the accepting thread and serves them on the least
+ *        loaded worker.
+ **/
+
+#include <algorithm>
+
+#include "worker_pool.h"
+#include "Logger.h"
+
+using namespace FTS;
+
+/** Creates the workers, the threads are started with start.
+ *
+ * \param in_nWorkers The number of worker threads, 0 for one per core.
+ * \param in_uiQueueLen The most new connections waiting for each worker.
+ */
+FTS::WorkerPool::WorkerPool( unsigned in_nWorkers, std::size_t in_uiQueueLen )
+{
+    if( in_nWorkers == 0 ) {
+        in_nWorkers = std::max( 1u, std::thread::hardware_concurrency() );
+    }
+    for( unsigned i = 0; i < in_nWorkers; ++i ) {
+        m_workers.emplace_back( new Worker( in_uiQueueLen ) );
+    }
+}
+
+/** Stops the threads, then closes all connections, also the ones not taken
+ *  by a worker yet, without calling any callback.
+ */
+FTS::WorkerPool::~WorkerPool()
+{
+    this->stop();
+}
+
+/** Starts accepting connections. They are handed out once start has been
+ *  called, until then they wait in the backlog.
+ *
+ * \param in_pWaiter The waiter to accept with, the pool takes it over and
+ *                   calls its init.
+ * \param in_usPort The port to listen on.
+ * \param in_onConnection Gets every new connection on the thread of the
+ *                        worker it has been given to, e.g. to add it to the
+ *                        worker's reactor.
+ * \param in_options The socket options of the new connections.
+ *
+ * \return What ConnectionWaiter::init returns, 0 on success.
+ */
+int FTS::WorkerPool::listen( ConnectionWaiter* in_pWaiter, std::uint16_t in_usPort, ConnectionCallback in_onConnection, const ConnectionOptions& in_options )
+{
+    if( m_bRunning ) {
+        FTSMSG( "Net: the worker pool has to be stopped to listen.", MsgType::Error );
+        delete in_pWaiter;
+        return -1;
+    }
+
+    m_onConnection = std::move( in_onConnection );
+    m_pWaiter.reset( in_pWaiter );
+    return m_pWaiter->init( in_usPort, [this]( Connection* in_pCon ) { this->dispatch( in_pCon ); }, in_options );
+}
+
+/** Hands a connection to the worker with the least load. This may be called
+ *  from any thread and never waits.
+ *
+ * \param in_pCon The new connection, the pool takes it over.
+ *
+ * \return false if all the queues are full, then the connection has been
+ *         closed and counted in getDropped.
+ */
+bool FTS::WorkerPool::dispatch( Connection* in_pCon )
+{
+    if( in_pCon == nullptr ) {
+        return false;
+    }
+
+    Worker *pBest = m_workers[0].get();
+    for( auto& pWorker : m_workers ) {
+        if( pWorker->nLoad.load( std::memory_order_relaxed ) < pBest->nLoad.load( std::memory_order_relaxed ) ) {
+            pBest = pWorker.get();
+        }
+    }
+    if( this->handTo( *pBest, in_pCon ) ) {
+        return true;
+    }
+
+    // Its queue is full, anybody else will do.
+    for( auto& pWorker : m_workers ) {
+        if( pWorker.get() != pBest && this->handTo( *pWorker, in_pCon ) ) {
+            return true;
+        }
+    }
+
+    ++m_nDropped;
+    FTSMSGDBG( "Net: all worker queues are full, closing the new connection.", 2 );
+    delete in_pCon;
+    return false;
+}
+
+/** Starts the worker threads and the accepting thread, if listening.
+ *  Nothing happens if they are running already.
+ */
+void FTS::WorkerPool::start()
+{
+    if( m_bRunning ) {
+        return;
+    }
+    m_bRunning = true;
+    m_bStop = false;
+
+    for( auto& pWorker : m_workers ) {
+        Worker *pW = pWorker.get();
+        pW->thread = std::thread( [this, pW] { this->work( *pW ); } );
+    }
+    if( m_pWaiter ) {
+        m_acceptor = std::thread( [this] {
+            while( !m_bStop ) {
+                m_pWaiter->waitForThenDoConnection( D_WORKER_POOL_ACCEPT_WAIT_MS );
+            }
+        } );
+    }
+}
+
+/** Stops all threads and waits for them, which takes up to
+ *  D_WORKER_POOL_ACCEPT_WAIT_MS when listening. The connections stay with
+ *  their workers, start serves them again.
+ */
+void FTS::WorkerPool::stop()
+{
+    if( !m_bRunning ) {
+        return;
+    }
+
+    m_bStop = true;
+    // No new connections while the workers stop.
+    if( m_acceptor.joinable() ) {
+        m_acceptor.join();
+    }
+    for( auto& pWorker : m_workers ) {
+        pWorker->reactor.getLoop().wake();
+    }
+    for( auto& pWorker : m_workers ) {
+        pWorker->thread.join();
+    }
+    m_bRunning = false;
+}
+
+/** Queues a connection for a worker and wakes the worker up.
+ *
+ * \param io_worker The worker.
+ * \param in_pCon The connection.
+ *
+ * \return false if the worker's queue is full.
+ */
+bool FTS::WorkerPool::handTo( Worker& io_worker, Connection* in_pCon )
+{
+    // Counted first, so the next dispatch sees it even before it's queued.
+    ++io_worker.nLoad;
+    if( !io_worker.queue.push( in_pCon ) ) {
+        --io_worker.nLoad;
+        return false;
+    }
+    io_worker.reactor.getLoop().wake();
+    return true;
+}
+
+/** Serves the worker's connections until stop is called, on its thread.
+ *
+ * \param io_worker The worker.
+ */
+void FTS::WorkerPool::work( Worker& io_worker )
+{
+    // The ones handed out while stopped first.
+    this->takeNew( io_worker );
+    while( !m_bStop ) {
+        io_worker.reactor.runOnce( -1 );
+        this->takeNew( io_worker );
+    }
+}
+
+/** Hands the connections queued for a worker to the callback, and updates
+ *  the worker's load.
+ *
+ * \param io_worker The worker.
+ */
+void FTS::WorkerPool::takeNew( Worker& io_worker )
+{
+    std::size_t nTaken = 0;
+    while( Connection *pCon = io_worker.queue.pop() ) {
+        ++nTaken;
+        if( m_onConnection ) {
+            m_onConnection( io_worker.reactor, pCon );
+        } else {
+            delete pCon;
+        }
+    }
+
+    // What has been taken but isn't served, and what has been lost, doesn't
+    // count anymore. The callbacks may add connections of their own too, so
+    // this may as well be negative.
+    std::size_t uiServed = io_worker.reactor.getConnectionCount();
+    std::size_t uiGone = io_worker.uiServed + nTaken - uiServed;
+    io_worker.uiServed = uiServed;
+    if( uiGone != 0 ) {
+        io_worker.nLoad -= uiGone;
+    }
+}
+
+ /* EOF */
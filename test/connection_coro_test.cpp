@@ -0,0 +1,144 @@
+#include "catch.hpp"
+#include "../include/connection_coro.h"
+#include "../include/dsrv_constants.h"
+#include "../src/socket_connection_waiter.h"
+#include <thread>
+#include <vector>
+
+using namespace FTS;
+using namespace std;
+
+// Echoes every packet but PLAYER_SET, which is answered by a LOGIN first.
+static Task<void> echoSession( AsyncConnection* in_pConn, int& out_nSessionsDone )
+{
+    unique_ptr<AsyncConnection> pConn( in_pConn );
+    while( PacketPtr p = co_await pConn->receive( 2000 ) ) {
+        if( p->getType() == DSRV_MSG_PLAYER_SET ) {
+            Packet question( DSRV_MSG_LOGIN );
+            question.append( (uint32_t) 7 );
+            PacketPtr pAnswer = co_await pConn->request( question, 2000 );
+            REQUIRE( pAnswer != nullptr );
+        }
+        pConn->getConnection().send( p.get() );
+    }
+    ++out_nSessionsDone;
+}
+
+static Task<void> acceptor( EventLoop& in_loop, AsyncConnectionWaiter& in_waiter, int in_nSessions, int& out_nSessionsDone )
+{
+    for( int i = 0; i < in_nSessions; ++i ) {
+        Connection* pCon = co_await in_waiter.accept( 2000 );
+        REQUIRE( pCon != nullptr );
+        spawn( echoSession( new AsyncConnection( in_loop, pCon ), out_nSessionsDone ) );
+    }
+}
+
+TEST_CASE( "One loop serves many coroutine sessions", "[AsyncConnection]" )
+{
+    const int nSessions = 8;
+
+    // Ports of earlier runs may still be in TIME_WAIT.
+    EventLoop loop;
+    auto pWaiter = ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET );
+    uint16_t usPort = 33190;
+    while( pWaiter->init( usPort, []( Connection* ) {} ) != 0 && usPort < 33210 ) {
+        delete pWaiter;
+        pWaiter = ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET );
+        ++usPort;
+    }
+    REQUIRE( usPort < 33210 );
+    AsyncConnectionWaiter waiter( loop, pWaiter );
+
+    int nSessionsDone = 0;
+    spawn( acceptor( loop, waiter, nSessions, nSessionsDone ) );
+
+    thread clients( [&] {
+        vector<unique_ptr<Connection>> cons;
+        for( int i = 0; i < nSessions; ++i ) {
+            cons.emplace_back( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 2000 ) );
+        }
+
+        // All sessions are open at once, each one is served in turn.
+        for( uint32_t i = 0; i < nSessions; ++i ) {
+            auto& pCon = cons[i];
+            PacketPtr p = Packet::create( DSRV_MSG_CHAT_GETMSG, 4 );
+            p->append( i );
+            CHECK( pCon->mreq( p ) == FTSC_ERR::OK );
+
+            // The server asks something back before echoing a PLAYER_SET.
+            Packet set( DSRV_MSG_PLAYER_SET );
+            set.append( i );
+            pCon->send( &set );
+            PacketPtr pQuestion = pCon->receivePacket();
+            REQUIRE( pQuestion != nullptr );
+            CHECK( pQuestion->getType() == DSRV_MSG_LOGIN );
+            pCon->send( pQuestion.get() );
+
+            PacketPtr pEcho = pCon->receivePacket();
+            REQUIRE( pEcho != nullptr );
+            uint32_t id = 0;
+            pEcho->get( id );
+            CHECK( pEcho->getType() == DSRV_MSG_PLAYER_SET );
+            CHECK( id == i );
+        }
+        for( auto& pCon : cons ) {
+            pCon->disconnect();
+        }
+    } );
+
+    auto until = EventLoop::Clock::now() + chrono::seconds( 10 );
+    while( nSessionsDone < nSessions && EventLoop::Clock::now() < until ) {
+        loop.runOnce( 100 );
+    }
+    clients.join();
+    REQUIRE( nSessionsDone == nSessions );
+}
+
+/// Has no listening socket, like a waiter of another kind.
+class NoSocketWaiter : public ConnectionWaiter {
+public:
+    int init( uint16_t, function<void( Connection* )>, const ConnectionOptions& ) { return 0; }
+    bool waitForThenDoConnection( int64_t ) { return false; }
+};
+
+static Task<void> awaitAll( AsyncConnectionWaiter& in_waiter, AsyncConnection& in_conn, int& out_nNulls )
+{
+    if( co_await in_waiter.accept( 2000 ) == nullptr ) {
+        ++out_nNulls;
+    }
+    if( co_await in_conn.receive( 2000 ) == nullptr ) {
+        ++out_nNulls;
+    }
+    Packet req( DSRV_MSG_LOGIN );
+    req.append( (uint32_t) 1 );
+    if( co_await in_conn.request( req, 2000 ) == nullptr ) {
+        ++out_nNulls;
+    }
+}
+
+TEST_CASE( "What can't be awaited fails at once", "[AsyncConnection]" )
+{
+    EventLoop loop;
+    AsyncConnectionWaiter waiter( loop, new NoSocketWaiter );
+
+    // Nobody listens there.
+    AsyncConnection conn( loop, Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", 1, 200 ) );
+    CHECK_FALSE( conn.isValid() );
+
+    int nNulls = 0;
+    spawn( awaitAll( waiter, conn, nNulls ) );
+    loop.runOnce( 0 );
+    CHECK( nNulls == 3 );
+
+    // Its connections couldn't be awaited. Where there is no io_uring, it is a SOCKET waiter.
+    auto pUring = ConnectionWaiter::create( ConnectionWaiter::ConnectionType::URING );
+    if( static_cast<SocketConnectionWaiter*>( pUring )->getType() == ConnectionWaiter::ConnectionType::URING ) {
+        AsyncConnectionWaiter uringWaiter( loop, pUring );
+        nNulls = 0;
+        spawn( awaitAll( uringWaiter, conn, nNulls ) );
+        loop.runOnce( 0 );
+        CHECK( nNulls == 3 );
+    } else {
+        delete pUring;
+    }
+}
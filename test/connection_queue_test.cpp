@@ -0,0 +1,86 @@
+#include "catch.hpp"
+#include "../include/connection_queue.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace FTS;
+using namespace std;
+
+// Only the pointers are queued, so any value will do as long as they are
+// all taken out again before the queue would delete them.
+static Connection *fake( uintptr_t in_i )
+{
+    return reinterpret_cast<Connection *>( (in_i + 1) * 16 );
+}
+
+static uintptr_t unfake( Connection *in_pCon )
+{
+    return reinterpret_cast<uintptr_t>( in_pCon ) / 16 - 1;
+}
+
+TEST_CASE( "The connection queue is a bounded FIFO", "[ConnectionQueue]" )
+{
+    ConnectionQueue q( 5 );
+    REQUIRE( q.capacity() == 8 );
+    CHECK( q.pop() == nullptr );
+    CHECK_FALSE( q.push( nullptr ) );
+
+    // Around the ring a few times.
+    for( uintptr_t round = 0; round < 3; ++round ) {
+        for( uintptr_t i = 0; i < 8; ++i ) {
+            REQUIRE( q.push( fake( round * 8 + i ) ) );
+        }
+        CHECK_FALSE( q.push( fake( 100 ) ) );
+        for( uintptr_t i = 0; i < 8; ++i ) {
+            Connection *p = q.pop();
+            REQUIRE( p != nullptr );
+            CHECK( unfake( p ) == round * 8 + i );
+        }
+        CHECK( q.pop() == nullptr );
+    }
+}
+
+TEST_CASE( "The connection queue hands every connection out exactly once", "[ConnectionQueue]" )
+{
+    const uintptr_t nPerProducer = 20000;
+    const int nProducers = 3;
+    const int nConsumers = 3;
+    ConnectionQueue q( 64 );
+    vector<atomic<int>> seen( nPerProducer * nProducers );
+    atomic<uintptr_t> nTaken( 0 );
+
+    vector<thread> threads;
+    for( int p = 0; p < nProducers; ++p ) {
+        threads.emplace_back( [&q, p, nPerProducer] {
+            for( uintptr_t i = 0; i < nPerProducer; ++i ) {
+                while( !q.push( fake( p * nPerProducer + i ) ) ) {
+                    this_thread::yield();
+                }
+            }
+        } );
+    }
+    for( int c = 0; c < nConsumers; ++c ) {
+        threads.emplace_back( [&] {
+            while( nTaken < nPerProducer * nProducers ) {
+                Connection *pCon = q.pop();
+                if( pCon == nullptr ) {
+                    this_thread::yield();
+                    continue;
+                }
+                ++seen[unfake( pCon )];
+                ++nTaken;
+            }
+        } );
+    }
+    for( auto& t : threads ) {
+        t.join();
+    }
+
+    CHECK( q.pop() == nullptr );
+    bool bAllOnce = true;
+    for( auto& n : seen ) {
+        bAllOnce = bAllOnce && n == 1;
+    }
+    CHECK( bAllOnce );
+}
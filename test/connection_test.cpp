@@ -0,0 +1,147 @@
+#include "catch.hpp"
+#include "../include/connection_waiter.h"
+#include "../include/dsrv_constants.h"
+#include "../src/TraditionalConnection.h"
+#include <vector>
+
+using namespace FTS;
+using namespace std;
+
+// Ports of earlier runs may still be in TIME_WAIT.
+static uint16_t initOnFreePort( ConnectionWaiter& io_waiter, function<void( Connection* )> in_cb )
+{
+    for( uint16_t usPort = 33340; usPort < 33360; ++usPort ) {
+        if( io_waiter.init( usPort, in_cb ) == 0 ) {
+            return usPort;
+        }
+    }
+    return 0;
+}
+
+TEST_CASE( "A full queue blocking the sender stops receiving, so mreq fails", "[Connection]" )
+{
+    unique_ptr<Connection> pSrv;
+    unique_ptr<ConnectionWaiter> pWaiter( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ) );
+    uint16_t usPort = initOnFreePort( *pWaiter, [&pSrv]( Connection* in_pCon ) { pSrv.reset( in_pCon ); } );
+    REQUIRE( usPort != 0 );
+
+    unique_ptr<Connection> pCli( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 2000 ) );
+    REQUIRE( pCli->isConnected() );
+    REQUIRE( pWaiter->waitForThenDoConnection( 2000 ) );
+    REQUIRE( pSrv != nullptr );
+
+    pCli->setQueueCapacity( 2, QueueOverflow::BlockSender );
+    pCli->setMaxWaitMillisec( 200 );
+
+    // The response comes after more packets than fit in the queue.
+    for( uint32_t i = 0; i < 3; ++i ) {
+        Packet p( DSRV_MSG_CHAT_GETMSG );
+        p.append( i );
+        REQUIRE( pSrv->send( &p ) == FTSC_ERR::OK );
+    }
+    Packet resp( DSRV_MSG_LOGIN );
+    resp.append( (uint8_t) 1 );
+    REQUIRE( pSrv->send( &resp ) == FTSC_ERR::OK );
+
+    Packet req( DSRV_MSG_LOGIN );
+    req.append( (uint8_t) 1 );
+    CHECK( pCli->mreq( &req ) == FTSC_ERR::RECEIVE );
+    CHECK( pCli->isQueueFull() );
+    CHECK( pCli->getPacketStats()[DSRV_MSG_CHAT_GETMSG].dropped == 0 );
+
+    // Taking the queued packets makes room to receive the response.
+    for( uint32_t i = 0; i < 2; ++i ) {
+        PacketPtr p = pCli->receivePacket();
+        REQUIRE( p != nullptr );
+        uint32_t id = 99;
+        p->get( id );
+        CHECK( id == i );
+    }
+    PacketPtr pResp( static_cast<TraditionalConnection*>( pCli.get() )->waitForThenGetPacketWithReq( DSRV_MSG_LOGIN ) );
+    REQUIRE( pResp != nullptr );
+    CHECK( pResp->getType() == DSRV_MSG_LOGIN );
+
+    PacketPtr pLast = pCli->receivePacket();
+    REQUIRE( pLast != nullptr );
+    uint32_t id = 99;
+    pLast->get( id );
+    CHECK( id == 2 );
+    CHECK( pCli->getPacketStats()[DSRV_MSG_CHAT_GETMSG].dropped == 0 );
+}
+
+TEST_CASE( "A type limit of a queue blocking the sender doesn't hold up other responses", "[Connection]" )
+{
+    unique_ptr<Connection> pSrv;
+    unique_ptr<ConnectionWaiter> pWaiter( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ) );
+    uint16_t usPort = initOnFreePort( *pWaiter, [&pSrv]( Connection* in_pCon ) { pSrv.reset( in_pCon ); } );
+    REQUIRE( usPort != 0 );
+
+    unique_ptr<Connection> pCli( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 2000 ) );
+    REQUIRE( pCli->isConnected() );
+    REQUIRE( pWaiter->waitForThenDoConnection( 2000 ) );
+    REQUIRE( pSrv != nullptr );
+
+    pCli->setQueueCapacity( 10, QueueOverflow::BlockSender );
+    pCli->setQueueLimit( DSRV_MSG_CHAT_GETMSG, 1 );
+    pCli->setMaxWaitMillisec( 2000 );
+
+    for( uint32_t i = 0; i < 3; ++i ) {
+        Packet p( DSRV_MSG_CHAT_GETMSG );
+        p.append( i );
+        REQUIRE( pSrv->send( &p ) == FTSC_ERR::OK );
+    }
+    Packet resp( DSRV_MSG_LOGIN );
+    resp.append( (uint8_t) 1 );
+    REQUIRE( pSrv->send( &resp ) == FTSC_ERR::OK );
+
+    Packet req( DSRV_MSG_LOGIN );
+    req.append( (uint8_t) 1 );
+    CHECK( pCli->mreq( &req ) == FTSC_ERR::OK );
+    CHECK( req.getType() == DSRV_MSG_LOGIN );
+
+    // Only the newest of the limited type is kept.
+    CHECK( pCli->getPacketStats()[DSRV_MSG_CHAT_GETMSG].dropped == 2 );
+    PacketPtr pLast = pCli->receivePacket();
+    REQUIRE( pLast != nullptr );
+    uint32_t id = 99;
+    pLast->get( id );
+    CHECK( id == 2 );
+}
+
+TEST_CASE( "The future of an asynchronous request tells why it failed", "[Connection]" )
+{
+    unique_ptr<Connection> pSrv;
+    unique_ptr<ConnectionWaiter> pWaiter( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ) );
+    uint16_t usPort = initOnFreePort( *pWaiter, [&pSrv]( Connection* in_pCon ) { pSrv.reset( in_pCon ); } );
+    REQUIRE( usPort != 0 );
+
+    unique_ptr<Connection> pCli( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 2000 ) );
+    REQUIRE( pCli->isConnected() );
+    REQUIRE( pWaiter->waitForThenDoConnection( 2000 ) );
+    REQUIRE( pSrv != nullptr );
+
+    Packet req( DSRV_MSG_LOGIN );
+    req.append( (uint8_t) 1 );
+    auto answered = pCli->mreqAsync( &req );
+    PacketPtr pOnServer = pSrv->receivePacket();
+    REQUIRE( pOnServer != nullptr );
+    REQUIRE( pSrv->send( pOnServer.get() ) == FTSC_ERR::OK );
+    CHECK( pCli->processResponses( 2000 ) == 0 );
+    auto result = answered.get();
+    CHECK( result.first == FTSC_ERR::OK );
+    REQUIRE( result.second != nullptr );
+    CHECK( result.second->getType() == DSRV_MSG_LOGIN );
+
+    // Lost before the response came.
+    auto lost = pCli->mreqAsync( &req );
+    pSrv->disconnect();
+    pCli->processResponses( 2000 );
+    result = lost.get();
+    CHECK( result.first != FTSC_ERR::OK );
+    CHECK( result.second == nullptr );
+
+    // Not even sent.
+    result = pCli->mreqAsync( &req ).get();
+    CHECK( result.first != FTSC_ERR::OK );
+    CHECK( result.second == nullptr );
+}
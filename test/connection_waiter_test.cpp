@@ -0,0 +1,68 @@
+#include "catch.hpp"
+#include "../include/connection_waiter.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace FTS;
+using namespace std;
+
+// Ports of earlier runs may still be in TIME_WAIT.
+static uint16_t initOnFreePort( ConnectionWaiter& io_waiter, function<void( Connection* )> in_cb )
+{
+    for( uint16_t usPort = 33300; usPort < 33320; ++usPort ) {
+        if( io_waiter.init( usPort, in_cb ) == 0 ) {
+            return usPort;
+        }
+    }
+    return 0;
+}
+
+TEST_CASE( "All connections waiting are accepted in one wakeup", "[ConnectionWaiter]" )
+{
+    vector<unique_ptr<Connection>> accepted;
+    unique_ptr<ConnectionWaiter> pWaiter( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ) );
+    uint16_t usPort = initOnFreePort( *pWaiter, [&accepted]( Connection* in_pCon ) { accepted.emplace_back( in_pCon ); } );
+    REQUIRE( usPort != 0 );
+
+    // The handshakes are done by the kernel, they all wait in the backlog.
+    vector<unique_ptr<Connection>> cons;
+    for( int i = 0; i < 3; ++i ) {
+        cons.emplace_back( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 2000 ) );
+        REQUIRE( cons.back()->isConnected() );
+    }
+
+    REQUIRE( pWaiter->waitForThenDoConnection( 2000 ) );
+    CHECK( accepted.size() == 3 );
+    AcceptStats stats = pWaiter->getAcceptStats();
+    CHECK( stats.wakeups == 1 );
+    CHECK( stats.accepted == 3 );
+    CHECK( stats.acceptedPerWakeup() == 3.0 );
+    for( auto& pCon : accepted ) {
+        CHECK( pCon->isConnected() );
+    }
+}
+
+TEST_CASE( "Waiting for a connection ends with it or with the time out", "[ConnectionWaiter]" )
+{
+    unique_ptr<Connection> pAccepted;
+    unique_ptr<ConnectionWaiter> pWaiter( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ) );
+    uint16_t usPort = initOnFreePort( *pWaiter, [&pAccepted]( Connection* in_pCon ) { pAccepted.reset( in_pCon ); } );
+    REQUIRE( usPort != 0 );
+
+    auto start = chrono::steady_clock::now();
+    CHECK_FALSE( pWaiter->waitForThenDoConnection( 50 ) );
+    CHECK( chrono::steady_clock::now() - start >= chrono::milliseconds( 50 ) );
+    CHECK( pWaiter->getAcceptStats().wakeups == 0 );
+    CHECK( pWaiter->getAcceptStats().acceptCalls == 0 );
+
+    unique_ptr<Connection> pCli;
+    thread client( [&pCli, usPort] {
+        this_thread::sleep_for( chrono::milliseconds( 20 ) );
+        pCli.reset( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 2000 ) );
+    } );
+    CHECK( pWaiter->waitForThenDoConnection( -1 ) );
+    client.join();
+    REQUIRE( pAccepted != nullptr );
+    CHECK( pAccepted->isConnected() );
+}
@@ -0,0 +1,103 @@
+#include "catch.hpp"
+#include "../include/event_loop.h"
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#  include <sys/socket.h>
+#  include <unistd.h>
+#endif
+
+using namespace FTS;
+using namespace std;
+
+#if !defined(_WIN32)
+TEST_CASE( "Loop reports readable sockets", "[EventLoop]" )
+{
+    EventLoop loop;
+    REQUIRE( loop.isValid() );
+
+    int fds[2];
+    REQUIRE( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) == 0 );
+
+    int nCalls = 0;
+    REQUIRE( loop.add( fds[0], EventLoop::Readable, [&]( uint32_t in_events ) {
+        REQUIRE( ( in_events & EventLoop::Readable ) != 0 );
+        char c;
+        REQUIRE( ::read( fds[0], &c, 1 ) == 1 );
+        ++nCalls;
+    } ) );
+    REQUIRE( loop.getSocketCount() == 1 );
+    REQUIRE( !loop.add( fds[0], EventLoop::Readable, []( uint32_t ) {} ) );
+
+    REQUIRE( loop.runOnce( 0 ) == 0 );
+    REQUIRE( ::write( fds[1], "ab", 2 ) == 2 );
+    loop.runOnce( 100 );
+    loop.runOnce( 100 );
+    REQUIRE( nCalls == 2 );
+
+    // Not watched for reading anymore.
+    REQUIRE( loop.modify( fds[0], 0 ) );
+    REQUIRE( ::write( fds[1], "c", 1 ) == 1 );
+    loop.runOnce( 0 );
+    REQUIRE( nCalls == 2 );
+
+    loop.remove( fds[0] );
+    REQUIRE( loop.getSocketCount() == 0 );
+    ::close( fds[0] );
+    ::close( fds[1] );
+}
+
+TEST_CASE( "Callbacks may remove their own socket", "[EventLoop]" )
+{
+    EventLoop loop;
+    int fds[2];
+    REQUIRE( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) == 0 );
+
+    int nCalls = 0;
+    loop.add( fds[0], EventLoop::Readable, [&]( uint32_t ) {
+        ++nCalls;
+        loop.remove( fds[0] );
+    } );
+    ::close( fds[1] );
+    loop.runOnce( 100 );
+    loop.runOnce( 0 );
+    REQUIRE( nCalls == 1 );
+    ::close( fds[0] );
+}
+#endif
+
+TEST_CASE( "Timers fire in order and can be cancelled", "[EventLoop]" )
+{
+    EventLoop loop;
+    vector<int> fired;
+    loop.addTimer( 20, [&] { fired.push_back( 2 ); } );
+    loop.addTimer( 1, [&] { fired.push_back( 1 ); } );
+    auto id = loop.addTimer( 10, [&] { fired.push_back( 3 ); } );
+    loop.cancelTimer( id );
+    loop.addTimer( 30, [&] { fired.push_back( 4 ); loop.stop(); } );
+
+    loop.run();
+    REQUIRE( fired == vector<int>( { 1, 2, 4 } ) );
+}
+
+TEST_CASE( "Functions posted from other threads run on the loop", "[EventLoop]" )
+{
+    EventLoop loop;
+    auto loopThread = this_thread::get_id();
+    int nRun = 0;
+
+    thread poster( [&] {
+        for( int i = 0; i < 100; ++i ) {
+            loop.post( [&] {
+                REQUIRE( this_thread::get_id() == loopThread );
+                if( ++nRun == 100 ) {
+                    loop.stop();
+                }
+            } );
+        }
+    } );
+    loop.run();
+    poster.join();
+    REQUIRE( nRun == 100 );
+}
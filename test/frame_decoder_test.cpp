@@ -0,0 +1,176 @@
+#include "catch.hpp"
+#include "../include/frame_decoder.h"
+#include "../include/dsrv_constants.h"
+#include "../include/Logger.h"
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace FTS;
+using namespace std;
+
+static void appendFrame( vector<int8_t>& out, const Packet& in_packet )
+{
+    auto p = in_packet.getPayloadPtr() - D_PACKET_HDR_LEN;
+    out.insert( out.end(), p, p + in_packet.getTotalLen() );
+}
+
+static void appendNoise( vector<int8_t>& out, const string& in_s )
+{
+    out.insert( out.end(), in_s.begin(), in_s.end() );
+}
+
+/// Feeds the stream in chunks of \a in_uiChunk bytes and collects the messages.
+static vector<string> decodeAll( FrameDecoder& decoder, const vector<int8_t>& in_stream, size_t in_uiChunk )
+{
+    vector<string> ret;
+    for( size_t off = 0; off < in_stream.size(); off += in_uiChunk ) {
+        auto p = in_stream.data() + off;
+        auto len = min( in_uiChunk, in_stream.size() - off );
+        while( len > 0 ) {
+            PacketView frame;
+            auto used = decoder.decode( p, len, frame );
+            REQUIRE( used > 0 );
+            REQUIRE( used <= len );
+            p += used;
+            len -= used;
+            if( frame.isValid() ) {
+                ret.push_back( to_string( frame.getType() ) + ":" + frame.get_string() );
+            }
+        }
+    }
+    return ret;
+}
+
+static Packet makePacket( master_request_t in_type, const string& in_s )
+{
+    Packet p( in_type );
+    p.append( in_s );
+    return p;
+}
+
+TEST_CASE( "Decode whole frames without copy", "[FrameDecoder]" )
+{
+    vector<int8_t> stream;
+    appendFrame( stream, makePacket( DSRV_MSG_LOGIN, "Hello" ) );
+    appendFrame( stream, makePacket( DSRV_MSG_CHAT_SENDMSG, "World" ) );
+
+    FrameDecoder decoder;
+    PacketView frame;
+    auto used = decoder.decode( stream.data(), stream.size(), frame );
+    REQUIRE( frame.isValid() );
+    REQUIRE( frame.getType() == DSRV_MSG_LOGIN );
+    REQUIRE( frame.getPayloadPtr() == stream.data() + D_PACKET_HDR_LEN );
+    REQUIRE( frame.get_string() == "Hello" );
+
+    used += decoder.decode( stream.data() + used, stream.size() - used, frame );
+    REQUIRE( frame.isValid() );
+    REQUIRE( frame.getType() == DSRV_MSG_CHAT_SENDMSG );
+    REQUIRE( used == stream.size() );
+    REQUIRE_FALSE( decoder.isInFrame() );
+    REQUIRE( decoder.getSkippedBytes() == 0 );
+
+    // A complete frame gets copied into a packet of its own.
+    auto p = frame.rewind().toPacket();
+    REQUIRE( p->getType() == DSRV_MSG_CHAT_SENDMSG );
+    REQUIRE( p->get_string() == "World" );
+}
+
+TEST_CASE( "Decode frames cut into chunks of any size", "[FrameDecoder]" )
+{
+    vector<int8_t> stream;
+    string sLong( 3000, 'x' );
+    appendFrame( stream, makePacket( DSRV_MSG_LOGIN, "Hello" ) );
+    appendNoise( stream, "FTxFFTSxFTS" );
+    appendFrame( stream, makePacket( DSRV_MSG_GAME_LST, sLong ) );
+    appendNoise( stream, "F" );
+    appendFrame( stream, makePacket( DSRV_MSG_CHAT_SENDMSG, "World" ) );
+    appendNoise( stream, "FT" );
+
+    const vector<string> expected = { to_string( DSRV_MSG_LOGIN ) + ":Hello",
+                                      to_string( DSRV_MSG_GAME_LST ) + ":" + sLong,
+                                      to_string( DSRV_MSG_CHAT_SENDMSG ) + ":World" };
+    for( size_t chunk : { 1, 2, 3, 5, 9, 10, 64, 1000, 100000 } ) {
+        FrameDecoder decoder;
+        REQUIRE( decodeAll( decoder, stream, chunk ) == expected );
+        REQUIRE( decoder.getSkippedBytes() == 12 );
+        REQUIRE( decoder.getDroppedFrames() == 0 );
+        // The trailing "FT" may still start a frame.
+        REQUIRE( decoder.isInFrame() );
+    }
+}
+
+TEST_CASE( "Drop frames with invalid headers", "[FrameDecoder]" )
+{
+    vector<int8_t> stream;
+    appendFrame( stream, makePacket( DSRV_MSG_LOGIN, "Hello" ) );
+
+    // An unknown request: the whole frame is dropped.
+    auto bad = makePacket( DSRV_MSG_LOGIN, "Bad request" );
+    bad.setType( DSRV_MSG_MAX );
+    appendFrame( stream, bad );
+
+    // No payload: only the header is dropped.
+    fts_packet_hdr_t hdr;
+    fillPacketHeader( &hdr, DSRV_MSG_LOGOUT );
+    hdr.data_len = 0;
+    stream.insert( stream.end(), (int8_t*) &hdr, (int8_t*) &hdr + sizeof( hdr ) );
+
+    // Too long: only the header is dropped.
+    hdr.data_len = 100000;
+    stream.insert( stream.end(), (int8_t*) &hdr, (int8_t*) &hdr + sizeof( hdr ) );
+
+    appendFrame( stream, makePacket( DSRV_MSG_CHAT_SENDMSG, "World" ) );
+
+    stringstream log;
+    Logger::LogFile( &log );
+    for( size_t chunk : { 1, 7, 100000 } ) {
+        FrameDecoder decoder( 10000 );
+        auto msgs = decodeAll( decoder, stream, chunk );
+        REQUIRE( msgs.size() == 2 );
+        REQUIRE( msgs[0] == to_string( DSRV_MSG_LOGIN ) + ":Hello" );
+        REQUIRE( msgs[1] == to_string( DSRV_MSG_CHAT_SENDMSG ) + ":World" );
+        REQUIRE( decoder.getDroppedFrames() == 3 );
+    }
+    Logger::LogFile( nullptr );
+    REQUIRE( log.str().find( "the length of the packet is incorrect: 100000" ) != string::npos );
+}
+
+TEST_CASE( "Find the identifier anywhere in the noise", "[FrameDecoder]" )
+{
+    // Every position relative to the 16 byte blocks, with look-alikes around.
+    for( size_t noise = 0; noise < 40; ++noise ) {
+        vector<int8_t> stream;
+        for( size_t i = 0; i < noise; ++i ) {
+            stream.push_back( "FTSF"[i % 4] );
+        }
+        appendFrame( stream, makePacket( DSRV_MSG_LOGIN, "Hello" ) );
+
+        FrameDecoder decoder;
+        auto msgs = decodeAll( decoder, stream, stream.size() );
+        REQUIRE( msgs.size() == 1 );
+        REQUIRE( decoder.getSkippedBytes() == noise );
+    }
+}
+
+TEST_CASE( "Give up on streams of garbage", "[FrameDecoder]" )
+{
+    vector<int8_t> noise( 1000, 'F' );
+    vector<int8_t> stream;
+    appendFrame( stream, makePacket( DSRV_MSG_LOGIN, "Hello" ) );
+
+    FrameDecoder decoder( UINT32_MAX, 2500 );
+    decodeAll( decoder, noise, noise.size() );
+    decodeAll( decoder, noise, 7 );
+    REQUIRE_FALSE( decoder.isCorrupt() );
+
+    // A valid frame starts the count over.
+    REQUIRE( decodeAll( decoder, stream, stream.size() ).size() == 1 );
+    decodeAll( decoder, noise, noise.size() );
+    decodeAll( decoder, noise, noise.size() );
+    REQUIRE_FALSE( decoder.isCorrupt() );
+    decodeAll( decoder, noise, noise.size() );
+    REQUIRE( decoder.isCorrupt() );
+    // The last 'F' may still start an identifier.
+    REQUIRE( decoder.getSkippedBytes() == 4999 );
+}
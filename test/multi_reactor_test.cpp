@@ -0,0 +1,88 @@
+#include "catch.hpp"
+#include "../include/multi_reactor.h"
+#include "../include/dsrv_constants.h"
+#include <atomic>
+#include <vector>
+
+using namespace FTS;
+using namespace std;
+
+// Ports of earlier runs may still be in TIME_WAIT.
+static uint16_t listenOnFreePort( MultiReactor& io_reactors, MultiReactor::AcceptCallback in_onAccept )
+{
+    for( uint16_t usPort = 33280; usPort < 33300; ++usPort ) {
+        if( io_reactors.listen( usPort, in_onAccept ) == 0 ) {
+            return usPort;
+        }
+    }
+    return 0;
+}
+
+TEST_CASE( "Several reactor threads serve the connections of one port", "[MultiReactor]" )
+{
+    const int nClients = 40;
+    MultiReactor reactors( 4 );
+    REQUIRE( reactors.getThreadCount() == 4 );
+    atomic<int> nAccepted( 0 );
+
+    // Echoes everything, on the thread of the reactor that got it.
+    uint16_t usPort = listenOnFreePort( reactors, [&]( Reactor& io_reactor, Connection* in_pCon ) {
+        ++nAccepted;
+        io_reactor.add( in_pCon, []( Connection& in_con, PacketPtr in_p ) { in_con.send( in_p.get() ); } );
+    } );
+    REQUIRE( usPort != 0 );
+#if defined(__linux__)
+    CHECK( reactors.isSharingPort() );
+#endif
+    reactors.start();
+
+    vector<unique_ptr<Connection>> cons;
+    for( int i = 0; i < nClients; ++i ) {
+        cons.emplace_back( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 2000 ) );
+        REQUIRE( cons.back()->isConnected() );
+    }
+
+    for( uint32_t i = 0; i < nClients; ++i ) {
+        Packet p( DSRV_MSG_CHAT_GETMSG );
+        p.append( i );
+        REQUIRE( cons[i]->send( &p ) == FTSC_ERR::OK );
+    }
+    for( uint32_t i = 0; i < nClients; ++i ) {
+        PacketPtr p = cons[i]->receivePacket();
+        REQUIRE( p != nullptr );
+        uint32_t id = 0;
+        p->get( id );
+        CHECK( id == i );
+    }
+
+    reactors.stop();
+    CHECK( nAccepted == nClients );
+    size_t nServed = 0;
+    for( size_t i = 0; i < reactors.getThreadCount(); ++i ) {
+        nServed += reactors.getReactor( i ).getConnectionCount();
+    }
+    CHECK( nServed == nClients );
+}
+
+TEST_CASE( "A stopped multi-reactor serves its connections again when started", "[MultiReactor]" )
+{
+    MultiReactor reactors( 2 );
+    reactors.setPinThreads( false );
+    uint16_t usPort = listenOnFreePort( reactors, []( Reactor& io_reactor, Connection* in_pCon ) {
+        io_reactor.add( in_pCon, []( Connection& in_con, PacketPtr in_p ) { in_con.send( in_p.get() ); } );
+    } );
+    REQUIRE( usPort != 0 );
+    reactors.start();
+
+    unique_ptr<Connection> pCli( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 2000 ) );
+    REQUIRE( pCli->isConnected() );
+    Packet p( DSRV_MSG_CHAT_GETMSG );
+    p.append( (uint32_t) 7 );
+    for( int i = 0; i < 2; ++i ) {
+        REQUIRE( pCli->send( &p ) == FTSC_ERR::OK );
+        PacketPtr pAnswer = pCli->receivePacket();
+        REQUIRE( pAnswer != nullptr );
+        reactors.stop();
+        reactors.start();
+    }
+}
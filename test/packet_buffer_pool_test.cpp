@@ -0,0 +1,125 @@
+#include "catch.hpp"
+#include "../include/packet_buffer_pool.h"
+#include "../include/packet.h"
+#include <cstring>
+#include <thread>
+
+using namespace FTS;
+using namespace std;
+
+TEST_CASE( "Allocate rounds up to the size class", "[PacketBufferPool]" )
+{
+    auto& pool = PacketBufferPool::instance();
+    auto classes = pool.getClasses();
+    REQUIRE( !classes.empty() );
+
+    void* p = pool.allocate( classes[0] - 1 );
+    REQUIRE( p != nullptr );
+    REQUIRE( PacketBufferPool::capacity( p ) == classes[0] );
+    pool.release( p );
+
+    auto big = classes.back() + 1;
+    p = pool.allocate( big );
+    REQUIRE( PacketBufferPool::capacity( p ) == big );
+    pool.release( p );
+}
+
+TEST_CASE( "Released buffers are reused", "[PacketBufferPool]" )
+{
+    auto& pool = PacketBufferPool::instance();
+    void* p1 = pool.allocate( 100 );
+    pool.release( p1 );
+
+    pool.resetStats();
+    void* p2 = pool.allocate( 100 );
+    REQUIRE( p2 == p1 );
+    pool.release( p2 );
+
+    auto stats = pool.getStats();
+    REQUIRE( stats.allocations == 1 );
+    REQUIRE( stats.hits == 1 );
+    REQUIRE( stats.misses == 0 );
+    REQUIRE( stats.releases == 1 );
+}
+
+TEST_CASE( "Reallocate keeps the content", "[PacketBufferPool]" )
+{
+    auto& pool = PacketBufferPool::instance();
+    auto p = (char*) pool.allocate( 10 );
+    strcpy( p, "Hallo" );
+
+    // Still fits in the class, nothing moves.
+    REQUIRE( pool.reallocate( p, PacketBufferPool::capacity( p ) ) == p );
+
+    p = (char*) pool.reallocate( p, 100000 );
+    REQUIRE( PacketBufferPool::capacity( p ) >= 100000 );
+    REQUIRE( string( p ) == "Hallo" );
+
+    p = (char*) pool.reallocate( p, 200000 );
+    REQUIRE( string( p ) == "Hallo" );
+    pool.release( p );
+}
+
+TEST_CASE( "Configure the size classes", "[PacketBufferPool]" )
+{
+    auto& pool = PacketBufferPool::instance();
+    auto old = pool.getClasses();
+
+    void* pOld = pool.allocate( 20 );
+    REQUIRE_FALSE( pool.configure( {} ) );
+    REQUIRE_FALSE( pool.configure( { 1 } ) );
+    REQUIRE( pool.configure( { 256, 32 } ) );
+    REQUIRE( pool.getClasses() == vector<size_t>( { 32, 256 } ) );
+
+    void* p = pool.allocate( 20 );
+    REQUIRE( PacketBufferPool::capacity( p ) == 32 );
+    pool.release( p );
+    // A buffer of the old configuration is still valid.
+    pool.release( pOld );
+
+    REQUIRE( pool.configure( old ) );
+}
+
+TEST_CASE( "Steady packet traffic does not allocate", "[PacketBufferPool]" )
+{
+    auto& pool = PacketBufferPool::instance();
+    char data[1000] = { 0 };
+    for( int i = 0; i < 2; ++i ) {
+        Packet p( DSRV_MSG_GAME_LST );
+        p.append( data, sizeof( data ) );
+        if( i == 0 ) {
+            pool.resetStats();
+        }
+    }
+
+    auto stats = pool.getStats();
+    REQUIRE( stats.allocations > 0 );
+    REQUIRE( stats.misses == 0 );
+
+    // Small packets don't even need the pool.
+    pool.resetStats();
+    Packet p( DSRV_MSG_CHAT_SENDMSG );
+    p.append( "Hello World" );
+    REQUIRE( pool.getStats().allocations == 0 );
+}
+
+TEST_CASE( "Buffers can be released by another thread", "[PacketBufferPool]" )
+{
+    auto& pool = PacketBufferPool::instance();
+    vector<void*> buffers;
+    for( int i = 0; i < 100; ++i ) {
+        buffers.push_back( pool.allocate( 64 ) );
+    }
+
+    thread t( [&pool, &buffers] {
+        for( auto p : buffers ) {
+            pool.release( p );
+        }
+    } );
+    t.join();
+
+    pool.resetStats();
+    void* p = pool.allocate( 64 );
+    REQUIRE( pool.getStats().hits == 1 );
+    pool.release( p );
+}
@@ -0,0 +1,90 @@
+#include "catch.hpp"
+#include "../include/packet_queue.h"
+#include "../include/dsrv_constants.h"
+#include <vector>
+
+using namespace FTS;
+using namespace std;
+
+static Packet *makePacket( master_request_t in_req, uint32_t in_uiId )
+{
+    auto p = new Packet( in_req );
+    p->append( in_uiId );
+    p->rewind();
+    return p;
+}
+
+static uint32_t idOf( Packet *in_p )
+{
+    uint32_t id = 0;
+    in_p->rewind();
+    in_p->get( id );
+    delete in_p;
+    return id;
+}
+
+TEST_CASE( "Queue keeps the order", "[PacketQueue]" )
+{
+    PacketQueue q;
+    REQUIRE( q.empty() );
+    REQUIRE( q.pop() == nullptr );
+    REQUIRE( q.pop( DSRV_MSG_LOGIN ) == nullptr );
+
+    for( uint32_t i = 0; i < 10; ++i ) {
+        q.push( makePacket( i % 2 ? DSRV_MSG_LOGIN : DSRV_MSG_CHAT_GETMSG, i ) );
+    }
+    REQUIRE( q.size() == 10 );
+    REQUIRE( q.count( DSRV_MSG_LOGIN ) == 5 );
+    REQUIRE( q.count( DSRV_MSG_CHAT_GETMSG ) == 5 );
+    REQUIRE( q.count( DSRV_MSG_LOGOUT ) == 0 );
+
+    for( uint32_t i = 0; i < 10; ++i ) {
+        REQUIRE( idOf( q.pop() ) == i );
+    }
+    REQUIRE( q.empty() );
+    REQUIRE( q.count( DSRV_MSG_LOGIN ) == 0 );
+}
+
+TEST_CASE( "Take packets out by type", "[PacketQueue]" )
+{
+    PacketQueue q;
+    q.push( makePacket( DSRV_MSG_LOGIN, 0 ) );
+    q.push( makePacket( DSRV_MSG_CHAT_GETMSG, 1 ) );
+    q.push( makePacket( DSRV_MSG_LOGIN, 2 ) );
+    q.push( makePacket( DSRV_MSG_CHAT_GETMSG, 3 ) );
+    q.push( makePacket( DSRV_MSG_LOGOUT, 4 ) );
+
+    // From the middle, the back and the front.
+    REQUIRE( idOf( q.pop( DSRV_MSG_CHAT_GETMSG ) ) == 1 );
+    REQUIRE( idOf( q.pop( DSRV_MSG_LOGOUT ) ) == 4 );
+    REQUIRE( idOf( q.pop( DSRV_MSG_LOGIN ) ) == 0 );
+    REQUIRE( q.pop( DSRV_MSG_LOGOUT ) == nullptr );
+    REQUIRE( q.size() == 2 );
+
+    vector<uint32_t> left;
+    q.forEach( [&left]( const Packet *p ) { left.push_back( (uint32_t) p->getType() ); } );
+    REQUIRE( left == vector<uint32_t>( { DSRV_MSG_LOGIN, DSRV_MSG_CHAT_GETMSG } ) );
+
+    // Pushing after taking out in between keeps both orders intact.
+    q.push( makePacket( DSRV_MSG_LOGIN, 5 ) );
+    REQUIRE( idOf( q.pop() ) == 2 );
+    REQUIRE( idOf( q.pop( DSRV_MSG_LOGIN ) ) == 5 );
+    REQUIRE( idOf( q.pop() ) == 3 );
+    REQUIRE( q.empty() );
+}
+
+TEST_CASE( "Clearing the queue", "[PacketQueue]" )
+{
+    PacketQueue q;
+    for( uint32_t i = 0; i < 100; ++i ) {
+        q.push( makePacket( (master_request_t) (i % 7 + 1), i ) );
+    }
+    q.clear();
+    REQUIRE( q.empty() );
+    REQUIRE( q.size() == 0 );
+    REQUIRE( q.count( 1 ) == 0 );
+
+    // The queue is usable again and deletes what's left when destroyed.
+    q.push( makePacket( DSRV_MSG_LOGIN, 1 ) );
+    REQUIRE( q.front()->getType() == DSRV_MSG_LOGIN );
+}
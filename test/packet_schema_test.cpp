@@ -0,0 +1,87 @@
+#include "catch.hpp"
+#include "../include/packet_schema.h"
+#include "../include/dsrv_constants.h"
+
+using namespace FTS;
+using namespace std;
+
+using ChatSendMsg = MessageDef<DSRV_MSG_CHAT_SENDMSG, DSRV_CHAT_TYPE, CString, CString>;
+using PlayerFlag = MessageDef<DSRV_MSG_PLAYER_SET_FLAG, uint8_t, uint32_t>;
+
+static_assert( ChatSendMsg::minSize == 3, "" );
+static_assert( !ChatSendMsg::isFixedSize, "" );
+static_assert( PlayerFlag::minSize == 5, "" );
+static_assert( PlayerFlag::isFixedSize, "" );
+
+TEST_CASE( "Encode a message the same way as append does", "[MessageDef]" )
+{
+    Packet p1( DSRV_MSG_CHAT_SENDMSG );
+    p1.append( DSRV_CHAT_TYPE::WHISPER );
+    p1.append( "Otto" );
+    p1.append( "Hallo Otto!" );
+
+    auto p2 = ChatSendMsg::create( DSRV_CHAT_TYPE::WHISPER, "Otto", "Hallo Otto!" );
+    REQUIRE( p2->getType() == DSRV_MSG_CHAT_SENDMSG );
+    REQUIRE( p2->getPayloadLen() == p1.getPayloadLen() );
+    REQUIRE( memcmp( p1.getPayloadPtr(), p2->getPayloadPtr(), p1.getPayloadLen() ) == 0 );
+
+    Packet p3( DSRV_MSG_PLAYER_SET_FLAG );
+    PlayerFlag::encode( p3, 7, 0xdeadbeef );
+    p3.rewind();
+    uint8_t flag = 0;
+    uint32_t value = 0;
+    p3.get( flag );
+    p3.get( value );
+    REQUIRE( flag == 7 );
+    REQUIRE( value == 0xdeadbeef );
+}
+
+TEST_CASE( "Decode a message", "[MessageDef]" )
+{
+    auto p = ChatSendMsg::create( DSRV_CHAT_TYPE::NORMAL, "", "Hi all" );
+
+    DSRV_CHAT_TYPE type = DSRV_CHAT_TYPE::NONE;
+    string_view to, msg;
+    REQUIRE( ChatSendMsg::decode( *p, type, to, msg ) );
+    REQUIRE( type == DSRV_CHAT_TYPE::NORMAL );
+    REQUIRE( to.empty() );
+    REQUIRE( msg == "Hi all" );
+
+    // The view's cursor moves behind the message.
+    p->append( (uint8_t) 42 );
+    PacketView v( *p );
+    REQUIRE( ChatSendMsg::decode( v, type, to, msg ) );
+    REQUIRE( v.get() == 42 );
+}
+
+TEST_CASE( "Decoding wrong or short messages fails", "[MessageDef]" )
+{
+    uint8_t flag = 0;
+    uint32_t value = 0;
+
+    // Wrong type.
+    auto p = ChatSendMsg::create( DSRV_CHAT_TYPE::NORMAL, "a", "b" );
+    REQUIRE_FALSE( PlayerFlag::decode( *p, flag, value ) );
+
+    // Too short.
+    Packet p2( DSRV_MSG_PLAYER_SET_FLAG );
+    p2.append( (uint8_t) 1 );
+    p2.append( (uint16_t) 2 );
+    REQUIRE_FALSE( PlayerFlag::decode( p2, flag, value ) );
+
+    // The string eats the bytes of the fields behind it.
+    using StrThenInt = MessageDef<DSRV_MSG_FEEDBACK, CString, uint32_t>;
+    Packet p3( DSRV_MSG_FEEDBACK );
+    p3.append( "abc" );
+    p3.append( (uint8_t) 'd' );
+    p3.append( (uint8_t) 0 );
+    string_view s;
+    PacketView v( p3 );
+    REQUIRE_FALSE( StrThenInt::decode( v, s, value ) );
+    REQUIRE( v.getRemaining() == p3.getPayloadLen() );
+
+    // No terminating 0 at all.
+    Packet p4( DSRV_MSG_FEEDBACK );
+    p4.append( "abcdefgh", 8 );
+    REQUIRE_FALSE( StrThenInt::decode( p4, s, value ) );
+}
@@ -2,6 +2,7 @@
 #include "catch.hpp"
 #include "../include/packet.h"
 #include <memory>
+#include <vector>
 #include "../include/dsrv_constants.h"
 
 using namespace FTS;
@@ -259,6 +260,50 @@ TEST_CASE( "Extracting a string w/o terminating 0", "[Packet]" )
     // Now all following data meaningless, since the string is removed from the buffer.
 }
 
+TEST_CASE( "Getting strings", "[Packet]" )
+{
+    string sLong( 300, 'x' );
+    Packet p( DSRV_MSG_CHAT_GETMSG );
+    p.append( "" );
+    p.append( "Pompei2" );
+    p.append( sLong );
+    p.append( "Hal", 3 );
+
+    p.rewind();
+    REQUIRE( p.get_string().empty() );
+    auto s = p.get_string_view();
+    REQUIRE( s == "Pompei2" );
+    REQUIRE( (const int8_t*) s.data() == p.getPayloadPtr() + 1 );
+    REQUIRE( p.get_string() == sLong );
+
+    // No terminating 0: nothing is returned and the cursor is at the end.
+    REQUIRE( p.get_string_view().empty() );
+    REQUIRE( p.get() == 0 );
+    REQUIRE( p.get_string().empty() );
+}
+
+TEST_CASE( "Extracting many strings from a big packet", "[Packet]" )
+{
+    auto p = Packet::create( DSRV_MSG_GAME_LST, 4000 );
+    for( int i = 0; i < 300; ++i ) {
+        p->append( "Game " + to_string( i ) );
+        p->append( (uint8_t) i );
+    }
+    auto cap = p->getCapacity();
+    auto payload = p->getPayloadPtr();
+
+    // Take out all the names, keep the numbers.
+    p->rewind();
+    for( int i = 0; i < 300; ++i ) {
+        REQUIRE( p->extractString() == "Game " + to_string( i ) );
+        REQUIRE( (uint8_t) p->get() == (uint8_t) i );
+    }
+    REQUIRE( p->getPayloadLen() == 300 );
+    REQUIRE( p->getCapacity() == cap );
+    REQUIRE( p->getPayloadPtr() == payload );
+    REQUIRE( p->extractString().empty() );
+}
+
 TEST_CASE( "Transfering data", "[Packet]" )
 {
     Packet p( DSRV_MSG_LOGOUT );
@@ -301,4 +346,162 @@ TEST_CASE( "Append non generic data", "[Packet]" )
     p.get( type );
     REQUIRE( type == DSRV_CHAT_TYPE::NORMAL);
 
-}
\ No newline at end of file
+}
+
+TEST_CASE( "Capacity and reserve", "[Packet]" )
+{
+    Packet p( DSRV_MSG_PLAYER_SET );
+    REQUIRE( p.getCapacity() >= D_PACKET_HDR_LEN );
+
+    p.reserve( 20 * sizeof( std::uint32_t ) );
+    REQUIRE( p.getCapacity() >= D_PACKET_HDR_LEN + 20 * sizeof( std::uint32_t ) );
+    REQUIRE( p.getPayloadLen() == 0 );
+
+    auto ptr = p.getPayloadPtr();
+    for( std::uint32_t i = 0; i < 20; ++i ) {
+        p.append( i );
+    }
+    REQUIRE( p.getPayloadPtr() == ptr );
+    REQUIRE( p.getPayloadLen() == 20 * sizeof( std::uint32_t ) );
+
+    // Growing past the capacity at least doubles it.
+    auto cap = p.getCapacity();
+    char data[1] = { 0 };
+    while( p.getCapacity() == cap ) {
+        p.append( data, 1 );
+    }
+    REQUIRE( p.getCapacity() >= 2 * cap );
+    REQUIRE( p.getPayloadLen() < p.getCapacity() );
+
+    p.rewind();
+    for( std::uint32_t i = 0; i < 20; ++i ) {
+        std::uint32_t v = 0;
+        p.get( v );
+        REQUIRE( v == i );
+    }
+}
+
+TEST_CASE( "Small packets stay inline, big ones spill", "[Packet]" )
+{
+    Packet p( DSRV_MSG_CHAT_SENDMSG );
+    p.append( "Hello" );
+    auto pInline = p.getPayloadPtr();
+    REQUIRE( p.getCapacity() == D_PACKET_INLINE_LEN );
+
+    // Moving a small packet copies its content.
+    Packet p2( move( p ) );
+    REQUIRE( p2.getPayloadPtr() != pInline );
+    p2.rewind();
+    REQUIRE( p2.get_string() == "Hello" );
+
+    char data[D_PACKET_INLINE_LEN] = { 0 };
+    data[D_PACKET_INLINE_LEN - 1] = 42;
+    p2.append( data, sizeof( data ) );
+    REQUIRE( p2.getCapacity() > D_PACKET_INLINE_LEN );
+    REQUIRE( p2.getPayloadLen() == sizeof( "Hello" ) + sizeof( data ) );
+
+    // Moving a big packet hands over the buffer.
+    auto pHeap = p2.getPayloadPtr();
+    Packet p3( DSRV_MSG_NULL );
+    p3 = move( p2 );
+    REQUIRE( p3.getPayloadPtr() == pHeap );
+    REQUIRE( p3.getType() == DSRV_MSG_CHAT_SENDMSG );
+    p3.rewind();
+    REQUIRE( p3.get_string() == "Hello" );
+    char dataread[D_PACKET_INLINE_LEN];
+    p3.get( dataread, sizeof( dataread ) );
+    REQUIRE( dataread[D_PACKET_INLINE_LEN - 1] == 42 );
+}
+
+TEST_CASE( "Create a packet in one allocation", "[Packet]" )
+{
+    auto p = Packet::create( DSRV_MSG_GAME_LST, 1000 );
+    REQUIRE( p->isValid() );
+    REQUIRE( p->getType() == DSRV_MSG_GAME_LST );
+    REQUIRE( p->getPayloadLen() == 0 );
+    REQUIRE( p->getCapacity() >= D_PACKET_HDR_LEN + 1000 );
+    // The buffer is right behind the object.
+    REQUIRE( p->getPayloadPtr() == (int8_t*) p.get() + sizeof( Packet ) + D_PACKET_HDR_LEN );
+
+    char data[1000] = { 0 };
+    data[999] = 42;
+    p->append( data, sizeof( data ) );
+    REQUIRE( p->getPayloadPtr() == (int8_t*) p.get() + sizeof( Packet ) + D_PACKET_HDR_LEN );
+
+    // Growing beyond moves the data into a pool buffer.
+    p->append( "Hello" );
+    auto cap = p->getCapacity();
+    while( p->getCapacity() == cap ) {
+        p->append( data, sizeof( data ) );
+    }
+    REQUIRE( p->getPayloadPtr() != (int8_t*) p.get() + sizeof( Packet ) + D_PACKET_HDR_LEN );
+    p->rewind();
+    char dataread[1000];
+    p->get( dataread, sizeof( dataread ) );
+    REQUIRE( dataread[999] == 42 );
+    REQUIRE( p->get_string() == "Hello" );
+
+    // Moving out of a packet made by create copies the data.
+    auto p2 = Packet::create( DSRV_MSG_GAME_LST, 1000 );
+    p2->append( data, sizeof( data ) );
+    Packet p3( move( *p2 ) );
+    p2.reset();
+    REQUIRE( p3.getPayloadLen() == sizeof( data ) );
+    p3.rewind();
+    p3.get( dataread, sizeof( dataread ) );
+    REQUIRE( dataread[999] == 42 );
+
+    // Small packets just use the inline buffer.
+    auto p4 = Packet::create( DSRV_MSG_LOGIN, 10 );
+    REQUIRE( p4->getCapacity() == D_PACKET_INLINE_LEN );
+}
+
+TEST_CASE( "Append and get arrays", "[Packet]" )
+{
+    // Odd lengths make the byte swap run the vector and the scalar code.
+    vector<uint32_t> ids( 37 );
+    vector<uint16_t> ports( 13 );
+    vector<uint64_t> stamps( 5 );
+    for( uint32_t i = 0; i < ids.size(); ++i ) ids[i] = 0x01020304u * (i + 1);
+    for( uint16_t i = 0; i < ports.size(); ++i ) ports[i] = (uint16_t) (0x0102u + i);
+    for( uint64_t i = 0; i < stamps.size(); ++i ) stamps[i] = 0x0102030405060708ull + i;
+
+    Packet p( DSRV_MSG_PLAYER_SET );
+    p.appendArray( ids.data(), ids.size() );
+    p.appendArray( ports.data(), ports.size(), ByteOrder::Big );
+    p.appendArray( stamps.data(), stamps.size(), ByteOrder::Big );
+    REQUIRE( p.getPayloadLen() == ids.size() * 4 + ports.size() * 2 + stamps.size() * 8 );
+
+    // Host order is the same as appending one by one.
+    Packet p2( DSRV_MSG_PLAYER_SET );
+    for( auto id : ids ) p2.append( id );
+    REQUIRE( memcmp( p.getPayloadPtr(), p2.getPayloadPtr(), p2.getPayloadLen() ) == 0 );
+
+    // Big endian really is big endian.
+    auto pPorts = (const uint8_t*) p.getPayloadPtr() + ids.size() * 4;
+    REQUIRE( pPorts[0] == 0x01 );
+    REQUIRE( pPorts[1] == 0x02 );
+    auto pStamps = pPorts + ports.size() * 2;
+    REQUIRE( pStamps[0] == 0x01 );
+    REQUIRE( pStamps[7] == 0x08 );
+
+    p.rewind();
+    vector<uint32_t> ids2( ids.size() );
+    vector<uint16_t> ports2( ports.size() );
+    vector<uint64_t> stamps2( stamps.size() );
+    REQUIRE( p.getArray( ids2.data(), ids2.size() ) );
+    REQUIRE( p.getArray( ports2.data(), ports2.size(), ByteOrder::Big ) );
+    REQUIRE( p.getArray( stamps2.data(), stamps2.size(), ByteOrder::Big ) );
+    REQUIRE( ids2 == ids );
+    REQUIRE( ports2 == ports );
+    REQUIRE( stamps2 == stamps );
+
+    // Not enough left: nothing is read.
+    uint8_t rest = 0;
+    REQUIRE_FALSE( p.getArray( &rest, 1 ) );
+    p.rewind();
+    REQUIRE_FALSE( p.getArray( ids2.data(), p.getPayloadLen() ) );
+    uint32_t first = 0;
+    p.get( first );
+    REQUIRE( first == ids[0] );
+}
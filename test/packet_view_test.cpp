@@ -0,0 +1,134 @@
+#include "catch.hpp"
+#include "../include/packet_view.h"
+#include "../include/dsrv_constants.h"
+#include "../include/packet_buffer_pool.h"
+#include <vector>
+
+using namespace FTS;
+using namespace std;
+
+TEST_CASE( "View of a packet", "[PacketView]" )
+{
+    Packet p( DSRV_MSG_CHAT_GETMSG );
+    p.append( DSRV_CHAT_TYPE::WHISPER );
+    p.append( "Pompei2" );
+    p.append( 1234 );
+
+    PacketView v( p );
+    REQUIRE( v.isValid() );
+    REQUIRE( v.getType() == DSRV_MSG_CHAT_GETMSG );
+    REQUIRE( v.getPayloadLen() == p.getPayloadLen() );
+    REQUIRE( v.getPayloadPtr() == p.getPayloadPtr() );
+
+    DSRV_CHAT_TYPE type = DSRV_CHAT_TYPE::NONE;
+    REQUIRE( v.get( type ) );
+    REQUIRE( type == DSRV_CHAT_TYPE::WHISPER );
+
+    auto s = v.get_string_view();
+    REQUIRE( s == "Pompei2" );
+    // No copy: the string points into the packet.
+    REQUIRE( (const int8_t*) s.data() == p.getPayloadPtr() + 1 );
+
+    int i = 0;
+    REQUIRE( v.get( i ) );
+    REQUIRE( i == 1234 );
+    REQUIRE( v.getRemaining() == 0 );
+    REQUIRE_FALSE( v.get( i ) );
+    REQUIRE( i == 0 );
+
+    v.rewind();
+    REQUIRE( v.getRemaining() == p.getPayloadLen() );
+}
+
+TEST_CASE( "View of a frame", "[PacketView]" )
+{
+    Packet p( DSRV_MSG_LOGIN );
+    p.append( "user" );
+    p.append( "pass" );
+
+    vector<int8_t> frame( p.getPayloadPtr() - D_PACKET_HDR_LEN, p.getPayloadPtr() + p.getPayloadLen() );
+    auto v = PacketView::fromFrame( frame.data(), frame.size() );
+    REQUIRE( v.isValid() );
+    REQUIRE( v.getType() == DSRV_MSG_LOGIN );
+    REQUIRE( v.get_string_view() == "user" );
+    REQUIRE( v.get_string() == "pass" );
+
+    // Truncated frames and corrupt headers give invalid views.
+    REQUIRE_FALSE( PacketView::fromFrame( frame.data(), frame.size() - 1 ).isValid() );
+    REQUIRE_FALSE( PacketView::fromFrame( frame.data(), 3 ).isValid() );
+    frame[0] = 'X';
+    REQUIRE_FALSE( PacketView::fromFrame( frame.data(), frame.size() ).isValid() );
+}
+
+TEST_CASE( "View strings w/o terminating 0", "[PacketView]" )
+{
+    char data[5] = { 'H', 'a', 'l', 'l', 'o' };
+    PacketView v( DSRV_MSG_NULL, data, sizeof( data ) );
+    REQUIRE( v.get_string_view().empty() );
+    REQUIRE( v.getRemaining() == 0 );
+}
+
+TEST_CASE( "Nested packet views", "[PacketView]" )
+{
+    Packet inner( DSRV_MSG_CHAT_GETMSG );
+    inner.append( "Hallo Otto!" );
+
+    Packet outer( DSRV_MSG_CHAT_MOTTO_GET );
+    outer.append( (uint8_t) 7 );
+    inner.writeToPacket( &outer );
+    outer.append( (uint8_t) 8 );
+
+    PacketView v( outer );
+    REQUIRE( v.get() == 7 );
+    auto nested = v.getPacketView();
+    REQUIRE( nested.isValid() );
+    REQUIRE( nested.getType() == DSRV_MSG_CHAT_GETMSG );
+    REQUIRE( nested.getPayloadLen() == inner.getPayloadLen() );
+    REQUIRE( nested.get_string_view() == "Hallo Otto!" );
+    REQUIRE( v.get() == 8 );
+
+    // Not enough bytes for a nested packet.
+    v.rewind();
+    v.get();
+    v.get();
+    REQUIRE_FALSE( v.getPacketView().isValid() );
+    REQUIRE( v.getRemaining() == 0 );
+}
+
+TEST_CASE( "Copy binary data out of a view", "[PacketView]" )
+{
+    char data[10] = { 1,2,3,4,5,6,7,8,9,0 };
+    PacketView v( DSRV_MSG_NULL, data, sizeof( data ) );
+    char out[10] = { 0 };
+    REQUIRE( v.get( out, 4 ) == 4 );
+    REQUIRE( out[3] == 4 );
+    REQUIRE( v.get( out, 0 ) == 6 );
+    REQUIRE( out[5] == 0 );
+    REQUIRE( out[0] == 5 );
+}
+
+TEST_CASE( "A view is copied into a packet with one allocation", "[PacketView]" )
+{
+    auto& pool = PacketBufferPool::instance();
+
+    // Fills a size class exactly, and goes beyond the biggest one.
+    void* pBlock = pool.allocate( sizeof( Packet ) + 200 );
+    size_t uiBoundary = PacketBufferPool::capacity( pBlock ) - sizeof( Packet ) - D_PACKET_HDR_LEN;
+    pool.release( pBlock );
+    size_t uiHuge = pool.getClasses().back() + 1000;
+
+    for( size_t uiLen : { uiBoundary, uiHuge } ) {
+        vector<char> payload( uiLen, 'x' );
+        payload.back() = 'y';
+        PacketView v( DSRV_MSG_CHAT_GETMSG, payload.data(), payload.size() );
+
+        auto before = pool.getStats().allocations;
+        PacketPtr p = v.toPacket();
+        CHECK( pool.getStats().allocations - before == 1 );
+        // Still the storage right behind the packet.
+        CHECK( p->getCapacity() == D_PACKET_HDR_LEN + uiLen );
+        CHECK( p->getPayloadLen() == uiLen );
+        CHECK( p->getType() == DSRV_MSG_CHAT_GETMSG );
+        CHECK( memcmp( p->getPayloadPtr(), payload.data(), uiLen ) == 0 );
+    }
+}
@@ -0,0 +1,177 @@
+#include "catch.hpp"
+#include "../include/reactor.h"
+#include "../include/dsrv_constants.h"
+#include "../src/socket_connection_waiter.h"
+#include <thread>
+#include <vector>
+
+using namespace FTS;
+using namespace std;
+
+// Ports of earlier runs may still be in TIME_WAIT.
+static uint16_t listenOnFreePort( Reactor& io_reactor, Reactor::AcceptCallback in_onAccept )
+{
+    for( uint16_t usPort = 33220; usPort < 33240; ++usPort ) {
+        if( io_reactor.listen( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ), usPort, in_onAccept ) == 0 ) {
+            return usPort;
+        }
+    }
+    return 0;
+}
+
+TEST_CASE( "One reactor thread serves many connections", "[Reactor]" )
+{
+    const int nClients = 50;
+    Reactor reactor;
+    int nClosed = 0;
+
+    // Echoes everything, stops when the last client is gone.
+    uint16_t usPort = listenOnFreePort( reactor, [&]( Connection* in_pCon ) {
+        REQUIRE( reactor.add( in_pCon, []( Connection& in_con, PacketPtr in_p ) { in_con.send( in_p.get() ); },
+                              [&]( Connection& ) { if( ++nClosed == nClients ) reactor.stop(); } ) );
+    } );
+    REQUIRE( usPort != 0 );
+
+    thread server( [&reactor] { reactor.run(); } );
+
+    vector<unique_ptr<Connection>> cons;
+    for( int i = 0; i < nClients; ++i ) {
+        cons.emplace_back( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 2000 ) );
+        REQUIRE( cons.back()->isConnected() );
+    }
+
+    // All at once, then all answers.
+    for( uint32_t i = 0; i < nClients; ++i ) {
+        Packet p( DSRV_MSG_CHAT_GETMSG );
+        p.append( i );
+        REQUIRE( cons[i]->send( &p ) == FTSC_ERR::OK );
+    }
+    for( uint32_t i = 0; i < nClients; ++i ) {
+        PacketPtr p = cons[i]->receivePacket();
+        REQUIRE( p != nullptr );
+        uint32_t id = 0;
+        p->get( id );
+        CHECK( id == i );
+    }
+
+    for( auto& pCon : cons ) {
+        pCon->disconnect();
+    }
+    server.join();
+    REQUIRE( nClosed == nClients );
+    REQUIRE( reactor.getConnectionCount() == 0 );
+}
+
+TEST_CASE( "Callbacks may remove their own connection", "[Reactor]" )
+{
+    Reactor reactor;
+    Connection* pServed = nullptr;
+    int nPackets = 0;
+
+    uint16_t usPort = listenOnFreePort( reactor, [&]( Connection* in_pCon ) {
+        pServed = in_pCon;
+        reactor.add( in_pCon, [&]( Connection& in_con, PacketPtr ) {
+            ++nPackets;
+            reactor.remove( &in_con );
+        } );
+    } );
+    REQUIRE( usPort != 0 );
+
+    unique_ptr<Connection> pCli( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 2000 ) );
+    REQUIRE( pCli->isConnected() );
+    Packet p( DSRV_MSG_CHAT_GETMSG );
+    p.append( (uint32_t) 1 );
+    pCli->cork();
+    pCli->send( &p );
+    pCli->send( &p );
+    pCli->flush();
+
+    auto until = EventLoop::Clock::now() + chrono::seconds( 2 );
+    while( pServed == nullptr || reactor.getConnectionCount() != 0 ) {
+        reactor.runOnce( 50 );
+        REQUIRE( EventLoop::Clock::now() < until );
+    }
+    reactor.runOnce( 50 );
+    REQUIRE( nPackets == 1 );
+}
+
+TEST_CASE( "More packets than are taken per wakeup all arrive", "[Reactor]" )
+{
+    const int nBurst = 3 * D_REACTOR_MAX_PACKETS_PER_WAKEUP + 8;
+    Reactor reactor;
+    int nPackets = 0;
+
+    uint16_t usPort = listenOnFreePort( reactor, [&]( Connection* in_pCon ) {
+        reactor.add( in_pCon, [&]( Connection&, PacketPtr ) { ++nPackets; } );
+    } );
+    REQUIRE( usPort != 0 );
+
+    unique_ptr<Connection> pCli( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 2000 ) );
+    REQUIRE( pCli->isConnected() );
+    auto until = EventLoop::Clock::now() + chrono::seconds( 2 );
+    while( reactor.getConnectionCount() == 0 ) {
+        reactor.runOnce( 50 );
+        REQUIRE( EventLoop::Clock::now() < until );
+    }
+
+    // All in one go, so they are all received with the first read.
+    Packet p( DSRV_MSG_CHAT_GETMSG );
+    p.append( (uint32_t) 1 );
+    pCli->setFlushThreshold( (size_t) -1 );
+    pCli->cork();
+    for( int i = 0; i < nBurst; ++i ) {
+        pCli->send( &p );
+    }
+    REQUIRE( pCli->flush() == FTSC_ERR::OK );
+
+    while( nPackets < nBurst ) {
+        reactor.runOnce( 50 );
+        REQUIRE( EventLoop::Clock::now() < until );
+    }
+    reactor.runOnce( 50 );
+    CHECK( nPackets == nBurst );
+}
+
+TEST_CASE( "A reactor that stops listening frees its port", "[Reactor]" )
+{
+    Reactor reactor;
+    uint16_t usPort = listenOnFreePort( reactor, []( Connection* in_pCon ) { delete in_pCon; } );
+    REQUIRE( usPort != 0 );
+
+    unique_ptr<ConnectionWaiter> pOther( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ) );
+    REQUIRE( pOther->init( usPort, []( Connection* in_pCon ) { delete in_pCon; } ) != 0 );
+
+    reactor.stopListening();
+    reactor.stopListening();
+    pOther.reset( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ) );
+    CHECK( pOther->init( usPort, []( Connection* in_pCon ) { delete in_pCon; } ) == 0 );
+}
+
+namespace {
+
+/// Has no listening socket, like a waiter of another kind.
+class NoSocketWaiter : public ConnectionWaiter {
+public:
+    int init( uint16_t, function<void( Connection* )>, const ConnectionOptions& ) { return 0; }
+    bool waitForThenDoConnection( int64_t ) { return false; }
+};
+
+}
+
+TEST_CASE( "A reactor refuses waiters whose connections it can't serve", "[Reactor]" )
+{
+    Reactor reactor;
+    CHECK( reactor.listen( new NoSocketWaiter, 33220, []( Connection* in_pCon ) { delete in_pCon; } ) == -1 );
+
+    // Where there is no io_uring, it is a SOCKET waiter.
+    unique_ptr<ConnectionWaiter> pProbe( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::URING ) );
+    bool bUring = static_cast<SocketConnectionWaiter*>( pProbe.get() )->getType() == ConnectionWaiter::ConnectionType::URING;
+    int iRet = -1;
+    for( uint16_t usPort = 33220; usPort < 33240 && iRet != 0; ++usPort ) {
+        iRet = reactor.listen( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::URING ), usPort, []( Connection* in_pCon ) { delete in_pCon; } );
+        if( bUring ) {
+            break;
+        }
+    }
+    CHECK( iRet == ( bUring ? -1 : 0 ) );
+}
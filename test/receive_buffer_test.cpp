@@ -0,0 +1,47 @@
+#include "catch.hpp"
+#include "../src/receive_buffer.h"
+#include <cstring>
+
+using namespace FTS;
+using namespace std;
+
+TEST_CASE( "Receive into and read from the buffer", "[ReceiveBuffer]" )
+{
+    ReceiveBuffer buf( 64 );
+    REQUIRE( buf.empty() );
+
+    size_t uiFree = 0;
+    auto p = buf.prepare( uiFree );
+    REQUIRE( uiFree == 64 );
+    memcpy( p, "Hello World", 11 );
+    buf.commit( 11 );
+    REQUIRE( buf.size() == 11 );
+    REQUIRE( memcmp( buf.data(), "Hello", 5 ) == 0 );
+
+    char out[16] = { 0 };
+    REQUIRE( buf.read( out, 6 ) == 6 );
+    REQUIRE( string( out ) == "Hello " );
+    REQUIRE( buf.read( out, sizeof( out ) ) == 5 );
+    REQUIRE( buf.empty() );
+
+    // Reading everything starts over at the front.
+    buf.prepare( uiFree );
+    REQUIRE( uiFree == 64 );
+}
+
+TEST_CASE( "The unread bytes move to the front when the end is full", "[ReceiveBuffer]" )
+{
+    ReceiveBuffer buf( 64 );
+    size_t uiFree = 0;
+    auto p = buf.prepare( uiFree );
+    for( size_t i = 0; i < 60; ++i ) p[i] = (int8_t) i;
+    buf.commit( 60 );
+    buf.consume( 50 );
+
+    p = buf.prepare( uiFree );
+    REQUIRE( uiFree == 54 );
+    REQUIRE( buf.size() == 10 );
+    REQUIRE( buf.data()[0] == 50 );
+    REQUIRE( buf.data()[9] == 59 );
+    REQUIRE( p == buf.data() + 10 );
+}
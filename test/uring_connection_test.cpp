@@ -0,0 +1,175 @@
+#include "catch.hpp"
+#include "../include/connection.h"
+#include "../include/connection_waiter.h"
+#include "../include/dsrv_constants.h"
+#include "../src/socket_connection_waiter.h"
+#include "../src/uring_connection.h"
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace FTS;
+using namespace std;
+
+#if defined(FTS_NET_HAVE_URING)
+
+// Ports of earlier runs may still be in TIME_WAIT.
+static ConnectionWaiter *listenOnFreePort( uint16_t& out_usPort, unique_ptr<Connection>& out_pCon )
+{
+    for( out_usPort = 33250; out_usPort < 33270; ++out_usPort ) {
+        auto pWaiter = ConnectionWaiter::create( ConnectionWaiter::ConnectionType::URING );
+        if( pWaiter->init( out_usPort, [&out_pCon]( Connection* in_pCon ) { out_pCon.reset( in_pCon ); } ) == 0 ) {
+            return pWaiter;
+        }
+        delete pWaiter;
+    }
+    return nullptr;
+}
+
+TEST_CASE( "io_uring connections exchange packets", "[UringConnection]" )
+{
+    uint16_t usPort = 0;
+    unique_ptr<Connection> pSrv;
+    unique_ptr<ConnectionWaiter> pWaiter( listenOnFreePort( usPort, pSrv ) );
+    REQUIRE( pWaiter != nullptr );
+
+    // Nobody there yet: the accept stays submitted for the next wait.
+    REQUIRE( !pWaiter->waitForThenDoConnection( 20 ) );
+
+    unique_ptr<Connection> pCli( Connection::create( Connection::eConnectionType::D_CONNECTION_URING, "127.0.0.1", usPort, 2000 ) );
+    REQUIRE( pCli->isConnected() );
+    REQUIRE( pCli->getType() == Connection::eConnectionType::D_CONNECTION_URING );
+    REQUIRE( pWaiter->waitForThenDoConnection( 2000 ) );
+    REQUIRE( pSrv != nullptr );
+    REQUIRE( pSrv->getType() == Connection::eConnectionType::D_CONNECTION_URING );
+
+    // Bigger than the registered buffer, so it takes several receives.
+    vector<uint8_t> big( 200000 );
+    for( size_t i = 0; i < big.size(); ++i ) {
+        big[i] = (uint8_t) ( i * 7 );
+    }
+
+    thread server( [&pSrv] {
+        pSrv->setMaxWaitMillisec( 2000 );
+        while( pSrv->isConnected() ) {
+            auto p = pSrv->receivePacket();
+            if( p != nullptr ) {
+                pSrv->send( p.get() );
+            }
+        }
+    } );
+
+    PacketPtr p = Packet::create( DSRV_MSG_CHAT_GETMSG, 4 );
+    p->append( (uint32_t) 42 );
+    REQUIRE( pCli->mreq( p ) == FTSC_ERR::OK );
+    uint32_t id = 0;
+    p->get( id );
+    REQUIRE( id == 42 );
+
+    Packet bigPacket( DSRV_MSG_PLAYER_SET );
+    bigPacket.append( big.data(), big.size() );
+    REQUIRE( pCli->send( &bigPacket ) == FTSC_ERR::OK );
+    PacketPtr pEcho = pCli->receivePacket();
+    REQUIRE( pEcho != nullptr );
+    REQUIRE( pEcho->getPayloadLen() == big.size() );
+    vector<uint8_t> got( big.size() );
+    pEcho->get( got.data(), got.size() );
+    REQUIRE( got == big );
+
+    // Corked packets go out in one send.
+    pCli->cork();
+    for( uint32_t i = 0; i < 10; ++i ) {
+        Packet q( DSRV_MSG_CHAT_GETMSG );
+        q.append( i );
+        pCli->send( &q );
+    }
+    REQUIRE( pCli->flush() == FTSC_ERR::OK );
+    for( uint32_t i = 0; i < 10; ++i ) {
+        PacketPtr pAnswer = pCli->receivePacket();
+        REQUIRE( pAnswer != nullptr );
+        pAnswer->get( id );
+        CHECK( id == i );
+    }
+
+    pCli->disconnect();
+    server.join();
+    REQUIRE( !pSrv->isConnected() );
+}
+
+TEST_CASE( "io_uring receives keep waiting after a time out", "[UringConnection]" )
+{
+    uint16_t usPort = 0;
+    unique_ptr<Connection> pSrv;
+    unique_ptr<ConnectionWaiter> pWaiter( listenOnFreePort( usPort, pSrv ) );
+    REQUIRE( pWaiter != nullptr );
+
+    unique_ptr<Connection> pCli( Connection::create( Connection::eConnectionType::D_CONNECTION_URING, "127.0.0.1", usPort, 2000 ) );
+    REQUIRE( pWaiter->waitForThenDoConnection( 2000 ) );
+
+    pCli->setMaxWaitMillisec( 20 );
+    REQUIRE( pCli->receivePacket() == nullptr );
+    REQUIRE( pCli->isConnected() );
+
+    // What comes after the time out lands in the receive still submitted.
+    Packet p( DSRV_MSG_LOGIN );
+    p.append( (uint32_t) 7 );
+    REQUIRE( pSrv->send( &p ) == FTSC_ERR::OK );
+    pCli->setMaxWaitMillisec( 2000 );
+    PacketPtr pGot = pCli->receivePacket();
+    REQUIRE( pGot != nullptr );
+    REQUIRE( pGot->getType() == DSRV_MSG_LOGIN );
+
+    // One system call for each direction.
+    auto before = pCli->getIoStats();
+    PacketPtr pReq = Packet::create( DSRV_MSG_CHAT_GETMSG, 4 );
+    pReq->append( (uint32_t) 1 );
+    pCli->send( pReq.get() );
+    PacketPtr pOnServer = pSrv->receivePacket();
+    REQUIRE( pOnServer != nullptr );
+    pSrv->send( pOnServer.get() );
+    REQUIRE( pCli->receivePacket() != nullptr );
+    auto after = pCli->getIoStats();
+    if( static_cast<UringConnection*>( pCli.get() )->isUsingUring() ) {
+        CHECK( after.sendCalls - before.sendCalls == 1 );
+        CHECK( after.recvCalls - before.recvCalls <= 1 );
+        CHECK( after.waitCalls == before.waitCalls );
+    }
+
+    pSrv->disconnect();
+    REQUIRE( pCli->receivePacket() == nullptr );
+    REQUIRE( !pCli->isConnected() );
+}
+
+TEST_CASE( "The io_uring waiter hands out all connections waiting and never blocks", "[UringConnection]" )
+{
+    uint16_t usPort = 0;
+    vector<unique_ptr<Connection>> accepted;
+    unique_ptr<Connection> pFirst;
+    unique_ptr<ConnectionWaiter> pWaiter( listenOnFreePort( usPort, pFirst ) );
+    REQUIRE( pWaiter != nullptr );
+
+    // Done by the kernel, they all wait in the backlog.
+    vector<unique_ptr<Connection>> cons;
+    for( int i = 0; i < 3; ++i ) {
+        cons.emplace_back( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 2000 ) );
+        REQUIRE( cons.back()->isConnected() );
+    }
+
+    REQUIRE( pWaiter->waitForThenDoConnection( 2000 ) );
+    REQUIRE( pFirst != nullptr );
+    CHECK( pWaiter->getAcceptStats().wakeups == 1 );
+    CHECK( pWaiter->getAcceptStats().accepted == 3 );
+
+    // As a reactor accepts: until nobody is there, which must not wait.
+    auto pSocketWaiter = static_cast<SocketConnectionWaiter*>( pWaiter.get() );
+    cons.emplace_back( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 2000 ) );
+    this_thread::sleep_for( chrono::milliseconds( 20 ) );
+    while( Connection *pCon = pSocketWaiter->acceptIfAny() ) {
+        CHECK( pCon->getType() == Connection::eConnectionType::D_CONNECTION_URING );
+        accepted.emplace_back( pCon );
+    }
+    CHECK( accepted.size() == 1 );
+}
+
+#endif
@@ -0,0 +1,139 @@
+#include "catch.hpp"
+#include "../include/worker_pool.h"
+#include "../include/dsrv_constants.h"
+#include "../src/TraditionalConnection.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#  include <sys/socket.h>
+#  include <unistd.h>
+#endif
+
+using namespace FTS;
+using namespace std;
+
+// Ports of earlier runs may still be in TIME_WAIT.
+static uint16_t listenOnFreePort( WorkerPool& io_pool, WorkerPool::ConnectionCallback in_onConnection )
+{
+    for( uint16_t usPort = 33320; usPort < 33340; ++usPort ) {
+        if( io_pool.listen( ConnectionWaiter::create( ConnectionWaiter::ConnectionType::SOCKET ), usPort, in_onConnection ) == 0 ) {
+            return usPort;
+        }
+    }
+    return 0;
+}
+
+static bool waitUntil( function<bool()> in_cond )
+{
+    auto until = chrono::steady_clock::now() + chrono::seconds( 2 );
+    while( !in_cond() ) {
+        if( chrono::steady_clock::now() > until ) {
+            return false;
+        }
+        this_thread::sleep_for( chrono::milliseconds( 1 ) );
+    }
+    return true;
+}
+
+TEST_CASE( "The worker pool hands each connection to the least loaded worker", "[WorkerPool]" )
+{
+    const int nClients = 30;
+    WorkerPool pool( 3 );
+    REQUIRE( pool.getWorkerCount() == 3 );
+
+    uint16_t usPort = listenOnFreePort( pool, []( Reactor& io_reactor, Connection* in_pCon ) {
+        io_reactor.add( in_pCon, []( Connection& in_con, PacketPtr in_p ) { in_con.send( in_p.get() ); } );
+    } );
+    REQUIRE( usPort != 0 );
+    pool.start();
+
+    vector<unique_ptr<Connection>> cons;
+    for( int i = 0; i < nClients; ++i ) {
+        cons.emplace_back( Connection::create( Connection::eConnectionType::D_CONNECTION_TRADITIONAL, "127.0.0.1", usPort, 2000 ) );
+        REQUIRE( cons.back()->isConnected() );
+    }
+    for( uint32_t i = 0; i < nClients; ++i ) {
+        Packet p( DSRV_MSG_CHAT_GETMSG );
+        p.append( i );
+        REQUIRE( cons[i]->send( &p ) == FTSC_ERR::OK );
+    }
+    for( uint32_t i = 0; i < nClients; ++i ) {
+        PacketPtr p = cons[i]->receivePacket();
+        REQUIRE( p != nullptr );
+        uint32_t id = 0;
+        p->get( id );
+        CHECK( id == i );
+    }
+
+    // Nobody has left yet, so they are dealt out evenly.
+    for( size_t i = 0; i < pool.getWorkerCount(); ++i ) {
+        CHECK( pool.getLoad( i ) == nClients / 3 );
+    }
+
+    // The ones that left don't count anymore.
+    for( int i = 0; i < nClients / 3; ++i ) {
+        cons[i]->disconnect();
+    }
+    CHECK( waitUntil( [&pool] { return pool.getLoad( 0 ) + pool.getLoad( 1 ) + pool.getLoad( 2 ) == nClients - nClients / 3; } ) );
+    CHECK( pool.getDropped() == 0 );
+    pool.stop();
+}
+
+#if !defined(_WIN32)
+// One end of a socket pair, the other one is closed.
+static Connection *makeConnection()
+{
+    int fds[2];
+    if( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) != 0 ) {
+        return nullptr;
+    }
+    close( fds[1] );
+    SOCKADDR_IN sa = {};
+    return new TraditionalConnection( fds[0], sa );
+}
+
+TEST_CASE( "A slow connection callback doesn't hold up the other workers", "[WorkerPool]" )
+{
+    WorkerPool pool( 2, 2 );
+    atomic<int> nHandled( 0 );
+    atomic<bool> bSlowNext( false );
+    atomic<bool> bSleeping( false );
+    pool.setConnectionCallback( [&]( Reactor&, Connection* in_pCon ) {
+        delete in_pCon;
+        if( bSlowNext.exchange( false ) ) {
+            bSleeping = true;
+            this_thread::sleep_for( chrono::milliseconds( 500 ) );
+        }
+        ++nHandled;
+    } );
+
+    // Not started, so they wait in the queues: 2 workers with 2 places each.
+    for( int i = 0; i < 4; ++i ) {
+        CHECK( pool.dispatch( makeConnection() ) );
+    }
+    CHECK_FALSE( pool.dispatch( makeConnection() ) );
+    CHECK( pool.getDropped() == 1 );
+    CHECK( pool.getLoad( 0 ) == 2 );
+    CHECK( pool.getLoad( 1 ) == 2 );
+
+    pool.start();
+    REQUIRE( waitUntil( [&] { return nHandled == 4 && pool.getLoad( 0 ) + pool.getLoad( 1 ) == 0; } ) );
+
+    // The sleeper keeps its load of 1, so the next ones go to the other
+    // worker, which handles them meanwhile.
+    bSlowNext = true;
+    CHECK( pool.dispatch( makeConnection() ) );
+    REQUIRE( waitUntil( [&bSleeping] { return bSleeping.load(); } ) );
+    auto start = chrono::steady_clock::now();
+    for( int i = 0; i < 3; ++i ) {
+        CHECK( pool.dispatch( makeConnection() ) );
+        REQUIRE( waitUntil( [&nHandled, i] { return nHandled == 5 + i; } ) );
+    }
+    CHECK( chrono::steady_clock::now() - start < chrono::milliseconds( 500 ) );
+    pool.stop();
+    CHECK( nHandled == 8 );
+}
+#endif